@@ -9,9 +9,10 @@
 
 MAD_PATH="/usr/include/infiniband/mad.h"
 
-counters=(IB_PC_EXT_ERR_RCV_F IB_PC_EXT_ERR_PHYSRCV_F IB_PC_EXT_ERR_SWITCH_REL_F IB_PC_EXT_XMT_DISCARDS_F \
+counters=(IB_PC_EXT_ERR_SYM_F IB_PC_EXT_LINK_RECOVERS_F IB_PC_EXT_LINK_DOWNED_F \
+          IB_PC_EXT_ERR_RCV_F IB_PC_EXT_ERR_PHYSRCV_F IB_PC_EXT_ERR_SWITCH_REL_F IB_PC_EXT_XMT_DISCARDS_F \
           IB_PC_EXT_ERR_XMTCONSTR_F IB_PC_EXT_ERR_RCVCONSTR_F IB_PC_EXT_ERR_LOCALINTEG_F \
-          IB_PC_EXT_ERR_EXCESS_OVR_F IB_PC_EXT_XMT_WAIT_F)
+          IB_PC_EXT_ERR_EXCESS_OVR_F IB_PC_EXT_VL15_DROPPED_F IB_PC_EXT_XMT_WAIT_F)
 
 if [ ! -f ${MAD_PATH} ]; then
     printf "0"
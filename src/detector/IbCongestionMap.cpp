@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include "IbCongestionMap.h"
+#include "IbNode.h"
+
+namespace Detector {
+
+std::ostream &operator<<(std::ostream &os, const IbLinkCongestion &o) {
+    const char *direction = o.direction == LINK_DIRECTION_UPSTREAM ? "upstream" :
+                            o.direction == LINK_DIRECTION_DOWNSTREAM ? "downstream" : "unknown";
+
+    return os
+            << "GUID: " << std::hex << o.nodeGuid << ", "
+            << "LID: " << o.lid << ", "
+            << "Port: " << std::dec << unsigned(o.portNum) << " -> "
+            << "GUID: " << std::hex << o.remoteGuid << ", "
+            << "Port: " << std::dec << unsigned(o.remotePortNum) << ", "
+            << "Link width: " << unsigned(o.linkWidth) << "x, "
+            << "Stalled: " << o.stallFraction * 100 << "%, "
+            << "Direction: " << direction;
+}
+
+IbCongestionMap::IbCongestionMap(double tickDuration) :
+        m_tickDuration(tickDuration),
+        m_snapshots(),
+        m_links() {
+
+}
+
+IbPerfRates IbCongestionMap::GetPortRates(uint64_t nodeGuid, const IbPort &port, SnapshotMap &snapshots) const {
+    const IbSampleHistory *history = port.GetHistory();
+    IbPerfSnapshot samples[2];
+
+    if (history != nullptr && history->GetLatest(samples, 2) == 2) {
+        return IbPerfCounter::CalculateRates(samples[0], samples[1]);
+    }
+
+    auto key = std::make_pair(nodeGuid, port.GetNum());
+    IbPerfSnapshot current = port.GetPublishedSnapshot();
+    auto known = m_snapshots.find(key);
+    std::pair<IbPerfSnapshot, IbPerfSnapshot> latest(IbPerfSnapshot{}, current);
+
+    // Without a refresh since the last update, the last two snapshots stay the same.
+    if (known != m_snapshots.end()) {
+        latest = current.timestamp > known->second.second.timestamp ?
+                 std::make_pair(known->second.second, current) : known->second;
+    }
+
+    snapshots[key] = latest;
+
+    return IbPerfCounter::CalculateRates(latest.first, latest.second);
+}
+
+void IbCongestionMap::Update(const std::vector<IbNode *> &nodes) {
+    SnapshotMap snapshots;
+    std::unordered_map<uint64_t, std::vector<uint64_t>> neighbours;
+    std::unordered_map<uint64_t, uint32_t> levels;
+    std::deque<uint64_t> queue;
+
+    m_links.clear();
+
+    // Collect the links. End nodes, including link partners outside of the given nodes, start with level 0.
+    for (IbNode *node : nodes) {
+        for (const IbPort *port : node->GetPorts()) {
+            const IbPort::Capabilities &capabilities = port->GetCapabilities();
+
+            if (capabilities.nodeType != IB_NODE_SWITCH && levels.emplace(node->GetGuid(), 0).second) {
+                queue.push_back(node->GetGuid());
+            }
+
+            if (capabilities.remoteGuid == 0) {
+                continue;
+            }
+
+            neighbours[node->GetGuid()].push_back(capabilities.remoteGuid);
+            neighbours[capabilities.remoteGuid].push_back(node->GetGuid());
+
+            if (capabilities.remoteNodeType != IB_NODE_SWITCH && levels.emplace(capabilities.remoteGuid, 0).second) {
+                queue.push_back(capabilities.remoteGuid);
+            }
+
+            if (!port->IsXmitWaitSupported() || !port->IsCounterSelected(COUNTER_XMIT_WAIT)) {
+                continue;
+            }
+
+            IbPerfRates rates = GetPortRates(node->GetGuid(), *port, snapshots);
+
+            if (rates.interval <= 0) {
+                continue;
+            }
+
+            IbLinkCongestion link{};
+            link.nodeGuid = node->GetGuid();
+            link.lid = capabilities.lid;
+            link.portNum = capabilities.portNum;
+            link.nodeType = capabilities.nodeType;
+            link.linkWidth = port->GetLinkWidth();
+            link.remoteGuid = capabilities.remoteGuid;
+            link.remotePortNum = capabilities.remotePortNum;
+            link.remoteNodeType = capabilities.remoteNodeType;
+            link.interval = rates.interval;
+            // The rate is given in ticks per second, so multiplying it with the tick's duration gives the fraction.
+            link.stallFraction = std::min(1.0, rates.values[COUNTER_XMIT_WAIT] * m_tickDuration / 1000000000.0);
+
+            m_links.push_back(link);
+        }
+    }
+
+    // Ports, that have not been seen by this update (e.g. after a rediscovery), are forgotten.
+    m_snapshots.swap(snapshots);
+
+    // Assign each switch its distance to the nearest end node (breadth-first search from all end nodes at once).
+    while (!queue.empty()) {
+        uint64_t guid = queue.front();
+        queue.pop_front();
+
+        for (uint64_t neighbour : neighbours[guid]) {
+            if (levels.emplace(neighbour, levels[guid] + 1).second) {
+                queue.push_back(neighbour);
+            }
+        }
+    }
+
+    for (IbLinkCongestion &link : m_links) {
+        auto level = levels.find(link.nodeGuid);
+        auto remoteLevel = levels.find(link.remoteGuid);
+
+        if (level == levels.end() || remoteLevel == levels.end() || level->second == remoteLevel->second) {
+            link.direction = LINK_DIRECTION_UNKNOWN;
+        } else {
+            link.direction = remoteLevel->second > level->second ? LINK_DIRECTION_UPSTREAM : LINK_DIRECTION_DOWNSTREAM;
+        }
+    }
+
+    std::stable_sort(m_links.begin(), m_links.end(), [](const IbLinkCongestion &a, const IbLinkCongestion &b) {
+        return a.stallFraction != b.stallFraction ? a.stallFraction > b.stallFraction : a.linkWidth > b.linkWidth;
+    });
+}
+
+std::vector<IbLinkCongestion> IbCongestionMap::GetCongestedLinks(double threshold, size_t maxLinks) const {
+    std::vector<IbLinkCongestion> links;
+
+    for (const IbLinkCongestion &link : m_links) {
+        if (link.stallFraction < threshold || links.size() >= maxLinks) {
+            break;
+        }
+
+        links.push_back(link);
+    }
+
+    return links;
+}
+
+}
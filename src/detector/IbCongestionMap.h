@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#ifndef DETECTOR_IBCONGESTIONMAP_H
+#define DETECTOR_IBCONGESTIONMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+#include "IbPerfSnapshot.h"
+
+namespace Detector {
+
+class IbNode;
+class IbPort;
+
+/**
+ * The direction, in which a link transmits, relative to the switch hierarchy.
+ */
+enum IbLinkDirection {
+    LINK_DIRECTION_UNKNOWN,
+    LINK_DIRECTION_UPSTREAM,
+    LINK_DIRECTION_DOWNSTREAM
+};
+
+/**
+ * The congestion of a single link in the transmitting direction of one of its ports.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+struct IbLinkCongestion {
+    /**
+     * The GUID of the transmitting port's node.
+     */
+    uint64_t nodeGuid;
+
+    /**
+     * The transmitting port's local id.
+     */
+    uint16_t lid;
+
+    /**
+     * The transmitting port's number.
+     */
+    uint8_t portNum;
+
+    /**
+     * The type of the transmitting port's node (see MAD_NODE_TYPE).
+     */
+    uint8_t nodeType;
+
+    /**
+     * The link's width.
+     */
+    uint8_t linkWidth;
+
+    /**
+     * The number of the receiving port.
+     */
+    uint8_t remotePortNum;
+
+    /**
+     * The type of the receiving port's node (see MAD_NODE_TYPE).
+     */
+    uint8_t remoteNodeType;
+
+    /**
+     * The GUID of the receiving port's node.
+     */
+    uint64_t remoteGuid;
+
+    /**
+     * The interval, over which the stall fraction has been calculated (in seconds).
+     */
+    double interval;
+
+    /**
+     * The fraction of the interval (0 to 1), in which the transmitting port had data to send, but could not send it.
+     */
+    double stallFraction;
+
+    /**
+     * Whether the link transmits towards the core of the network or towards the end nodes.
+     */
+    IbLinkDirection direction;
+};
+
+/**
+ * Write a link's congestion to an output stream.
+ */
+std::ostream &operator<<(std::ostream &os, const IbLinkCongestion &o);
+
+/**
+ * Turns the transmission-wait counters of a fabric's ports into a map of congested links.
+ *
+ * PortXmitWait counts the ticks, in which a port had data to send, but could not send anything (e.g. because the
+ * receiver had no free buffer credits). The map divides the increase of this counter between the last two
+ * refreshes of each port by the amount of ticks in this interval, which gives the fraction of time, in which the
+ * link has been stalled. The duration of a tick is device-specific and therefore needs to be configured.
+ *
+ * The counters are only read from the ports' published snapshots and histories, so the map may be updated by
+ * another thread, while the fabric is being refreshed. If a port keeps a history (see
+ * IbPerfCounter::SetHistoryCapacity()), its last two samples are used. Otherwise, the map remembers the last two
+ * published snapshots, that it has seen itself, so the ports need to have been refreshed between two updates.
+ *
+ * Each link is also classified as upstream or downstream of its switch. Every node is assigned a level: End nodes
+ * (HCAs and routers) have level 0 and switches have their distance in hops to the nearest end node. A link transmits
+ * upstream, if the receiving node has a higher level than the transmitting one, and downstream, if it has a lower
+ * one. In a fat tree, a stalled leaf-to-spine link is upstream and a stalled leaf-to-host link is downstream.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbCongestionMap {
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param tickDuration The duration of a PortXmitWait-tick in nanoseconds
+     */
+    explicit IbCongestionMap(double tickDuration);
+
+    /**
+     * Destructor.
+     */
+    ~IbCongestionMap() = default;
+
+    /**
+     * Rebuild the map from the current rates of the nodes' ports. The ports need to have been refreshed
+     * at least twice (see above). Ports without a link partner or without a transmission-wait counter are left out.
+     *
+     * @param nodes The nodes (e.g. IbFabric::GetNodes())
+     */
+    void Update(const std::vector<IbNode *> &nodes);
+
+    /**
+     * Get all links, ordered from the most to the least congested one.
+     * Links with the same stall fraction are ordered by their width, since a wider link loses more bandwidth.
+     */
+    const std::vector<IbLinkCongestion> &GetLinks() const {
+        return m_links;
+    }
+
+    /**
+     * Get the most congested links.
+     *
+     * @param threshold The minimum stall fraction of a link (0 to 1)
+     * @param maxLinks The maximum amount of links
+     *
+     * @return The links, ordered from the most to the least congested one
+     */
+    std::vector<IbLinkCongestion> GetCongestedLinks(double threshold, size_t maxLinks) const;
+
+    /**
+     * Get the duration of a PortXmitWait-tick in nanoseconds.
+     */
+    double GetTickDuration() const {
+        return m_tickDuration;
+    }
+
+private:
+    /**
+     * A port's last two published snapshots with different timestamps, identified by its node's GUID and its number.
+     */
+    typedef std::map<std::pair<uint64_t, uint8_t>, std::pair<IbPerfSnapshot, IbPerfSnapshot>> SnapshotMap;
+
+    /**
+     * Calculate a port's rates between its last two refreshes, without accessing the counters,
+     * that are being refreshed (see the class description).
+     *
+     * @param nodeGuid The GUID of the port's node
+     * @param port The port
+     * @param snapshots The snapshots of the current update. The port's snapshots are added to it.
+     */
+    IbPerfRates GetPortRates(uint64_t nodeGuid, const IbPort &port, SnapshotMap &snapshots) const;
+
+    /**
+     * The duration of a PortXmitWait-tick in nanoseconds.
+     */
+    double m_tickDuration;
+
+    /**
+     * The snapshots of the ports without a history, as they have been seen by the last update.
+     */
+    SnapshotMap m_snapshots;
+
+    /**
+     * The links, ordered from the most to the least congested one.
+     */
+    std::vector<IbLinkCongestion> m_links;
+};
+
+}
+
+#endif
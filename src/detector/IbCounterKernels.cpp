@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IbCounterKernels.h"
+
+#if USE_COUNTER_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace Detector {
+
+const IbCounterKernels::Implementation &IbCounterKernels::GetImplementation() {
+    // Initialized once in a thread-safe way, as guaranteed by C++11.
+    static const Implementation &best = *GetSupportedImplementations().back();
+
+    return best;
+}
+
+std::vector<const IbCounterKernels::Implementation *> IbCounterKernels::GetSupportedImplementations() {
+    static const Implementation scalar = {"scalar", &SumScalar, &AddScalar, &SubtractScalar};
+
+    std::vector<const Implementation *> implementations{&scalar};
+
+#if USE_COUNTER_KERNELS_X86
+    static const Implementation avx2 = {"avx2", &SumAvx2, &AddAvx2, &SubtractAvx2};
+    static const Implementation avx512 = {"avx512", &SumAvx512, &AddAvx512, &SubtractAvx512};
+
+    if (__builtin_cpu_supports("avx2")) {
+        implementations.push_back(&avx2);
+    }
+
+    if (__builtin_cpu_supports("avx512f")) {
+        implementations.push_back(&avx512);
+    }
+#endif
+
+    return implementations;
+}
+
+uint64_t IbCounterKernels::SumScalar(const uint64_t *values, size_t count) {
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        sum += values[i];
+    }
+
+    return sum;
+}
+
+void IbCounterKernels::AddScalar(uint64_t *totals, const uint64_t *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        totals[i] += values[i];
+    }
+}
+
+void IbCounterKernels::SubtractScalar(const uint64_t *current, const uint64_t *previous, uint64_t *deltas,
+                                      size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        deltas[i] = current[i] < previous[i] ? 0 : current[i] - previous[i];
+    }
+}
+
+#if USE_COUNTER_KERNELS_X86
+
+__attribute__((target("avx2")))
+uint64_t IbCounterKernels::SumAvx2(const uint64_t *values, size_t count) {
+    // Two accumulators hide the latency of the additions.
+    __m256i sum0 = _mm256_setzero_si256();
+    __m256i sum1 = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        sum0 = _mm256_add_epi64(sum0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i)));
+        sum1 = _mm256_add_epi64(sum1, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i + 4)));
+    }
+
+    if (i + 4 <= count) {
+        sum0 = _mm256_add_epi64(sum0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i)));
+        i += 4;
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), _mm256_add_epi64(sum0, sum1));
+
+    uint64_t sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    for (; i < count; i++) {
+        sum += values[i];
+    }
+
+    return sum;
+}
+
+__attribute__((target("avx2")))
+void IbCounterKernels::AddAvx2(uint64_t *totals, const uint64_t *values, size_t count) {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i total = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(totals + i));
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(totals + i), _mm256_add_epi64(total, value));
+    }
+
+    for (; i < count; i++) {
+        totals[i] += values[i];
+    }
+}
+
+__attribute__((target("avx2")))
+void IbCounterKernels::SubtractAvx2(const uint64_t *current, const uint64_t *previous, uint64_t *deltas,
+                                    size_t count) {
+    // AVX2 can only compare signed integers. Flipping the sign bits turns this into an unsigned comparison.
+    const __m256i signBit = _mm256_set1_epi64x(static_cast<int64_t>(0x8000000000000000ull));
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(current + i));
+        __m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(previous + i));
+        __m256i isReset = _mm256_cmpgt_epi64(_mm256_xor_si256(prev, signBit), _mm256_xor_si256(cur, signBit));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(deltas + i),
+                            _mm256_andnot_si256(isReset, _mm256_sub_epi64(cur, prev)));
+    }
+
+    for (; i < count; i++) {
+        deltas[i] = current[i] < previous[i] ? 0 : current[i] - previous[i];
+    }
+}
+
+__attribute__((target("avx512f")))
+uint64_t IbCounterKernels::SumAvx512(const uint64_t *values, size_t count) {
+    __m512i sum0 = _mm512_setzero_si512();
+    __m512i sum1 = _mm512_setzero_si512();
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        sum0 = _mm512_add_epi64(sum0, _mm512_loadu_si512(values + i));
+        sum1 = _mm512_add_epi64(sum1, _mm512_loadu_si512(values + i + 8));
+    }
+
+    for (; i < count; i += 8) {
+        // The last iteration uses a masked load, so that no scalar tail is needed.
+        __mmask8 mask = count - i >= 8 ? 0xff : static_cast<__mmask8>((1u << (count - i)) - 1);
+        sum0 = _mm512_add_epi64(sum0, _mm512_maskz_loadu_epi64(mask, values + i));
+    }
+
+    uint64_t lanes[8];
+    _mm512_storeu_si512(lanes, _mm512_add_epi64(sum0, sum1));
+
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+
+__attribute__((target("avx512f")))
+void IbCounterKernels::AddAvx512(uint64_t *totals, const uint64_t *values, size_t count) {
+    for (size_t i = 0; i < count; i += 8) {
+        __mmask8 mask = count - i >= 8 ? 0xff : static_cast<__mmask8>((1u << (count - i)) - 1);
+        __m512i total = _mm512_maskz_loadu_epi64(mask, totals + i);
+        __m512i value = _mm512_maskz_loadu_epi64(mask, values + i);
+
+        _mm512_mask_storeu_epi64(totals + i, mask, _mm512_add_epi64(total, value));
+    }
+}
+
+__attribute__((target("avx512f")))
+void IbCounterKernels::SubtractAvx512(const uint64_t *current, const uint64_t *previous, uint64_t *deltas,
+                                      size_t count) {
+    for (size_t i = 0; i < count; i += 8) {
+        __mmask8 mask = count - i >= 8 ? 0xff : static_cast<__mmask8>((1u << (count - i)) - 1);
+        __m512i cur = _mm512_maskz_loadu_epi64(mask, current + i);
+        __m512i prev = _mm512_maskz_loadu_epi64(mask, previous + i);
+        __mmask8 isValid = _mm512_cmpge_epu64_mask(cur, prev);
+
+        _mm512_mask_storeu_epi64(deltas + i, mask, _mm512_maskz_sub_epi64(isValid, cur, prev));
+    }
+}
+
+#endif
+
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBCOUNTERKERNELS_H
+#define DETECTOR_IBCOUNTERKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define USE_COUNTER_KERNELS_X86 1
+#else
+#define USE_COUNTER_KERNELS_X86 0
+#endif
+
+namespace Detector {
+
+/**
+ * Vectorized kernels, that are used to aggregate arrays of counter values
+ * (e.g. the columns of an IbCounterTable or the values of several snapshots).
+ *
+ * On x86-64, AVX-512 or AVX2 implementations are chosen at runtime, depending on the features of the CPU.
+ * On every other CPU, and if neither extension is available, scalar implementations are used.
+ * All implementations yield exactly the same results.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbCounterKernels {
+
+public:
+    /**
+     * A set of kernels for a single instruction set.
+     */
+    struct Implementation {
+        const char *name;
+        uint64_t (*sum)(const uint64_t *values, size_t count);
+        void (*add)(uint64_t *totals, const uint64_t *values, size_t count);
+        void (*subtract)(const uint64_t *current, const uint64_t *previous, uint64_t *deltas, size_t count);
+    };
+
+    /**
+     * Constructor.
+     */
+    IbCounterKernels() = delete;
+
+    /**
+     * Sum up an array of values (modulo 2^64).
+     *
+     * @param values The values
+     * @param count The amount of values
+     */
+    static uint64_t Sum(const uint64_t *values, size_t count) {
+        return GetImplementation().sum(values, count);
+    }
+
+    /**
+     * Add an array of values element-wise to an array of totals (modulo 2^64).
+     *
+     * @param totals The totals
+     * @param values The values, that are added to the totals
+     * @param count The amount of values
+     */
+    static void Add(uint64_t *totals, const uint64_t *values, size_t count) {
+        GetImplementation().add(totals, values, count);
+    }
+
+    /**
+     * Calculate the element-wise differences of two arrays. Like IbPerfCounter::GetDelta(), a difference is 0,
+     * if the current value is smaller than the previous one (i.e. the counter has been reset in the meantime).
+     *
+     * @param current The current values
+     * @param previous The previous values
+     * @param deltas The array, that the differences are written to (may be the same as current or previous)
+     * @param count The amount of values
+     */
+    static void Subtract(const uint64_t *current, const uint64_t *previous, uint64_t *deltas, size_t count) {
+        GetImplementation().subtract(current, previous, deltas, count);
+    }
+
+    /**
+     * Get the name of the implementation, that is used on this CPU ("avx512", "avx2" or "scalar").
+     */
+    static const char *GetImplementationName() {
+        return GetImplementation().name;
+    }
+
+    /**
+     * Get all implementations, that this CPU supports, starting with the scalar one and ending with the one,
+     * that is used by the kernels above. This allows comparing the implementations against each other.
+     */
+    static std::vector<const Implementation *> GetSupportedImplementations();
+
+private:
+    /**
+     * Get the best implementation for this CPU. The CPU's features are only checked on the first call.
+     */
+    static const Implementation &GetImplementation();
+
+    static uint64_t SumScalar(const uint64_t *values, size_t count);
+
+    static void AddScalar(uint64_t *totals, const uint64_t *values, size_t count);
+
+    static void SubtractScalar(const uint64_t *current, const uint64_t *previous, uint64_t *deltas, size_t count);
+
+#if USE_COUNTER_KERNELS_X86
+
+    static uint64_t SumAvx2(const uint64_t *values, size_t count);
+
+    static void AddAvx2(uint64_t *totals, const uint64_t *values, size_t count);
+
+    static void SubtractAvx2(const uint64_t *current, const uint64_t *previous, uint64_t *deltas, size_t count);
+
+    static uint64_t SumAvx512(const uint64_t *values, size_t count);
+
+    static void AddAvx512(uint64_t *totals, const uint64_t *values, size_t count);
+
+    static void SubtractAvx512(const uint64_t *current, const uint64_t *previous, uint64_t *deltas, size_t count);
+
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBCOUNTERREGISTRY_H
+#define DETECTOR_IBCOUNTERREGISTRY_H
+
+// The extended 64-bit versions of symbolErrors, linkRecoveries, linkDowned, rcvErrors, rcvRemotePhysicalErrors,
+// rcvSwitchRelayErrors, xmitDiscards, xmitConstraintErrors, rcvConstraintErrors, localLinkIntegrityErrors,
+// excessiveBufferOverrunErrors, vl15Dropped, xmitWait are only available in new versions of libibmad.
+// By default build script checks, if the counters are availabe.
+#ifndef USE_ADDITIONAL_EXTENDED_COUNTERS
+#define USE_ADDITIONAL_EXTENDED_COUNTERS 0
+#endif
+
+#if USE_ADDITIONAL_EXTENDED_COUNTERS
+#define ADDITIONAL_EXTENDED_FIELD(field) field
+#else
+#define ADDITIONAL_EXTENDED_FIELD(field) IB_NO_FIELD
+#endif
+
+#include <cstdint>
+#include <infiniband/mad.h>
+#include "IbPerfSnapshot.h"
+
+namespace Detector {
+
+/**
+ * The groups, that the counters belong to. Each group has a counter mask (e.g. COUNTER_MASK_DATA).
+ */
+enum IbCounterGroup {
+    COUNTER_GROUP_DATA,
+    COUNTER_GROUP_CAST,
+    COUNTER_GROUP_ERRORS,
+    COUNTER_GROUP_CONGESTION
+};
+
+/**
+ * Capabilities of a device's PMA, that a counter or one of its attributes needs (see IbPort).
+ */
+enum IbCounterCapability {
+    CAPABILITY_NONE = 0,
+    CAPABILITY_EXTENDED_WIDTH = 1,
+    CAPABILITY_ADDITIONAL_EXTENDED = 2,
+    CAPABILITY_XMIT_WAIT = 4
+};
+
+/**
+ * Describes, where a single counter comes from and how it is presented.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+struct IbCounterDescriptor {
+    /**
+     * The counter's id. Equals the descriptor's index in the registry.
+     */
+    IbCounterId id;
+
+    /**
+     * The counter's name, as it is printed.
+     */
+    const char *name;
+
+    /**
+     * The counter's unit (empty for plain counts).
+     */
+    const char *unit;
+
+    /**
+     * The group, that the counter belongs to.
+     */
+    IbCounterGroup group;
+
+    /**
+     * The name of the file in a port's sysfs counter directory (used in compatibility mode).
+     */
+    const char *sysfsFile;
+
+    /**
+     * The field in the PortCounters-attribute (IB_NO_FIELD, if the attribute does not contain the counter).
+     */
+    MAD_FIELDS field;
+
+    /**
+     * The amount of bits of the counter in PortCounters and in sysfs.
+     */
+    uint8_t width;
+
+    /**
+     * The bit, that selects the counter, when resetting PortCounters (0, if the counter can not be reset this way).
+     * The lower 16 bits go into CounterSelect, the others into CounterSelect2.
+     */
+    uint32_t counterSelectBit;
+
+    /**
+     * The 64-bit field in the PortCountersExtended-attribute (IB_NO_FIELD, if there is none).
+     */
+    MAD_FIELDS extendedField;
+
+    /**
+     * The capability, that the device needs, to provide extendedField.
+     */
+    IbCounterCapability extendedCapability;
+
+    /**
+     * The capability, that the device needs, to provide the counter at all.
+     */
+    IbCounterCapability capability;
+
+    /**
+     * Whether the value is counted per lane and needs to be multiplied by the link width.
+     */
+    bool isPerLane;
+};
+
+/**
+ * The compile-time registry of all performance counters.
+ *
+ * Decoding MAD-responses, reading sysfs files, resetting counters, selecting counter groups and printing counters
+ * all loop over this table. Adding a counter only requires a new IbCounterId and a new descriptor.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbCounterRegistry {
+
+public:
+    IbCounterRegistry() = delete;
+
+    /**
+     * The descriptors of all counters, indexed by IbCounterId.
+     */
+    static constexpr IbCounterDescriptor COUNTERS[NUM_COUNTERS] = {
+            {COUNTER_XMIT_DATA_BYTES, "XmitData", "Bytes", COUNTER_GROUP_DATA, "port_xmit_data",
+                    IB_PC_XMT_BYTES_F, 32, 1u << 12, IB_PC_EXT_XMT_BYTES_F, CAPABILITY_NONE, CAPABILITY_NONE, true},
+            {COUNTER_RCV_DATA_BYTES, "RcvData", "Bytes", COUNTER_GROUP_DATA, "port_rcv_data",
+                    IB_PC_RCV_BYTES_F, 32, 1u << 13, IB_PC_EXT_RCV_BYTES_F, CAPABILITY_NONE, CAPABILITY_NONE, true},
+            {COUNTER_XMIT_PKTS, "XmitPkts", "", COUNTER_GROUP_DATA, "port_xmit_packets",
+                    IB_PC_XMT_PKTS_F, 32, 1u << 14, IB_PC_EXT_XMT_PKTS_F, CAPABILITY_NONE, CAPABILITY_NONE, false},
+            {COUNTER_RCV_PKTS, "RcvPkts", "", COUNTER_GROUP_DATA, "port_rcv_packets",
+                    IB_PC_RCV_PKTS_F, 32, 1u << 15, IB_PC_EXT_RCV_PKTS_F, CAPABILITY_NONE, CAPABILITY_NONE, false},
+            {COUNTER_UNICAST_XMIT_PKTS, "UnicastXmitPkts", "", COUNTER_GROUP_CAST, "unicast_xmit_packets",
+                    IB_NO_FIELD, 64, 0, IB_PC_EXT_XMT_UPKTS_F, CAPABILITY_EXTENDED_WIDTH, CAPABILITY_NONE, false},
+            {COUNTER_UNICAST_RCV_PKTS, "UnicastRcvPkts", "", COUNTER_GROUP_CAST, "unicast_rcv_packets",
+                    IB_NO_FIELD, 64, 0, IB_PC_EXT_RCV_UPKTS_F, CAPABILITY_EXTENDED_WIDTH, CAPABILITY_NONE, false},
+            {COUNTER_MULTICAST_XMIT_PKTS, "MulticastXmitPkts", "", COUNTER_GROUP_CAST, "multicast_xmit_packets",
+                    IB_NO_FIELD, 64, 0, IB_PC_EXT_XMT_MPKTS_F, CAPABILITY_EXTENDED_WIDTH, CAPABILITY_NONE, false},
+            {COUNTER_MULTICAST_RCV_PKTS, "MulticastRcvPkts", "", COUNTER_GROUP_CAST, "multicast_rcv_packets",
+                    IB_NO_FIELD, 64, 0, IB_PC_EXT_RCV_MPKTS_F, CAPABILITY_EXTENDED_WIDTH, CAPABILITY_NONE, false},
+            {COUNTER_SYMBOL_ERRORS, "SymbolErrors", "", COUNTER_GROUP_ERRORS, "symbol_error",
+                    IB_PC_ERR_SYM_F, 16, 1u << 0, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_ERR_SYM_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_LINK_DOWNED, "LinkDownedCounter", "", COUNTER_GROUP_ERRORS, "link_downed",
+                    IB_PC_LINK_DOWNED_F, 8, 1u << 2, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_LINK_DOWNED_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_LINK_RECOVERIES, "LinkRecoveryCounter", "", COUNTER_GROUP_ERRORS, "link_error_recovery",
+                    IB_PC_LINK_RECOVERS_F, 8, 1u << 1, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_LINK_RECOVERS_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_RCV_ERRORS, "RcvErrors", "", COUNTER_GROUP_ERRORS, "port_rcv_errors",
+                    IB_PC_ERR_RCV_F, 16, 1u << 3, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_ERR_RCV_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_RCV_REMOTE_PHYSICAL_ERRORS, "RcvRemotePhysicalErrors", "", COUNTER_GROUP_ERRORS,
+                    "port_rcv_remote_physical_errors",
+                    IB_PC_ERR_PHYSRCV_F, 16, 1u << 4, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_ERR_PHYSRCV_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_RCV_SWITCH_RELAY_ERRORS, "RcvSwitchRelayErrors", "", COUNTER_GROUP_ERRORS,
+                    "port_rcv_switch_relay_errors",
+                    IB_PC_ERR_SWITCH_REL_F, 16, 1u << 5, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_ERR_SWITCH_REL_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_XMIT_DISCARDS, "XmitDiscards", "", COUNTER_GROUP_ERRORS, "port_xmit_discards",
+                    IB_PC_XMT_DISCARDS_F, 16, 1u << 6, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_XMT_DISCARDS_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_XMIT_CONSTRAINT_ERRORS, "XmitConstraintErrors", "", COUNTER_GROUP_ERRORS,
+                    "port_xmit_constraint_errors",
+                    IB_PC_ERR_XMTCONSTR_F, 8, 1u << 7, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_ERR_XMTCONSTR_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_RCV_CONSTRAINT_ERRORS, "RcvConstraintErrors", "", COUNTER_GROUP_ERRORS,
+                    "port_rcv_constraint_errors",
+                    IB_PC_ERR_RCVCONSTR_F, 8, 1u << 8, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_ERR_RCVCONSTR_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_LOCAL_LINK_INTEGRITY_ERRORS, "LocalLinkIntegrityErrors", "", COUNTER_GROUP_ERRORS,
+                    "local_link_integrity_errors",
+                    IB_PC_ERR_LOCALINTEG_F, 4, 1u << 9, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_ERR_LOCALINTEG_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_EXCESSIVE_BUFFER_OVERRUN_ERRORS, "ExcessiveBufferOverrunErrors", "", COUNTER_GROUP_ERRORS,
+                    "excessive_buffer_overrun_errors",
+                    IB_PC_ERR_EXCESS_OVR_F, 4, 1u << 10, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_ERR_EXCESS_OVR_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_VL15_DROPPED, "VL15Dropped", "", COUNTER_GROUP_ERRORS, "VL15_dropped",
+                    IB_PC_VL15_DROPPED_F, 16, 1u << 11, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_VL15_DROPPED_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_NONE, false},
+            {COUNTER_XMIT_WAIT, "XmitWait", "", COUNTER_GROUP_CONGESTION, "port_xmit_wait",
+                    IB_PC_XMT_WAIT_F, 32, 1u << 16, ADDITIONAL_EXTENDED_FIELD(IB_PC_EXT_XMT_WAIT_F),
+                    CAPABILITY_ADDITIONAL_EXTENDED, CAPABILITY_XMIT_WAIT, false}
+    };
+
+    /**
+     * Get the descriptor of a counter.
+     *
+     * @param id The counter's id
+     */
+    static constexpr const IbCounterDescriptor &Get(IbCounterId id) {
+        return COUNTERS[id];
+    }
+
+    /**
+     * Get the mask, that selects all counters of a group.
+     *
+     * @param group The group
+     * @param index The first counter to consider (used for the recursion)
+     */
+    static constexpr uint32_t GetGroupMask(IbCounterGroup group, uint32_t index = 0) {
+        return index >= NUM_COUNTERS ? 0 :
+               (COUNTERS[index].group == group ? CounterMaskBit(static_cast<IbCounterId>(index)) : 0) |
+               GetGroupMask(group, index + 1);
+    }
+
+    /**
+     * Check, that every descriptor is stored at the index of its id.
+     *
+     * @param index The first counter to check (used for the recursion)
+     */
+    static constexpr bool IsOrdered(uint32_t index = 0) {
+        return index >= NUM_COUNTERS || (COUNTERS[index].id == index && IsOrdered(index + 1));
+    }
+};
+
+static_assert(IbCounterRegistry::IsOrdered(), "The counter descriptors must be ordered by their ids!");
+
+/**
+ * Selects the transmitted and received data and packets.
+ */
+constexpr uint32_t COUNTER_MASK_DATA = IbCounterRegistry::GetGroupMask(COUNTER_GROUP_DATA);
+
+/**
+ * Selects the uni- and multicast packets.
+ */
+constexpr uint32_t COUNTER_MASK_CAST = IbCounterRegistry::GetGroupMask(COUNTER_GROUP_CAST);
+
+/**
+ * Selects all error counters.
+ */
+constexpr uint32_t COUNTER_MASK_ERRORS = IbCounterRegistry::GetGroupMask(COUNTER_GROUP_ERRORS);
+
+/**
+ * Selects the transmission-wait counter.
+ */
+constexpr uint32_t COUNTER_MASK_XMIT_WAIT = IbCounterRegistry::GetGroupMask(COUNTER_GROUP_CONGESTION);
+
+}
+
+#endif
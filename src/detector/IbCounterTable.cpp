@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "IbCounterTable.h"
+
+namespace Detector {
+
+IbCounterTable::IbCounterTable(size_t numRows) :
+        m_numRows(numRows),
+        m_stride((numRows + COUNTER_TABLE_ALIGNMENT / sizeof(uint64_t) - 1) &
+                 ~(COUNTER_TABLE_ALIGNMENT / sizeof(uint64_t) - 1)),
+        m_data(nullptr) {
+    size_t size = (m_stride > 0 ? m_stride : 1) * NUM_COUNTERS * sizeof(uint64_t);
+    void *data;
+
+    if (posix_memalign(&data, COUNTER_TABLE_ALIGNMENT, size) != 0) {
+        throw std::bad_alloc();
+    }
+
+    memset(data, 0, size);
+    m_data = static_cast<uint64_t *>(data);
+}
+
+IbCounterTable::~IbCounterTable() {
+    free(m_data);
+}
+
+}
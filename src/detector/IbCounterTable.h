@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBCOUNTERTABLE_H
+#define DETECTOR_IBCOUNTERTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "IbPerfSnapshot.h"
+
+#define COUNTER_TABLE_ALIGNMENT 64
+
+namespace Detector {
+
+/**
+ * Stores the counters of many ports or nodes as a structure of arrays:
+ * Each counter has its own contiguous column, which holds the values of all rows (i.e. ports or nodes).
+ *
+ * Every column starts on a cache line, so that scanning a single counter over the whole fabric
+ * (e.g. to sum it up or to find the busiest ports) streams through memory, instead of visiting one
+ * heap-allocated object per port. Ports and nodes attach to a row via IbPerfCounter::AttachStorage()
+ * and keep working as before.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbCounterTable {
+
+public:
+    /**
+     * Constructor.
+     *
+     * All counters are initialized with 0.
+     *
+     * @param numRows The amount of rows
+     */
+    explicit IbCounterTable(size_t numRows);
+
+    /**
+     * Destructor.
+     */
+    ~IbCounterTable();
+
+    IbCounterTable(const IbCounterTable &copy) = delete;
+
+    IbCounterTable &operator=(const IbCounterTable &copy) = delete;
+
+    /**
+     * Get the amount of rows.
+     */
+    size_t GetNumRows() const {
+        return m_numRows;
+    }
+
+    /**
+     * Get the distance between the beginnings of two columns (in elements).
+     * This is the amount of rows, rounded up to a whole cache line.
+     */
+    size_t GetStride() const {
+        return m_stride;
+    }
+
+    /**
+     * Get a column, that holds the values of a single counter for all rows.
+     *
+     * @param id The counter's id
+     */
+    uint64_t *GetColumn(IbCounterId id) {
+        return m_data + id * m_stride;
+    }
+
+    /**
+     * Get a column, that holds the values of a single counter for all rows.
+     *
+     * @param id The counter's id
+     */
+    const uint64_t *GetColumn(IbCounterId id) const {
+        return m_data + id * m_stride;
+    }
+
+    /**
+     * Get a pointer to the first counter of a row. Counter i of the row is found at GetRow(row)[i * GetStride()].
+     *
+     * @param row The row's index
+     */
+    uint64_t *GetRow(size_t row) {
+        return m_data + row;
+    }
+
+private:
+    /**
+     * The amount of rows.
+     */
+    size_t m_numRows;
+
+    /**
+     * The size of each column.
+     */
+    size_t m_stride;
+
+    /**
+     * All columns in a single allocation.
+     */
+    uint64_t *m_data;
+};
+
+}
+
+#endif
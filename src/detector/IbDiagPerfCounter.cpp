@@ -17,12 +17,37 @@
  */
 
 #include <cstring>
-#include <iostream>
 #include "detector/exception/IbFileException.h"
 #include "IbDiagPerfCounter.h"
+#include "IbSysfsBatch.h"
 
 namespace Detector {
 
+static const char *const COUNTER_FILES[] = {
+        "lifespan",
+        "rq_num_lle",
+        "rq_num_lpe",
+        "rq_num_lqpoe",
+        "rq_num_oos",
+        "rq_num_rae",
+        "rq_num_rire",
+        "rq_num_rnr",
+        "rq_num_wrfe",
+        "sq_num_bre",
+        "sq_num_lle",
+        "sq_num_lpe",
+        "sq_num_lqpoe",
+        "sq_num_mwbe",
+        "sq_num_oos",
+        "sq_num_rae",
+        "sq_num_rire",
+        "sq_num_rnr",
+        "sq_num_roe",
+        "sq_num_rree",
+        "sq_num_tree",
+        "sq_num_wrfe"
+};
+
 IbDiagPerfCounter::IbDiagPerfCounter(std::string deviceName, uint8_t portNumber) :
         m_lifespan(0),
         m_rqLocalLengthErrors(0),
@@ -48,60 +73,20 @@ IbDiagPerfCounter::IbDiagPerfCounter(std::string deviceName, uint8_t portNumber)
         m_sqCompletionQueueEntryErrors(0),
         m_deviceName(std::move(deviceName)),
         m_portNumber(portNumber),
-        m_buffer(),
-        m_files(),
+        m_reader("/sys/class/infiniband/" + m_deviceName + (m_portNumber > 0 ?
+                 "/ports/" + std::to_string(m_portNumber) + "/hw_counters/" : "/hw_counters/"),
+                 COUNTER_FILES, sizeof(COUNTER_FILES) / sizeof(COUNTER_FILES[0])),
         m_baseValues() {
-    std::string path = "/sys/class/infiniband/" + m_deviceName + (m_portNumber > 0 ?
-                       "/ports/" + std::to_string(m_portNumber) + "/hw_counters/" : "/hw_counters/");
-
-    m_files[0] = std::ifstream(path + "lifespan", std::ios::in);
-    m_files[1] = std::ifstream(path + "rq_num_lle", std::ios::in);
-    m_files[2] = std::ifstream(path + "rq_num_lpe", std::ios::in);
-    m_files[3] = std::ifstream(path + "rq_num_lqpoe", std::ios::in);
-    m_files[4] = std::ifstream(path + "rq_num_oos", std::ios::in);
-    m_files[5] = std::ifstream(path + "rq_num_rae", std::ios::in);
-    m_files[6] = std::ifstream(path + "rq_num_rire", std::ios::in);
-    m_files[7] = std::ifstream(path + "rq_num_rnr", std::ios::in);
-    m_files[8] = std::ifstream(path + "rq_num_wrfe", std::ios::in);
-    m_files[9] = std::ifstream(path + "sq_num_bre", std::ios::in);
-    m_files[10] = std::ifstream(path + "sq_num_lle", std::ios::in);
-    m_files[11] = std::ifstream(path + "sq_num_lpe", std::ios::in);
-    m_files[12] = std::ifstream(path + "sq_num_lqpoe", std::ios::in);
-    m_files[13] = std::ifstream(path + "sq_num_mwbe", std::ios::in);
-    m_files[14] = std::ifstream(path + "sq_num_oos", std::ios::in);
-    m_files[15] = std::ifstream(path + "sq_num_rae", std::ios::in);
-    m_files[16] = std::ifstream(path + "sq_num_rire", std::ios::in);
-    m_files[17] = std::ifstream(path + "sq_num_rnr", std::ios::in);
-    m_files[18] = std::ifstream(path + "sq_num_roe", std::ios::in);
-    m_files[19] = std::ifstream(path + "sq_num_rree", std::ios::in);
-    m_files[20] = std::ifstream(path + "sq_num_tree", std::ios::in);
-    m_files[21] = std::ifstream(path + "sq_num_wrfe", std::ios::in);
-
-    for (const std::ifstream &file : m_files) {
-        if (!file.is_open()) {
-            throw IbFileException("Unable to open file!");
-        }
-    }
-
     std::memset(m_baseValues, 0, sizeof(m_baseValues));
 }
 
-IbDiagPerfCounter::~IbDiagPerfCounter() {
-    for (std::ifstream &file : m_files) {
-        file.close();
-    }
-}
+IbDiagPerfCounter::~IbDiagPerfCounter() = default;
 
 void IbDiagPerfCounter::ResetCounters() {
-    for(uint64_t i = 0; i < sizeof(m_files) / sizeof(std::ifstream); i++) {
-        if(!m_files[i].good()) {
-            throw IbFileException("Unable to read file!");
-        }
-
-        m_files[i].seekg(0, std::ios::beg);
-        m_files[i].getline(m_buffer, sizeof(m_buffer));
+    m_reader.DiscardBufferedValues();
 
-        m_baseValues[i] = strtoull(m_buffer, nullptr, 10);
+    for(uint64_t i = 0; i < m_reader.GetNumFiles(); i++) {
+        m_baseValues[i] = m_reader.Read(i);
     }
 }
 
@@ -128,19 +113,16 @@ void IbDiagPerfCounter::RefreshCounters() {
     m_sqRnrNakRetriesExceededErrors = ReadCounter(19);
     m_sqTransportRetriesExceededErrors = ReadCounter(20);
     m_sqCompletionQueueEntryErrors = ReadCounter(21);
-}
-
-uint64_t IbDiagPerfCounter::ReadCounter(uint8_t index) {
-    std::memset(m_buffer, 0, sizeof(m_buffer));
 
-    if(!m_files[index].good()) {
-        throw IbFileException("Unable to read file!");
-    }
+    m_reader.DiscardBufferedValues();
+}
 
-    m_files[index].seekg(0, std::ios::beg);
-    m_files[index].getline(m_buffer, sizeof(m_buffer));
+void IbDiagPerfCounter::RegisterFiles(IbSysfsBatch &batch) {
+    batch.Register(m_reader);
+}
 
-    return strtoull(m_buffer, nullptr, 10) - m_baseValues[index];
+uint64_t IbDiagPerfCounter::ReadCounter(uint8_t index) {
+    return m_reader.Read(index) - m_baseValues[index];
 }
 
 }
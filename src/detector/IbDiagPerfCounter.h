@@ -20,10 +20,14 @@
 #define DETECTOR_IBDIAGPERFCOUNTER_H
 
 #include <cstdint>
-#include <fstream>
+#include <ostream>
+#include <string>
+#include "IbSysfsReader.h"
 
 namespace Detector {
 
+class IbSysfsBatch;
+
 /*
  * Reads the diagnostic counters of a local device from
  * "/sys/class/infiniband/<device name>/ports/<port number>/hw_counters/".
@@ -55,6 +59,14 @@ public:
      */
     void RefreshCounters();
 
+    /**
+     * Register the counter files at a batch, so that they can be read together with the files of other devices.
+     * The next call of RefreshCounters() uses the values of the batch's last submission.
+     *
+     * @param batch The batch
+     */
+    void RegisterFiles(IbSysfsBatch &batch);
+
     /**
      * Get the name of the device, that this counter is monitoring.
      */
@@ -261,7 +273,7 @@ private:
     /**
      * Read a single diagnostic counter.
      *
-     * @param index Index into files
+     * @param index Index into the counter files
      */
     uint64_t ReadCounter(uint8_t index);
 
@@ -306,14 +318,9 @@ private:
     uint8_t m_portNumber;
 
     /**
-     * A buffer used for reading the counters.
-     */
-    char m_buffer[128];
-
-    /**
-     * An array of streams which contains one stream for each counter file
+     * Reads the counter files.
      */
-    std::ifstream m_files[22];
+    IbSysfsReader m_reader;
 
     /**
      * An array containing all counters from the last time that ResetCounters() has been called.
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <algorithm>
+#include "IbDiscoveryOptions.h"
+#include "detector/exception/IbNetDiscException.h"
+
+namespace Detector {
+
+IbDiscoveryOptions::IbDiscoveryOptions() :
+        m_caName(),
+        m_caPort(0),
+        m_startLid(0),
+        m_maxHops(0),
+        m_cachePath(),
+        m_isLazyPortInit(false) {
+
+}
+
+void IbDiscoveryOptions::SetStartPort(const std::string &caName, int caPort) {
+    m_caName = caName;
+    m_caPort = caPort;
+}
+
+void IbDiscoveryOptions::SetStartLid(uint16_t lid) {
+    m_startLid = lid;
+}
+
+void IbDiscoveryOptions::SetMaxHops(uint32_t maxHops) {
+    m_maxHops = maxHops;
+}
+
+void IbDiscoveryOptions::SetCachePath(const std::string &path) {
+    m_cachePath = path;
+}
+
+void IbDiscoveryOptions::SetLazyPortInit(bool enabled) {
+    m_isLazyPortInit = enabled;
+}
+
+void IbDiscoveryOptions::IncludeGuid(uint64_t guid) {
+    m_includedGuids.push_back(guid);
+}
+
+void IbDiscoveryOptions::ExcludeGuid(uint64_t guid) {
+    m_excludedGuids.push_back(guid);
+}
+
+void IbDiscoveryOptions::IncludeLidRange(uint16_t firstLid, uint16_t lastLid) {
+    m_includedLids.push_back({firstLid, lastLid});
+}
+
+void IbDiscoveryOptions::ExcludeLidRange(uint16_t firstLid, uint16_t lastLid) {
+    m_excludedLids.push_back({firstLid, lastLid});
+}
+
+void IbDiscoveryOptions::IncludeNodeType(int nodeType) {
+    m_includedTypes.push_back(nodeType);
+}
+
+void IbDiscoveryOptions::ExcludeNodeType(int nodeType) {
+    m_excludedTypes.push_back(nodeType);
+}
+
+void IbDiscoveryOptions::IncludeDescription(const std::string &pattern) {
+    m_includedDescriptions.push_back(CompilePattern(pattern));
+    m_includedPatterns.push_back(pattern);
+}
+
+void IbDiscoveryOptions::ExcludeDescription(const std::string &pattern) {
+    m_excludedDescriptions.push_back(CompilePattern(pattern));
+    m_excludedPatterns.push_back(pattern);
+}
+
+std::regex IbDiscoveryOptions::CompilePattern(const std::string &pattern) {
+    try {
+        return std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+    } catch (const std::regex_error &exception) {
+        throw IbNetDiscException("Invalid description pattern '" + pattern + "'! Error: " + exception.what());
+    }
+}
+
+bool IbDiscoveryOptions::HasFilters() const {
+    return !m_includedGuids.empty() || !m_excludedGuids.empty() ||
+           !m_includedLids.empty() || !m_excludedLids.empty() ||
+           !m_includedTypes.empty() || !m_excludedTypes.empty() ||
+           !m_includedDescriptions.empty() || !m_excludedDescriptions.empty();
+}
+
+uint64_t IbDiscoveryOptions::GetScopeFingerprint() const {
+    // 64-bit FNV-1a. Every list is preceded by its length, so that different lists never yield the same bytes.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    auto add = [&hash](const void *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ static_cast<const uint8_t *>(data)[i]) * 0x100000001b3ULL;
+        }
+    };
+
+    auto addString = [&add](const std::string &string) {
+        uint64_t size = string.size();
+
+        add(&size, sizeof(size));
+        add(string.data(), string.size());
+    };
+
+    auto addList = [&add](const void *data, size_t count, size_t size) {
+        uint64_t length = count;
+
+        add(&length, sizeof(length));
+        add(data, count * size);
+    };
+
+    auto addPatterns = [&add, &addString](const std::vector<std::string> &patterns) {
+        uint64_t length = patterns.size();
+
+        add(&length, sizeof(length));
+
+        for (const std::string &pattern : patterns) {
+            addString(pattern);
+        }
+    };
+
+    auto caPort = static_cast<int64_t>(m_caPort);
+
+    addString(m_caName);
+    add(&caPort, sizeof(caPort));
+    add(&m_startLid, sizeof(m_startLid));
+    add(&m_maxHops, sizeof(m_maxHops));
+    addList(m_includedGuids.data(), m_includedGuids.size(), sizeof(uint64_t));
+    addList(m_excludedGuids.data(), m_excludedGuids.size(), sizeof(uint64_t));
+    addList(m_includedLids.data(), m_includedLids.size(), sizeof(LidRange));
+    addList(m_excludedLids.data(), m_excludedLids.size(), sizeof(LidRange));
+    addList(m_includedTypes.data(), m_includedTypes.size(), sizeof(int));
+    addList(m_excludedTypes.data(), m_excludedTypes.size(), sizeof(int));
+    addPatterns(m_includedPatterns);
+    addPatterns(m_excludedPatterns);
+
+    return hash;
+}
+
+bool IbDiscoveryOptions::IsInRanges(const std::vector<LidRange> &ranges, const std::vector<uint16_t> &lids) {
+    for (const LidRange &range : ranges) {
+        for (uint16_t lid : lids) {
+            if (lid >= range.first && lid <= range.last) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool IbDiscoveryOptions::IsMatchingAny(const std::vector<std::regex> &patterns, const std::string &description) {
+    for (const std::regex &pattern : patterns) {
+        if (std::regex_search(description, pattern)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool IbDiscoveryOptions::IsMatch(uint64_t guid, int nodeType, const std::string &description,
+                                 const std::vector<uint16_t> &lids) const {
+    auto contains = [](const std::vector<uint64_t> &guids, uint64_t value) {
+        return std::find(guids.begin(), guids.end(), value) != guids.end();
+    };
+
+    auto containsType = [](const std::vector<int> &types, int value) {
+        return std::find(types.begin(), types.end(), value) != types.end();
+    };
+
+    // Exclusions are checked first, since they are usually cheaper than the description patterns.
+    if (contains(m_excludedGuids, guid) || containsType(m_excludedTypes, nodeType) ||
+        IsInRanges(m_excludedLids, lids) || IsMatchingAny(m_excludedDescriptions, description)) {
+        return false;
+    }
+
+    return (m_includedGuids.empty() || contains(m_includedGuids, guid)) &&
+           (m_includedTypes.empty() || containsType(m_includedTypes, nodeType)) &&
+           (m_includedLids.empty() || IsInRanges(m_includedLids, lids)) &&
+           (m_includedDescriptions.empty() || IsMatchingAny(m_includedDescriptions, description));
+}
+
+bool IbDiscoveryOptions::IsMatch(ibnd_node_t *node) const {
+    if (!HasFilters()) {
+        return true;
+    }
+
+    std::vector<uint16_t> lids;
+
+    for (int i = 0; i <= node->numports; i++) {
+        if (node->ports[i] != nullptr) {
+            lids.push_back(node->ports[i]->base_lid);
+        }
+    }
+
+    return IsMatch(node->guid, node->type, node->nodedesc, lids);
+}
+
+ibnd_fabric_t *IbDiscoveryOptions::Discover() const {
+    // The config contains parameters for ibnd_discover_fabric.
+    // Only the hop limit is set, all other parameters are left at their defaults by setting them to zero.
+    ibnd_config_t config = {0};
+    config.max_hops = m_maxHops;
+
+    ib_portid_t from{};
+    ib_portid_set(&from, m_startLid, 0, 0);
+
+    // ibnd_discover_fabric() does not take a const string.
+    std::vector<char> caName(m_caName.begin(), m_caName.end());
+    caName.push_back('\0');
+
+    // ibnd_discover_fabric() scans the entire InfiniBand-fabric for nodes.
+    // It takes the following parameters:
+    //
+    // dev_name: The name of the local device, from which the discovery is started.
+    //           This seems to be optional, as passing a nullptr also works.
+    // dev_port: This seems to be number of the local port from which the discovery is started.
+    //           Passing a zero works fine. I guess, it then uses a default value.
+    // from:     This seems to be a portid-struct, that describes the local port, from which the discovery is started.
+    //           Again, passing a nullptr works fine.
+    // config:   Contains some configuration parameters for ibnd_discover_fabric()
+    ibnd_fabric_t *fabric = ibnd_discover_fabric(m_caName.empty() ? nullptr : caName.data(), m_caPort,
+                                                 m_startLid == 0 ? nullptr : &from, &config);
+
+    if (fabric == nullptr) {
+        throw IbNetDiscException("Unable to discover nodes in the fabric (ibnd_discover_fabric failed)!");
+    }
+
+    return fabric;
+}
+
+}
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBDISCOVERYOPTIONS_H
+#define DETECTOR_IBDISCOVERYOPTIONS_H
+
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+#include <ibnetdisc.h>
+
+namespace Detector {
+
+/**
+ * Controls, which part of the network is discovered by an IbFabric and how the found nodes are set up.
+ *
+ * The network discovery can be limited to a maximum amount of hops from a chosen start port. Afterwards,
+ * the found nodes are filtered by their GUID, the LIDs of their ports, their type and their description.
+ * Only nodes, that pass the filters, get IbNode- and IbPort-objects, so that the others do not cost any MADs.
+ *
+ * Each kind of filter has an include- and an exclude-list. A node passes, if it matches at least one entry of each
+ * non-empty include-list and no entry of any exclude-list. A node matches a LID range, if one of its ports does.
+ *
+ * The hop limit, the start port and the filters only apply to the network discovery (including Rediscover() and
+ * nodes, that are loaded from a topology cache). Local devices are always set up completely.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbDiscoveryOptions {
+
+public:
+    /**
+     * Constructor.
+     *
+     * By default, the whole network is discovered and all nodes are set up eagerly, without a topology cache.
+     */
+    IbDiscoveryOptions();
+
+    /**
+     * Destructor.
+     */
+    ~IbDiscoveryOptions() = default;
+
+    /**
+     * Set the local port, from which the discovery is started (default: the first active port).
+     *
+     * @param caName The name of the local device (e.g. "mlx5_0")
+     * @param caPort The number of the port on the local device
+     */
+    void SetStartPort(const std::string &caName, int caPort);
+
+    /**
+     * Start the discovery at the node with the given LID, instead of the local port (0 to use the local port).
+     * Together with SetMaxHops(), this limits the discovery to the surroundings of a node (e.g. a leaf switch).
+     *
+     * @param lid The LID of the node
+     */
+    void SetStartLid(uint16_t lid);
+
+    /**
+     * Set the maximum amount of hops from the start port, that the discovery follows (0 means unlimited).
+     *
+     * @param maxHops The maximum amount of hops
+     */
+    void SetMaxHops(uint32_t maxHops);
+
+    /**
+     * Use a topology cache (see IbTopologyCache and IbFabric's constructors). An empty path disables the cache.
+     *
+     * @param path The path of the cache file
+     */
+    void SetCachePath(const std::string &path);
+
+    /**
+     * Enable or disable lazy port initialization (see IbPort::Initialize()).
+     *
+     * @param enabled Set to true, to defer the ports' capability queries until they are refreshed
+     */
+    void SetLazyPortInit(bool enabled);
+
+    /**
+     * Only set up nodes with one of the included GUIDs.
+     *
+     * @param guid The node's GUID
+     */
+    void IncludeGuid(uint64_t guid);
+
+    /**
+     * Do not set up the node with the given GUID.
+     *
+     * @param guid The node's GUID
+     */
+    void ExcludeGuid(uint64_t guid);
+
+    /**
+     * Only set up nodes with a port in one of the included LID ranges.
+     *
+     * @param firstLid The first LID of the range
+     * @param lastLid The last LID of the range (inclusive)
+     */
+    void IncludeLidRange(uint16_t firstLid, uint16_t lastLid);
+
+    /**
+     * Do not set up nodes with a port in the given LID range.
+     *
+     * @param firstLid The first LID of the range
+     * @param lastLid The last LID of the range (inclusive)
+     */
+    void ExcludeLidRange(uint16_t firstLid, uint16_t lastLid);
+
+    /**
+     * Only set up nodes of one of the included types.
+     *
+     * @param nodeType The node type (IB_NODE_CA, IB_NODE_SWITCH or IB_NODE_ROUTER)
+     */
+    void IncludeNodeType(int nodeType);
+
+    /**
+     * Do not set up nodes of the given type.
+     *
+     * @param nodeType The node type (IB_NODE_CA, IB_NODE_SWITCH or IB_NODE_ROUTER)
+     */
+    void ExcludeNodeType(int nodeType);
+
+    /**
+     * Only set up nodes, whose description contains a match of one of the included patterns.
+     * Throws an IbNetDiscException, if the pattern is not a valid regular expression.
+     *
+     * @param pattern A regular expression (ECMAScript syntax)
+     */
+    void IncludeDescription(const std::string &pattern);
+
+    /**
+     * Do not set up nodes, whose description contains a match of the given pattern.
+     * Throws an IbNetDiscException, if the pattern is not a valid regular expression.
+     *
+     * @param pattern A regular expression (ECMAScript syntax)
+     */
+    void ExcludeDescription(const std::string &pattern);
+
+    /**
+     * Check, whether a node passes the filters.
+     *
+     * @param guid The node's GUID
+     * @param nodeType The node's type
+     * @param description The node's description
+     * @param lids The LIDs of the node's ports
+     */
+    bool IsMatch(uint64_t guid, int nodeType, const std::string &description,
+                 const std::vector<uint16_t> &lids) const;
+
+    /**
+     * Check, whether a node, that has been found by the ibnetdisc-library, passes the filters.
+     *
+     * @param node The node
+     */
+    bool IsMatch(ibnd_node_t *node) const;
+
+    /**
+     * Check, whether any filters have been set.
+     */
+    bool HasFilters() const;
+
+    /**
+     * Discover the network according to the hop limit and start port.
+     * Throws an IbNetDiscException, if the discovery fails.
+     *
+     * @return The discovered fabric, which must be freed with ibnd_destroy_fabric()
+     */
+    ibnd_fabric_t *Discover() const;
+
+    /**
+     * Get the path of the topology cache (empty, if no cache is used).
+     */
+    const std::string &GetCachePath() const {
+        return m_cachePath;
+    }
+
+    /**
+     * Check, whether ports are initialized lazily.
+     */
+    bool IsLazyPortInit() const {
+        return m_isLazyPortInit;
+    }
+
+    /**
+     * Get the maximum amount of hops (0 means unlimited).
+     */
+    uint32_t GetMaxHops() const {
+        return m_maxHops;
+    }
+
+    /**
+     * Get a fingerprint of the part of the network, that is selected by the start port, the hop limit and the filters.
+     * Options with the same fingerprint set up the same nodes. The cache path and lazy port initialization are not
+     * part of it. The fingerprint is the same in every process, so that it can be stored in a topology cache.
+     */
+    uint64_t GetScopeFingerprint() const;
+
+private:
+    /**
+     * An inclusive range of LIDs.
+     */
+    struct LidRange {
+        /**
+         * The first LID of the range.
+         */
+        uint16_t first;
+
+        /**
+         * The last LID of the range.
+         */
+        uint16_t last;
+    };
+
+    /**
+     * Check, whether any of the LIDs is part of any of the ranges.
+     *
+     * @param ranges The ranges
+     * @param lids The LIDs
+     */
+    static bool IsInRanges(const std::vector<LidRange> &ranges, const std::vector<uint16_t> &lids);
+
+    /**
+     * Check, whether any of the patterns matches a part of the description.
+     *
+     * @param patterns The patterns
+     * @param description The description
+     */
+    static bool IsMatchingAny(const std::vector<std::regex> &patterns, const std::string &description);
+
+    /**
+     * Compile a pattern and throw an IbNetDiscException, if it is invalid.
+     *
+     * @param pattern The pattern
+     */
+    static std::regex CompilePattern(const std::string &pattern);
+
+private:
+    /**
+     * The name of the local device, from which the discovery is started (empty for the default device).
+     */
+    std::string m_caName;
+
+    /**
+     * The number of the local port, from which the discovery is started (0 for the default port).
+     */
+    int m_caPort;
+
+    /**
+     * The LID of the node, at which the discovery is started (0 to start at the local port).
+     */
+    uint16_t m_startLid;
+
+    /**
+     * The maximum amount of hops from the start port (0 means unlimited).
+     */
+    uint32_t m_maxHops;
+
+    /**
+     * The path of the topology cache (empty, if no cache is used).
+     */
+    std::string m_cachePath;
+
+    /**
+     * Whether ports are initialized lazily.
+     */
+    bool m_isLazyPortInit;
+
+    /**
+     * The filters by node GUID.
+     */
+    std::vector<uint64_t> m_includedGuids;
+    std::vector<uint64_t> m_excludedGuids;
+
+    /**
+     * The filters by LID range.
+     */
+    std::vector<LidRange> m_includedLids;
+    std::vector<LidRange> m_excludedLids;
+
+    /**
+     * The filters by node type.
+     */
+    std::vector<int> m_includedTypes;
+    std::vector<int> m_excludedTypes;
+
+    /**
+     * The filters by node description.
+     */
+    std::vector<std::regex> m_includedDescriptions;
+    std::vector<std::regex> m_excludedDescriptions;
+
+    /**
+     * The patterns of the description filters, as they have been passed (see GetScopeFingerprint()).
+     */
+    std::vector<std::string> m_includedPatterns;
+    std::vector<std::string> m_excludedPatterns;
+};
+
+}
+
+#endif
@@ -17,38 +17,664 @@
  */
 
 #include <algorithm>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include "IbFabric.h"
 #include "detector/exception/IbMadException.h"
 #include "detector/exception/IbNetDiscException.h"
 #include "detector/exception/IbFileException.h"
 #include "detector/exception/IbVerbsException.h"
+#include "IbCounterKernels.h"
 #include "IbDiagPerfCounter.h"
+#include "IbTopologyCache.h"
 
 namespace Detector {
 
 IbFabric::IbFabric(bool network, bool compatibility) :
-        m_fabric(nullptr) {
+        IbFabric(network, compatibility, IbDiscoveryOptions()) {
 
-    discoverFabric(network, compatibility);
+}
 
-    std::sort(m_nodes.begin(), m_nodes.end(),
-              [](IbNode *l, IbNode *r) { return l->GetDescription() < r->GetDescription(); });
+IbFabric::IbFabric(bool network, bool compatibility, const IbDiscoveryOptions &options) :
+        m_fabric(nullptr),
+        m_madPortPool(1),
+        m_workerPool(new IbWorkerPool(1)),
+        m_isNetwork(network && !compatibility),
+        m_isCompatibility(compatibility),
+        m_discoveryOptions(options),
+        m_historyCapacity(0),
+        m_isBaselineReset(false),
+        m_isResetOnSaturation(false),
+        m_counterMask(COUNTER_MASK_ALL),
+        m_queryWindow(0),
+        m_sysfsBatch(nullptr),
+        m_portCounterTable(nullptr),
+        m_nodeCounterTable(nullptr),
+        m_totals(),
+        m_publishBuffers{nullptr, nullptr},
+        m_publishSequence(0),
+        m_publishedTotals() {
+    const std::string &cachePath = options.GetCachePath();
+    bool isCached = false;
+
+    if (!compatibility && !cachePath.empty()) {
+        try {
+            IbTopologyCache cache(cachePath);
+
+            // A cache, that has been written with another start port, hop limit or other filters, may lack nodes,
+            // that these options select, so it is not used.
+            if (cache.IsNetwork() == m_isNetwork && cache.GetScopeFingerprint() == options.GetScopeFingerprint()) {
+                for (uint32_t i = 0; i < cache.GetNumNodes(); i++) {
+                    m_nodes.push_back(new IbNode(cache, i, m_madPortPool));
+                }
+
+                isCached = true;
+            }
+        } catch (const IbFileException &exception) {
+            // Without a usable cache, the fabric is simply discovered.
+        }
+    }
+
+    if (!isCached) {
+        discoverFabric(network, compatibility);
+
+        if (!compatibility && !cachePath.empty()) {
+            try {
+                SaveTopologyCache(cachePath);
+            } catch (const IbFileException &exception) {
+                // The cache only speeds up the next start, so the fabric is usable anyway.
+            }
+        }
+    }
+
+    updateNodeList();
+
+    SetBatchedReads(true);
 }
 
 IbFabric::~IbFabric() {
+    deleteQueryEngines();
+
+    delete m_sysfsBatch;
+    delete m_workerPool;
+
+    delete[] m_publishBuffers[0];
+    delete[] m_publishBuffers[1];
+
     for (IbNode *node : m_nodes) {
         delete node;
     }
 
+    delete m_portCounterTable;
+    delete m_nodeCounterTable;
+
     if(m_fabric != nullptr) {
         ibnd_destroy_fabric(m_fabric);
     }
 }
 
+IbFabric::RediscoveryResult IbFabric::Rediscover() {
+    RediscoveryResult result{};
+    bool isBatchedReadsEnabled = IsBatchedReadsEnabled();
+    bool isCounterTableEnabled = m_portCounterTable != nullptr;
+    std::unordered_set<IbPerfCounter *> known(m_nodes.begin(), m_nodes.end());
+
+    known.insert(m_ports.begin(), m_ports.end());
+
+    // The batch and the tables refer to the ports, so they are rebuilt afterwards.
+    SetBatchedReads(false);
+    SetCounterTable(false);
+
+    try {
+        if (m_isNetwork) {
+            rediscoverNetwork(result);
+        } else {
+            rediscoverLocalDevices(result);
+        }
+    } catch (...) {
+        // Known nodes may have changed their ports already. Either way, the fabric must not be left without its
+        // batch and counter tables.
+        finishRediscovery(known, isBatchedReadsEnabled, isCounterTableEnabled);
+        throw;
+    }
+
+    finishRediscovery(known, isBatchedReadsEnabled, isCounterTableEnabled);
+
+    return result;
+}
+
+void IbFabric::finishRediscovery(const std::unordered_set<IbPerfCounter *> &known, bool isBatchedReadsEnabled,
+                                 bool isCounterTableEnabled) {
+    updateNodeList();
+
+    for (IbNode *node : m_nodes) {
+        if (known.count(node) == 0) {
+            node->SetBaselineReset(m_isBaselineReset);
+            node->SetCounterMask(m_counterMask);
+            node->SetHistoryCapacity(m_historyCapacity);
+        }
+    }
+
+    for (IbPort *port : m_ports) {
+        if (known.count(port) == 0) {
+            port->SetBaselineReset(m_isBaselineReset);
+            port->SetResetOnSaturation(m_isResetOnSaturation);
+            port->SetCounterMask(m_counterMask);
+            port->SetHistoryCapacity(m_historyCapacity);
+        }
+    }
+
+    SetBatchedReads(isBatchedReadsEnabled);
+    SetCounterTable(isCounterTableEnabled);
+
+    publishSnapshots();
+}
+
+void IbFabric::rediscoverNetwork(RediscoveryResult &result) {
+    ibnd_fabric_t *fabric = m_discoveryOptions.Discover();
+
+    std::unordered_map<uint64_t, IbNode *> oldNodes;
+    std::vector<IbNode *> nodes;
+
+    for (IbNode *node : m_nodes) {
+        oldNodes[node->GetGuid()] = node;
+    }
+
+    for (ibnd_node_t *currentNode = fabric->nodes; currentNode != nullptr; currentNode = currentNode->next) {
+        // Nodes, that do not pass the filters anymore, are removed like vanished ones.
+        if (!m_discoveryOptions.IsMatch(currentNode)) {
+            continue;
+        }
+
+        auto oldNode = oldNodes.find(currentNode->guid);
+
+        if (oldNode != oldNodes.end()) {
+            IbNode::PortChanges changes = oldNode->second->UpdatePorts(currentNode, m_madPortPool,
+                                                                       m_discoveryOptions.IsLazyPortInit());
+
+            result.numAddedPorts += changes.numAdded;
+            result.numRemovedPorts += changes.numRemoved;
+            result.numFailed += changes.numFailed;
+
+            nodes.push_back(oldNode->second);
+            oldNodes.erase(oldNode);
+
+            continue;
+        }
+
+        try {
+            nodes.push_back(new IbNode(currentNode, m_madPortPool, m_discoveryOptions.IsLazyPortInit()));
+
+            result.numAddedNodes++;
+            result.numAddedPorts += nodes.back()->GetPorts().size();
+        } catch (const IbMadException &exception) {
+            result.numFailed++;
+        }
+    }
+
+    // All nodes, that are left, have vanished.
+    for (auto &oldNode : oldNodes) {
+        result.numRemovedNodes++;
+        result.numRemovedPorts += oldNode.second->GetPorts().size();
+
+        delete oldNode.second;
+    }
+
+    m_nodes = nodes;
+
+    // The nodes do not keep any pointers into the old fabric.
+    if (m_fabric != nullptr) {
+        ibnd_destroy_fabric(m_fabric);
+    }
+
+    m_fabric = fabric;
+}
+
+void IbFabric::rediscoverLocalDevices(RediscoveryResult &result) {
+    int32_t numDevices;
+    ibv_device **deviceList = ibv_get_device_list(&numDevices);
+
+    if(deviceList == nullptr) {
+        throw IbVerbsException("Unable to get device list! Error: " + std::string(strerror(errno)));
+    }
+
+    std::unordered_map<uint64_t, IbNode *> oldNodes;
+    std::vector<IbNode *> nodes;
+
+    for (IbNode *node : m_nodes) {
+        oldNodes[node->GetGuid()] = node;
+    }
+
+    for(int32_t i = 0; i < numDevices; i++) {
+        auto oldNode = oldNodes.find(htonll(ibv_get_device_guid(deviceList[i])));
+
+        if (oldNode != oldNodes.end()) {
+            nodes.push_back(oldNode->second);
+            oldNodes.erase(oldNode);
+
+            continue;
+        }
+
+        try {
+            nodes.push_back(new IbNode(deviceList[i], m_isCompatibility, m_madPortPool));
+
+            result.numAddedNodes++;
+            result.numAddedPorts += nodes.back()->GetPorts().size();
+        } catch(const IbPerfException &exception) {
+            result.numFailed++;
+        }
+    }
+
+    ibv_free_device_list(deviceList);
+
+    for (auto &oldNode : oldNodes) {
+        result.numRemovedNodes++;
+        result.numRemovedPorts += oldNode.second->GetPorts().size();
+
+        delete oldNode.second;
+    }
+
+    m_nodes = nodes;
+}
+
+void IbFabric::SaveTopologyCache(const std::string &path) const {
+    IbTopologyCache::Save(path, m_nodes, m_isNetwork, m_discoveryOptions.GetScopeFingerprint());
+}
+
+void IbFabric::updateNodeList() {
+    std::sort(m_nodes.begin(), m_nodes.end(),
+              [](IbNode *l, IbNode *r) { return l->GetDescription() < r->GetDescription(); });
+
+    m_ports.clear();
+
+    for (IbNode *node : m_nodes) {
+        m_ports.insert(m_ports.end(), node->GetPorts().begin(), node->GetPorts().end());
+    }
+
+    size_t publishBufferSize = (m_nodes.size() + m_ports.size()) * (NUM_COUNTERS + 1);
+
+    for (std::atomic<uint64_t> *&buffer : m_publishBuffers) {
+        delete[] buffer;
+        buffer = new std::atomic<uint64_t>[publishBufferSize];
+
+        for (size_t i = 0; i < publishBufferSize; i++) {
+            buffer[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
 void IbFabric::RefreshCounters() {
+    try {
+        refreshCounters();
+    } catch (...) {
+        // Publish the ports, that have been refreshed successfully, anyway.
+        publishSnapshots();
+        throw;
+    }
+
+    publishSnapshots();
+}
+
+void IbFabric::refreshCounters() {
+    if (m_sysfsBatch != nullptr) {
+        m_sysfsBatch->Submit();
+    }
+
+    if (!m_queryEngines.empty()) {
+        uint32_t numWorkers = m_workerPool->GetNumWorkers();
+
+        // The engines use the ports' query plans as they are, so ports from a topology cache need to be verified
+        // beforehand (see IbPort::RefreshCounters()). Ports, that could not be verified, are left out.
+        std::vector<IbPort *> verifiedPorts;
+        const std::vector<IbPort *> &ports = verifyCachedPorts(verifiedPorts) ? m_ports : verifiedPorts;
+
+        // Split the ports into one contiguous slice per worker, so that each engine can pipeline its queries.
+        m_workerPool->ParallelFor(numWorkers, [this, &ports, numWorkers](size_t index, uint32_t worker) {
+            size_t begin = ports.size() * index / numWorkers;
+            size_t end = ports.size() * (index + 1) / numWorkers;
+
+            m_queryEngines[worker]->RefreshCounters(ports.data() + begin, end - begin);
+        });
+
+        // The engines do not reset saturated counters themselves, since they keep their MAD-ports borrowed.
+        for (IbPort *port : ports) {
+            try {
+                port->ResetSaturatedCounters();
+            } catch (const IbMadException &exception) {
+                // The counters stay saturated, so the reset is tried again after the next refresh.
+                // Until then, the other ports are reset as usual.
+            }
+        }
+
+        aggregateNodes();
+
+        if (ports.size() < m_ports.size()) {
+            throw IbMadException("Failed to verify the capabilities of " +
+                                 std::to_string(m_ports.size() - ports.size()) + " ports!");
+        }
+
+        return;
+    }
+
+    if (m_workerPool->GetNumWorkers() <= 1) {
+        for (IbNode *node : m_nodes) {
+            node->RefreshCounters();
+        }
+
+        return;
+    }
+
+    m_workerPool->ParallelFor(m_ports.size(), [this](size_t index, uint32_t worker) {
+        m_ports[index]->RefreshCounters();
+    });
+
+    aggregateNodes();
+}
+
+void IbFabric::aggregateNodes() {
+    if (m_portCounterTable == nullptr) {
+        for (IbNode *node : m_nodes) {
+            node->AggregateCounters();
+        }
+
+        return;
+    }
+
+    size_t firstRow = 0;
+
+    for (IbNode *node : m_nodes) {
+        node->AggregateCounters(*m_portCounterTable, firstRow);
+        firstRow += node->GetPorts().size();
+    }
+}
+
+void IbFabric::calculateTotals() {
+    m_totals = IbPerfSnapshot{};
+
+    for (const IbNode *node : m_nodes) {
+        m_totals.timestamp = std::max(m_totals.timestamp, node->GetTimestamp());
+    }
+
+    if (m_nodeCounterTable != nullptr) {
+        for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+            m_totals.values[i] = IbCounterKernels::Sum(m_nodeCounterTable->GetColumn(static_cast<IbCounterId>(i)),
+                                                       m_nodes.size());
+        }
+
+        return;
+    }
+
+    for (const IbNode *node : m_nodes) {
+        IbPerfSnapshot snapshot = node->GetSnapshot();
+        IbCounterKernels::Add(m_totals.values, snapshot.values, NUM_COUNTERS);
+    }
+}
+
+IbPerfSnapshot IbFabric::GetTotalDeltas() const {
+    IbPerfSnapshot deltas{};
+    uint64_t nodeDeltas[NUM_COUNTERS];
+
+    deltas.timestamp = m_totals.timestamp;
+
+    // The deltas are calculated per node, so that a reset of a single node's counters only zeroes the deltas of this
+    // node, instead of hiding the traffic of the whole fabric. Nodes, that have been read only once, are left out.
+    for (const IbNode *node : m_nodes) {
+        const IbPerfSnapshot &previous = node->GetPreviousSnapshot();
+
+        if (previous.timestamp == 0) {
+            continue;
+        }
+
+        IbPerfSnapshot current = node->GetSnapshot();
+
+        IbCounterKernels::Subtract(current.values, previous.values, nodeDeltas, NUM_COUNTERS);
+        IbCounterKernels::Add(deltas.values, nodeDeltas, NUM_COUNTERS);
+    }
+
+    return deltas;
+}
+
+void IbFabric::RefreshAggregateCounters() {
+    try {
+        if (m_sysfsBatch != nullptr) {
+            m_sysfsBatch->Submit();
+        }
+
+        m_workerPool->ParallelFor(m_nodes.size(), [this](size_t index, uint32_t worker) {
+            m_nodes[index]->RefreshAggregateCounters();
+        });
+    } catch (...) {
+        publishSnapshots();
+        throw;
+    }
+
+    publishSnapshots();
+}
+
+void IbFabric::publishSnapshots() {
+    uint64_t sequence = m_publishSequence.load(std::memory_order_relaxed);
+    std::atomic<uint64_t> *buffer = m_publishBuffers[(sequence / 2 + 1) % 2];
+    size_t offset = 0;
+
+    calculateTotals();
+
+    // Announce, that the other buffer is being written. Readers of the current buffer are not affected by this.
+    m_publishSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto write = [&buffer, &offset](const IbPerfSnapshot &snapshot) {
+        buffer[offset++].store(snapshot.timestamp, std::memory_order_relaxed);
+
+        for (uint64_t value : snapshot.values) {
+            buffer[offset++].store(value, std::memory_order_relaxed);
+        }
+    };
+
+    for (const IbNode *node : m_nodes) {
+        write(node->GetSnapshot());
+    }
+
+    for (const IbPort *port : m_ports) {
+        write(port->GetSnapshot());
+    }
+
+    m_publishSequence.store(sequence + 2, std::memory_order_release);
+    m_publishedTotals.Store(m_totals);
+}
+
+uint64_t IbFabric::GetPublishedSnapshots(std::vector<IbPerfSnapshot> &nodeSnapshots,
+                                         std::vector<IbPerfSnapshot> &portSnapshots) const {
+    nodeSnapshots.resize(m_nodes.size());
+    portSnapshots.resize(m_ports.size());
+
+    while (true) {
+        uint64_t sequence = m_publishSequence.load(std::memory_order_acquire);
+        uint64_t number = sequence / 2;
+        const std::atomic<uint64_t> *buffer = m_publishBuffers[number % 2];
+        size_t offset = 0;
+
+        auto read = [&buffer, &offset](IbPerfSnapshot &snapshot) {
+            snapshot.timestamp = buffer[offset++].load(std::memory_order_relaxed);
+
+            for (uint64_t &value : snapshot.values) {
+                value = buffer[offset++].load(std::memory_order_relaxed);
+            }
+        };
+
+        for (IbPerfSnapshot &snapshot : nodeSnapshots) {
+            read(snapshot);
+        }
+
+        for (IbPerfSnapshot &snapshot : portSnapshots) {
+            read(snapshot);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // The buffer is only overwritten, when refresh (number + 2) is published, which starts with sequence 2n + 3.
+        if (m_publishSequence.load(std::memory_order_relaxed) <= 2 * number + 2) {
+            return number;
+        }
+    }
+}
+
+void IbFabric::SetNumThreads(uint32_t numThreads) {
+    if (numThreads == m_workerPool->GetNumWorkers()) {
+        return;
+    }
+
+    delete m_workerPool;
+    m_workerPool = new IbWorkerPool(numThreads);
+
+    m_madPortPool.SetMaxPorts(m_workerPool->GetNumWorkers());
+
+    createQueryEngines();
+}
+
+void IbFabric::SetQueryWindow(uint32_t windowSize) {
+    m_queryWindow = windowSize;
+
+    createQueryEngines();
+}
+
+void IbFabric::SetBatchedReads(bool enabled) {
+    delete m_sysfsBatch;
+    m_sysfsBatch = nullptr;
+
+    if (!enabled || !m_isCompatibility) {
+        return;
+    }
+
+    m_sysfsBatch = new IbSysfsBatch();
+
+    if (!m_sysfsBatch->IsAvailable()) {
+        delete m_sysfsBatch;
+        m_sysfsBatch = nullptr;
+
+        return;
+    }
+
+    for (IbPort *port : m_ports) {
+        port->RegisterFiles(*m_sysfsBatch);
+    }
+}
+
+void IbFabric::SetCounterTable(bool enabled) {
+    if (enabled == (m_portCounterTable != nullptr)) {
+        return;
+    }
+
+    if (!enabled) {
+        for (IbNode *node : m_nodes) {
+            node->DetachStorage();
+        }
+
+        for (IbPort *port : m_ports) {
+            port->DetachStorage();
+        }
+
+        delete m_portCounterTable;
+        delete m_nodeCounterTable;
+        m_portCounterTable = nullptr;
+        m_nodeCounterTable = nullptr;
+
+        return;
+    }
+
+    m_portCounterTable = new IbCounterTable(m_ports.size());
+    m_nodeCounterTable = new IbCounterTable(m_nodes.size());
+
+    for (size_t i = 0; i < m_ports.size(); i++) {
+        m_ports[i]->AttachStorage(m_portCounterTable->GetRow(i), m_portCounterTable->GetStride());
+    }
+
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+        m_nodes[i]->AttachStorage(m_nodeCounterTable->GetRow(i), m_nodeCounterTable->GetStride());
+    }
+}
+
+void IbFabric::createQueryEngines() {
+    deleteQueryEngines();
+
+    if (m_queryWindow == 0 || m_isCompatibility) {
+        return;
+    }
+
+    try {
+        for (uint32_t i = 0; i < m_workerPool->GetNumWorkers(); i++) {
+            m_queryEngines.push_back(new IbMadQueryEngine(m_madPortPool, m_queryWindow));
+        }
+    } catch (const IbMadException &exception) {
+        deleteQueryEngines();
+        m_queryWindow = 0;
+
+        throw;
+    }
+}
+
+void IbFabric::deleteQueryEngines() {
+    for (IbMadQueryEngine *engine : m_queryEngines) {
+        delete engine;
+    }
+
+    m_queryEngines.clear();
+}
+
+void IbFabric::SetBaselineReset(bool enabled) {
+    m_isBaselineReset = enabled;
+
+    for (IbNode *node : m_nodes) {
+        node->SetBaselineReset(enabled);
+    }
+}
+
+void IbFabric::SetCounterMask(uint32_t mask) {
+    m_counterMask = mask & COUNTER_MASK_ALL;
+
+    for (IbNode *node : m_nodes) {
+        node->SetCounterMask(m_counterMask);
+    }
+
+    // The batch needs to leave out the files of counters, that are not selected anymore.
+    SetBatchedReads(IsBatchedReadsEnabled());
+}
+
+void IbFabric::SetResetOnSaturation(bool enabled) {
+    m_isResetOnSaturation = enabled;
+
+    for (IbPort *port : m_ports) {
+        port->SetResetOnSaturation(enabled);
+    }
+}
+
+void IbFabric::SetHistoryCapacity(size_t capacity) {
+    m_historyCapacity = capacity;
+
     for (IbNode *node : m_nodes) {
-        node->RefreshCounters();
+        node->SetHistoryCapacity(capacity);
     }
+
+    for (IbPort *port : m_ports) {
+        port->SetHistoryCapacity(capacity);
+    }
+}
+
+IbPerfRates IbFabric::GetRates() const {
+    IbPerfRates rates{};
+
+    for (const IbNode *node : m_nodes) {
+        IbPerfRates nodeRates = node->GetRates();
+
+        rates.interval = std::max(rates.interval, nodeRates.interval);
+
+        for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+            rates.values[i] += nodeRates.values[i];
+        }
+    }
+
+    return rates;
 }
 
 void IbFabric::ResetCounters() {
@@ -70,34 +696,105 @@ void IbFabric::discoverFabric(bool network, bool compatibility) {
 }
 
 void IbFabric::discoverNetwork() {
-    // The config contains parameters for ibnd_discover_fabric.
-    // We don't need any special parameters and just set them all to zero.
-    ibnd_config_t config = {0};
-
-    // ibnd_discover_fabric() scans the entire InfiniBand-fabric for nodes.
-    // It takes the following parameters:
-    //
-    // dev_name: The name of the local device, from which the discovery is started.
-    //           This seems to be optional, as passing a nullptr also works.
-    // dev_port: This seems to be number of the local port from which the discovery is started.
-    //           Passing a zero works fine. I guess, it then uses a default value.
-    // from:     This seems to be a portid-struct, that describes the local port, from which the discovery is started.
-    //           Again, passing a nullptr works fine.
-    // config:   Contains some configuration parameters for ibnd_discover_fabric()
-    m_fabric = ibnd_discover_fabric(nullptr, 0, nullptr, &config);
-
-    if (m_fabric == nullptr) {
-        throw IbNetDiscException("Unable to discover nodes in the fabric (ibnd_discover_fabric failed)!");
-    }
+    // The options decide, where the discovery starts and how far it goes (see IbDiscoveryOptions::Discover()).
+    m_fabric = m_discoveryOptions.Discover();
 
     // The found nodes are stored in a linked list, where every node has a pointer to the next one.
-    ibnd_node_t *currentNode = &m_fabric->nodes[0];
+    // Iterate over all nodes, that pass the filters, and create an instance of IbNode for each one. The ports are
+    // created from the discovery's data without sending any MADs, so that their setup queries can be spread
+    // over multiple threads.
+    for (ibnd_node_t *currentNode = m_fabric->nodes; currentNode != nullptr; currentNode = currentNode->next) {
+        if (m_discoveryOptions.IsMatch(currentNode)) {
+            m_nodes.emplace_back(new IbNode(currentNode, m_madPortPool, true));
+        }
+    }
+
+    if (m_discoveryOptions.IsLazyPortInit()) {
+        return;
+    }
+
+    std::vector<IbPort *> ports;
+
+    for (IbNode *node : m_nodes) {
+        ports.insert(ports.end(), node->GetPorts().begin(), node->GetPorts().end());
+    }
+
+    verifyPorts(ports);
 
-    // Iterate over all nodes and create an instance of IbPort for each one.
-    do {
-        m_nodes.emplace_back(new IbNode(currentNode));
-        currentNode = currentNode->next;
-    } while (currentNode != nullptr);
+    for (IbNode *node : m_nodes) {
+        node->UpdateCapabilities();
+    }
+}
+
+void IbFabric::verifyPorts(const std::vector<IbPort *> &ports) {
+    std::vector<std::string> errors(ports.size());
+
+    runDiscoveryTasks(ports.size(), [&ports, &errors](size_t index, uint32_t worker) {
+        try {
+            ports[index]->Verify();
+        } catch (const IbMadException &exception) {
+            std::ostringstream error;
+
+            error << "LID 0x" << std::hex << ports[index]->GetLid() << std::dec << ", port "
+                  << unsigned(ports[index]->GetNum()) << ": " << exception.what();
+            errors[index] = error.str();
+        }
+    });
+
+    for (const std::string &error : errors) {
+        if (!error.empty()) {
+            m_discoveryErrors.push_back(error);
+        }
+    }
+}
+
+bool IbFabric::verifyCachedPorts(std::vector<IbPort *> &verifiedPorts) {
+    std::vector<IbPort *> ports;
+
+    for (IbPort *port : m_ports) {
+        if (!port->IsVerified()) {
+            ports.push_back(port);
+        }
+    }
+
+    if (ports.empty()) {
+        return true;
+    }
+
+    // This runs before every refresh, while ports are unverified, so it uses the fabric's own threads and MAD-ports.
+    // Ports, that do not answer, are only tried again after a growing amount of refreshes (see IbPort::TryVerify()).
+    m_workerPool->ParallelFor(ports.size(), [&ports](size_t index, uint32_t worker) {
+        ports[index]->TryVerify();
+    });
+
+    for (IbNode *node : m_nodes) {
+        node->UpdateCapabilities();
+    }
+
+    for (IbPort *port : m_ports) {
+        if (port->IsVerified()) {
+            verifiedPorts.push_back(port);
+        }
+    }
+
+    return verifiedPorts.size() == m_ports.size();
+}
+
+void IbFabric::runDiscoveryTasks(size_t count, const IbWorkerPool::Task &task) {
+    uint32_t numThreads = std::min<uint32_t>(std::thread::hardware_concurrency(), DISCOVERY_MAX_THREADS);
+    IbWorkerPool workerPool(numThreads);
+
+    // Every thread needs a MAD-port of its own, or the threads would wait for each other.
+    m_madPortPool.SetMaxPorts(workerPool.GetNumWorkers());
+
+    try {
+        workerPool.ParallelFor(count, task);
+    } catch (...) {
+        m_madPortPool.SetMaxPorts(m_workerPool->GetNumWorkers());
+        throw;
+    }
+
+    m_madPortPool.SetMaxPorts(m_workerPool->GetNumWorkers());
 }
 
 void IbFabric::discoverLocalDevices(bool compatibility) {
@@ -108,19 +805,27 @@ void IbFabric::discoverLocalDevices(bool compatibility) {
         throw IbVerbsException("Unable to get device list! Error: " + std::string(strerror(errno)));
     }
 
-    for(int32_t i = 0; i < numDevices; i++) {
-        IbNode *currentNode = nullptr;
+    std::vector<IbNode *> nodes(static_cast<size_t>(numDevices), nullptr);
+    std::vector<std::string> errors(static_cast<size_t>(numDevices));
 
+    // Every device is set up by its own task. The results are collected by index, to keep the devices' order.
+    runDiscoveryTasks(nodes.size(), [&](size_t index, uint32_t worker) {
         try {
-            currentNode = new IbNode(deviceList[i], compatibility);
-        } catch(const IbVerbsException &exception) {
-            continue;
+            nodes[index] = new IbNode(deviceList[index], compatibility, m_madPortPool);
+        } catch(const IbPerfException &exception) {
+            errors[index] = std::string(ibv_get_device_name(deviceList[index])) + ": " + exception.what();
         }
-
-        m_nodes.emplace_back(currentNode);
-    }
+    });
 
     ibv_free_device_list(deviceList);
+
+    for(size_t i = 0; i < nodes.size(); i++) {
+        if(nodes[i] != nullptr) {
+            m_nodes.emplace_back(nodes[i]);
+        } else {
+            m_discoveryErrors.push_back(errors[i]);
+        }
+    }
 }
 
 }
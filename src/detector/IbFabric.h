@@ -19,7 +19,18 @@
 #ifndef DETECTOR_IBFABRIC_H
 #define DETECTOR_IBFABRIC_H
 
+// The maximum amount of threads, that set up nodes and ports during the discovery.
+#define DISCOVERY_MAX_THREADS 32
+
+#include <atomic>
+#include <unordered_set>
+#include "IbCounterTable.h"
+#include "IbDiscoveryOptions.h"
+#include "IbMadPortPool.h"
+#include "IbMadQueryEngine.h"
 #include "IbNode.h"
+#include "IbSysfsBatch.h"
+#include "IbWorkerPool.h"
 
 namespace Detector {
 
@@ -31,6 +42,36 @@ namespace Detector {
 class IbFabric {
 
 public:
+    /**
+     * The changes of the fabric, that have been made by Rediscover().
+     */
+    struct RediscoveryResult {
+        /**
+         * The amount of nodes, that have been found for the first time.
+         */
+        uint32_t numAddedNodes;
+
+        /**
+         * The amount of nodes, that have vanished.
+         */
+        uint32_t numRemovedNodes;
+
+        /**
+         * The amount of ports, that have been created (including the ports of new nodes).
+         */
+        uint32_t numAddedPorts;
+
+        /**
+         * The amount of ports, that have been deleted (including the ports of vanished nodes).
+         */
+        uint32_t numRemovedPorts;
+
+        /**
+         * The amount of nodes and ports, that have been discovered, but could not be set up.
+         */
+        uint32_t numFailed;
+    };
+
     /**
      * Constructor.
      *
@@ -46,16 +87,238 @@ public:
      */
     explicit IbFabric(bool network, bool compatibility);
 
+    /**
+     * Constructor.
+     *
+     * Like the constructor above, but the network discovery can be limited to a part of the network and the found
+     * nodes can be filtered, before any objects are created for them (see IbDiscoveryOptions).
+     * The options are kept and also apply to Rediscover().
+     *
+     * If the options contain a topology cache path (see IbTopologyCache), the fabric starts up without any MADs,
+     * if the cache file exists, is valid and has been written with the same value for network and the same scope
+     * (see IbDiscoveryOptions::GetScopeFingerprint()). Ports query their capabilities once again before their first
+     * refresh, in case they have changed (e.g. the link width). Topology changes since the cache has been written
+     * are picked up by Rediscover(). Otherwise, the fabric is discovered as usual and the cache is written
+     * afterwards. The cache is not used in compatibility mode.
+     *
+     * With lazy port initialization, the ports are created from the data, that the network discovery has gathered
+     * anyway, and each port queries its capabilities with its first refresh (see IbPort::Initialize()). Thus,
+     * the startup cost depends on the amount of ports, that are actually monitored, instead of the size of the fabric.
+     * This only affects the network discovery, since local devices are few and compatibility mode sends no MADs.
+     *
+     * @param network Set to true, to scan the entire network
+     * @param compatibility Set to true, to activate compatibility mode
+     * @param options The discovery options, including the topology cache path and lazy port initialization
+     */
+    IbFabric(bool network, bool compatibility, const IbDiscoveryOptions &options);
+
     /**
      * Destructor.
      */
     ~IbFabric();
 
+    /**
+     * Discover the fabric again and apply the changes to the existing nodes and ports.
+     *
+     * Nodes are matched by their GUID and ports by their number and LID. Objects are only created for new nodes
+     * and ports, and vanished ones are deleted. Everything else keeps its counters, baselines and history.
+     * New nodes and ports get the same settings (e.g. history capacity), that have been applied to the fabric.
+     * Nodes and ports, that do not answer the setup queries, are left out and may be found by the next call.
+     *
+     * CAUTION: This must not be called, while other threads use the fabric (including GetPublishedSnapshots()).
+     *          Pointers to deleted nodes and ports become invalid.
+     *
+     * @return The changes, that have been made
+     */
+    RediscoveryResult Rediscover();
+
+    /**
+     * Write the current topology and the capabilities of all ports to a topology cache (see IbTopologyCache).
+     *
+     * @param path The path of the cache file
+     */
+    void SaveTopologyCache(const std::string &path) const;
+
     /**
      * Refreshes the performance counters on all nodes in the fabric.
+     *
+     * If more than one thread has been configured via SetNumThreads(), the ports of all nodes are distributed
+     * over a pool of worker threads and the node aggregates are calculated afterwards.
+     * The resulting values are the same as with a single thread.
      */
     void RefreshCounters();
 
+    /**
+     * Refreshes only the aggregated counters of all nodes in the fabric (see IbNode::RefreshAggregateCounters()).
+     *
+     * Switches, that support AllPortSelect, are queried with a single query per switch.
+     * This is much cheaper than RefreshCounters(), if only per-node values are needed.
+     */
+    void RefreshAggregateCounters();
+
+    /**
+     * Set the amount of threads, that are used to refresh the counters (default: 1).
+     *
+     * All ports share a pool of MAD-ports, which is resized to the amount of threads,
+     * so that each worker can borrow its own MAD-port.
+     *
+     * @param numThreads The amount of threads (0 is treated as 1)
+     */
+    void SetNumThreads(uint32_t numThreads);
+
+    /**
+     * Get the amount of threads, that are used to refresh the counters.
+     */
+    uint32_t GetNumThreads() const {
+        return m_workerPool->GetNumWorkers();
+    }
+
+    /**
+     * Set the maximum amount of PMA-queries, that each thread keeps in flight during a refresh (default: 0).
+     *
+     * A value of 0 refreshes one port after another with blocking queries. Any other value uses an IbMadQueryEngine
+     * per thread, which sends the queries for many ports at once and decodes the responses as they arrive.
+     * This setting is ignored in compatibility mode.
+     *
+     * @param windowSize The maximum amount of outstanding queries per thread
+     */
+    void SetQueryWindow(uint32_t windowSize);
+
+    /**
+     * Get the maximum amount of PMA-queries, that each thread keeps in flight during a refresh.
+     */
+    uint32_t GetQueryWindow() const {
+        return m_queryWindow;
+    }
+
+    /**
+     * Enable or disable batched reads of the counter files in compatibility mode (default: enabled).
+     *
+     * If enabled, the files of all ports are read with a single io_uring submission per refresh,
+     * instead of one system call per counter. If io_uring is not available, the setting has no effect.
+     * This setting is ignored, if the fabric has not been discovered in compatibility mode.
+     *
+     * @param enabled Set to true, to enable batched reads
+     */
+    void SetBatchedReads(bool enabled);
+
+    /**
+     * Check, whether the counter files are read in batches.
+     */
+    bool IsBatchedReadsEnabled() const {
+        return m_sysfsBatch != nullptr;
+    }
+
+    /**
+     * Choose, how ResetCounters() works on all nodes and ports (see IbPerfCounter::SetBaselineReset()).
+     * With baseline resets, resetting the whole fabric does not send a single MAD.
+     *
+     * @param enabled Set to true, to reset the counters by storing a baseline
+     */
+    void SetBaselineReset(bool enabled);
+
+    /**
+     * Choose, which counters are updated by RefreshCounters() on all nodes and ports
+     * (see IbPerfCounter::SetCounterMask()). The mask is also applied to nodes and ports, that are added later.
+     *
+     * @param mask The selected counters (e.g. COUNTER_MASK_DATA)
+     */
+    void SetCounterMask(uint32_t mask);
+
+    /**
+     * Get the counters, that are updated by RefreshCounters().
+     */
+    uint32_t GetCounterMask() const {
+        return m_counterMask;
+    }
+
+    /**
+     * Enable or disable resetting saturated counters on all ports (see IbPort::SetResetOnSaturation()).
+     *
+     * @param enabled Set to true, to reset saturated counters
+     */
+    void SetResetOnSaturation(bool enabled);
+
+    /**
+     * Let every port and node keep its most recent snapshots in a history (default: 0, which disables the history).
+     * See IbPerfCounter::SetHistoryCapacity().
+     *
+     * @param capacity The maximum amount of snapshots per port and node
+     */
+    void SetHistoryCapacity(size_t capacity);
+
+    /**
+     * Store the counters of all ports and nodes in two fabric-wide IbCounterTables (default: disabled).
+     *
+     * Port i of GetPorts() uses row i of the port table and node i of GetNodes() uses row i of the node table.
+     * The ports and nodes keep their values and can be used as before. Passes over a single counter of all ports
+     * (e.g. sums or rankings) can then work directly on the table's columns.
+     *
+     * @param enabled Set to true, to enable the counter tables
+     */
+    void SetCounterTable(bool enabled);
+
+    /**
+     * Get the table, that holds the counters of all ports. Null, if the counter tables are disabled.
+     */
+    const IbCounterTable *GetPortCounterTable() const {
+        return m_portCounterTable;
+    }
+
+    /**
+     * Get the table, that holds the counters of all nodes. Null, if the counter tables are disabled.
+     */
+    const IbCounterTable *GetNodeCounterTable() const {
+        return m_nodeCounterTable;
+    }
+
+    /**
+     * Get a consistent copy of the counters of all nodes and ports, as they have been after the last completed
+     * RefreshCounters() or RefreshAggregateCounters().
+     *
+     * All copies belong to the same refresh. This may be called by any amount of threads, while another thread is
+     * refreshing the fabric. The refreshing thread never waits for readers. A reader only has to retry, if a whole
+     * refresh completes, while it is copying the values.
+     *
+     * @param nodeSnapshots Filled with one snapshot per node, in the order of GetNodes()
+     * @param portSnapshots Filled with one snapshot per port, in the order of the nodes and their ports
+     *
+     * @return The number of the refresh, that the snapshots belong to (0, if the fabric has not been refreshed yet)
+     */
+    uint64_t GetPublishedSnapshots(std::vector<IbPerfSnapshot> &nodeSnapshots,
+                                   std::vector<IbPerfSnapshot> &portSnapshots) const;
+
+    /**
+     * Get a consistent copy of the counters summed up over all nodes, as they have been after the last
+     * completed refresh. This may be called by any amount of threads, while another thread is refreshing the fabric.
+     */
+    IbPerfSnapshot GetPublishedTotals() const {
+        return m_publishedTotals.Load();
+    }
+
+    /**
+     * Get the counters summed up over all nodes in the fabric, as they have been after the last refresh.
+     * The timestamp is the one of the most recently read node.
+     *
+     * CAUTION: Like the getters of the nodes, this must not be used, while another thread refreshes the counters.
+     *          Use GetPublishedTotals() instead.
+     */
+    const IbPerfSnapshot &GetTotals() const {
+        return m_totals;
+    }
+
+    /**
+     * Get the changes of the counters between each node's last two refreshes, summed up over all nodes
+     * (see IbCounterKernels::Subtract()). The timestamp is the one of the last refresh.
+     */
+    IbPerfSnapshot GetTotalDeltas() const;
+
+    /**
+     * Get the rates of all counters per second, summed up over all nodes in the fabric.
+     * Each node's rates are calculated from the timestamps of its own queries (see IbNode::GetRates()).
+     */
+    IbPerfRates GetRates() const;
+
     /**
      * Resets the performance counters on all nodes in the fabric.
      */
@@ -75,6 +338,24 @@ public:
         return m_nodes;
     }
 
+    /**
+     * Get the errors, that have occurred while setting up the discovered nodes and ports.
+     *
+     * Nodes and ports are set up concurrently (see DISCOVERY_MAX_THREADS). A node or port, that fails,
+     * does not abort the discovery. Failed nodes are left out, while failed ports are kept uninitialized
+     * and query their capabilities again with their first refresh. The errors are ordered like the discovered devices.
+     */
+    const std::vector<std::string> &GetDiscoveryErrors() const {
+        return m_discoveryErrors;
+    }
+
+    /**
+     * Get the ports of all nodes in a single vector, in the order of the nodes and their ports.
+     */
+    const std::vector<IbPort *> &GetPorts() const {
+        return m_ports;
+    }
+
     /**
      * Write fabric information to an output stream.
      */
@@ -101,6 +382,94 @@ private:
 
     void discoverLocalDevices(bool compatibility);
 
+    /**
+     * Query the capabilities of the given ports concurrently and record the ports, that have failed,
+     * in m_discoveryErrors.
+     *
+     * @param ports The ports
+     */
+    void verifyPorts(const std::vector<IbPort *> &ports);
+
+    /**
+     * Verify all ports, that have been loaded from a topology cache and have not been verified yet, using the
+     * fabric's worker pool (see IbPort::TryVerify()). Ports, that do not answer, stay unverified.
+     *
+     * @param verifiedPorts Set to the verified ports, if any port is unverified. Otherwise, it is left empty.
+     *
+     * @return true, if all ports are verified
+     */
+    bool verifyCachedPorts(std::vector<IbPort *> &verifiedPorts);
+
+    /**
+     * Execute a task for every index in [0, count) on a temporary worker pool, that is sized by the amount of cores
+     * (at most DISCOVERY_MAX_THREADS). The MAD-port pool is enlarged for the duration of the call.
+     *
+     * @param count The amount of work items
+     * @param task The task to execute for each work item
+     */
+    void runDiscoveryTasks(size_t count, const IbWorkerPool::Task &task);
+
+    /**
+     * Rediscover the nodes of the whole network (see Rediscover()).
+     *
+     * @param result The result, that the changes are added to
+     */
+    void rediscoverNetwork(RediscoveryResult &result);
+
+    /**
+     * Rediscover the local devices (see Rediscover()). The ports of known devices are kept as they are.
+     *
+     * @param result The result, that the changes are added to
+     */
+    void rediscoverLocalDevices(RediscoveryResult &result);
+
+    /**
+     * Rebuild the node list after a rediscovery, apply the fabric's settings to new nodes and ports and restore
+     * the batch and the counter tables. This is also done, if the rediscovery fails.
+     *
+     * @param known The nodes and ports, that have existed before the rediscovery
+     * @param isBatchedReadsEnabled Whether batched reads have been enabled before the rediscovery
+     * @param isCounterTableEnabled Whether the counter tables have been enabled before the rediscovery
+     */
+    void finishRediscovery(const std::unordered_set<IbPerfCounter *> &known, bool isBatchedReadsEnabled,
+                           bool isCounterTableEnabled);
+
+    /**
+     * Sort the nodes, rebuild m_ports and resize the publication buffers after the nodes have changed.
+     */
+    void updateNodeList();
+
+    /**
+     * Refresh the counters without publishing them (see RefreshCounters()).
+     */
+    void refreshCounters();
+
+    /**
+     * Sum up the counters of each node's ports into the node (see IbNode::AggregateCounters()).
+     */
+    void aggregateNodes();
+
+    /**
+     * Sum up the counters of all nodes into m_totals.
+     */
+    void calculateTotals();
+
+    /**
+     * Copy the counters of all nodes and ports into the publication buffer, that readers are currently not using,
+     * and make it the current one.
+     */
+    void publishSnapshots();
+
+    /**
+     * (Re-)create one query engine per worker, according to m_queryWindow.
+     */
+    void createQueryEngines();
+
+    /**
+     * Delete all query engines.
+     */
+    void deleteQueryEngines();
+
 private:
     /**
      * Pointer to an ibnd_fabric-struct.
@@ -108,10 +477,111 @@ private:
      */
     ibnd_fabric_t *m_fabric;
 
+    /**
+     * The MAD-ports, that are shared by all ports in the fabric.
+     */
+    IbMadPortPool m_madPortPool;
+
     /**
      * All of the nodes in the fabric.
      */
     std::vector<IbNode *> m_nodes;
+
+    /**
+     * The ports of all nodes in a single vector, so that they can easily be distributed over the worker pool.
+     */
+    std::vector<IbPort *> m_ports;
+
+    /**
+     * The worker pool, that is used to refresh the counters.
+     */
+    IbWorkerPool *m_workerPool;
+
+    /**
+     * Whether the entire network has been scanned (instead of only the local devices).
+     */
+    bool m_isNetwork;
+
+    /**
+     * Whether the fabric has been discovered in compatibility mode.
+     */
+    bool m_isCompatibility;
+
+    /**
+     * The options, that the fabric has been discovered with.
+     */
+    IbDiscoveryOptions m_discoveryOptions;
+
+    /**
+     * The errors, that have occurred while setting up the discovered nodes and ports (see GetDiscoveryErrors()).
+     */
+    std::vector<std::string> m_discoveryErrors;
+
+    /**
+     * The history capacity of all nodes and ports (see SetHistoryCapacity()).
+     */
+    size_t m_historyCapacity;
+
+    /**
+     * Whether the nodes and ports use baseline resets (see SetBaselineReset()).
+     */
+    bool m_isBaselineReset;
+
+    /**
+     * Whether the ports reset saturated counters (see SetResetOnSaturation()).
+     */
+    bool m_isResetOnSaturation;
+
+    /**
+     * The counters, that are updated by RefreshCounters() (see SetCounterMask()).
+     */
+    uint32_t m_counterMask;
+
+    /**
+     * The maximum amount of outstanding queries per worker (0 means blocking queries).
+     */
+    uint32_t m_queryWindow;
+
+    /**
+     * One query engine per worker. Empty, if m_queryWindow is 0.
+     */
+    std::vector<IbMadQueryEngine *> m_queryEngines;
+
+    /**
+     * Reads the counter files of all ports at once in compatibility mode. Null, if batched reads are disabled.
+     */
+    IbSysfsBatch *m_sysfsBatch;
+
+    /**
+     * Holds the counters of all ports in m_ports. Null, if the counter tables are disabled.
+     */
+    IbCounterTable *m_portCounterTable;
+
+    /**
+     * Holds the counters of all nodes in m_nodes. Null, if the counter tables are disabled.
+     */
+    IbCounterTable *m_nodeCounterTable;
+
+    /**
+     * The counters of the last refresh, summed up over all nodes.
+     */
+    IbPerfSnapshot m_totals;
+
+    /**
+     * Two buffers, each holding one snapshot per node and port (timestamp followed by the counter values).
+     * Refresh n is published in m_publishBuffers[n % 2], so that readers of refresh n - 1 are not disturbed.
+     */
+    std::atomic<uint64_t> *m_publishBuffers[2];
+
+    /**
+     * 2 * (the number of the last published refresh), plus 1 while the next refresh is being published.
+     */
+    std::atomic<uint64_t> m_publishSequence;
+
+    /**
+     * The counters of the last published refresh, summed up over all nodes.
+     */
+    IbSeqLockedSnapshot m_publishedTotals;
 };
 
 }
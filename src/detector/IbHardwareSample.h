@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#ifndef DETECTOR_IBHARDWARESAMPLE_H
+#define DETECTOR_IBHARDWARESAMPLE_H
+
+#define MAX_SAMPLE_COUNTERS 15
+
+#include <cstdint>
+
+namespace Detector {
+
+/**
+ * The counters, that a device's PMA can sample (values of the CounterSelect-fields of PortSamplesControl).
+ */
+enum IbSampleCounter : uint16_t {
+    SAMPLE_COUNTER_NONE = 0x0000,
+    SAMPLE_COUNTER_XMIT_DATA = 0x0001,
+    SAMPLE_COUNTER_RCV_DATA = 0x0002,
+    SAMPLE_COUNTER_XMIT_PKTS = 0x0003,
+    SAMPLE_COUNTER_RCV_PKTS = 0x0004,
+    SAMPLE_COUNTER_XMIT_WAIT = 0x0005
+};
+
+/**
+ * The states of a device's sampling mechanism (values of the SampleStatus-field).
+ */
+enum IbSampleStatus : uint8_t {
+    SAMPLE_STATUS_DONE = 0,
+    SAMPLE_STATUS_STARTED = 1,
+    SAMPLE_STATUS_RUNNING = 2
+};
+
+/**
+ * Describes a sample, that is taken by a device's PMA itself (see IbPort::ArmHardwareSample()).
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+struct IbHardwareSampleConfig {
+    /**
+     * The delay between arming the sample and its start (in ticks, see IbHardwareSample::tick).
+     */
+    uint32_t sampleStart;
+
+    /**
+     * The duration of the sample (in ticks, see IbHardwareSample::tick).
+     */
+    uint32_t sampleInterval;
+
+    /**
+     * A value, that identifies the sample. It is returned with the results.
+     */
+    uint16_t tag;
+
+    /**
+     * The amount of counters, that are sampled (up to MAX_SAMPLE_COUNTERS).
+     */
+    uint8_t numCounters;
+
+    /**
+     * The counters, that are sampled.
+     */
+    IbSampleCounter counters[MAX_SAMPLE_COUNTERS];
+};
+
+/**
+ * The result of a sample, that has been taken by a device's PMA.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+struct IbHardwareSample {
+    /**
+     * The sample's tag, as it has been returned by the device.
+     */
+    uint16_t tag;
+
+    /**
+     * The device's sampling tick, as it is reported by PortSamplesControl. The duration of a tick is device-specific.
+     */
+    uint8_t tick;
+
+    /**
+     * The amount of bits of the device's sample counters.
+     */
+    uint8_t counterWidth;
+
+    /**
+     * Whether the sample has finished and the values are valid.
+     */
+    bool isComplete;
+
+    /**
+     * The sample's duration in ticks.
+     */
+    uint32_t sampleInterval;
+
+    /**
+     * The amount of counters, that have been sampled.
+     */
+    uint8_t numCounters;
+
+    /**
+     * The counters, that have been sampled.
+     */
+    IbSampleCounter counters[MAX_SAMPLE_COUNTERS];
+
+    /**
+     * The counters' increase during the sample. Data counters are given in the same unit as
+     * COUNTER_XMIT_DATA_BYTES and COUNTER_RCV_DATA_BYTES.
+     */
+    uint64_t values[MAX_SAMPLE_COUNTERS];
+};
+
+}
+
+#endif
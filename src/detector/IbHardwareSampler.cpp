@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include "IbHardwareSampler.h"
+#include "IbPort.h"
+#include "detector/exception/IbPerfException.h"
+
+namespace Detector {
+
+IbHardwareSampler::IbHardwareSampler(const IbHardwareSampleConfig &config, std::chrono::milliseconds timeout) :
+        m_config(config),
+        m_timeout(timeout),
+        m_errors() {
+
+}
+
+std::chrono::microseconds IbHardwareSampler::GetPollInterval(const std::vector<IbPort *> &ports,
+                                                             const std::vector<size_t> &pending) const {
+    std::chrono::nanoseconds duration(0);
+
+    for (size_t index : pending) {
+        const IbHardwareSample &sample = ports[index]->GetArmedHardwareSample();
+
+        // A tick lasts HARDWARE_SAMPLE_TICK_NS * 2^Tick nanoseconds. Larger exponents are clamped,
+        // since they would overflow and the samples are bounded by the timeout anyway.
+        uint64_t tickNs = static_cast<uint64_t>(HARDWARE_SAMPLE_TICK_NS) << std::min<uint8_t>(sample.tick, 24);
+        uint64_t numTicks = static_cast<uint64_t>(m_config.sampleStart) + m_config.sampleInterval;
+
+        duration = std::max(duration, std::chrono::nanoseconds(numTicks * tickNs));
+    }
+
+    return std::max(std::chrono::duration_cast<std::chrono::microseconds>(duration),
+                    std::chrono::microseconds(HARDWARE_SAMPLE_MIN_POLL_INTERVAL));
+}
+
+std::vector<IbHardwareSample> IbHardwareSampler::Sample(const std::vector<IbPort *> &ports) {
+    std::vector<IbHardwareSample> samples(ports.size(), IbHardwareSample{});
+    std::vector<bool> isDone(ports.size(), false);
+    size_t numRemaining = ports.size();
+
+    m_errors.clear();
+
+    auto addError = [&](size_t index, const std::string &message) {
+        std::ostringstream error;
+
+        error << "LID 0x" << std::hex << ports[index]->GetLid() << std::dec << ", port "
+              << unsigned(ports[index]->GetNum()) << ": " << message;
+        m_errors.push_back(error.str());
+        isDone[index] = true;
+        numRemaining--;
+    };
+
+    // Devices, whose sample has timed out. They may still be sampling, so arming another port would fail.
+    std::unordered_set<uint16_t> timedOutLids;
+
+    while (numRemaining > 0) {
+        std::unordered_set<uint16_t> busyLids;
+        std::vector<size_t> pending;
+
+        // Arm one port per device. All ports of a switch share the switch's LID.
+        for (size_t i = 0; i < ports.size(); i++) {
+            if (isDone[i]) {
+                continue;
+            }
+
+            if (timedOutLids.count(ports[i]->GetLid()) > 0) {
+                addError(i, "Skipped, since a previous sample on the device has not completed in time!");
+                continue;
+            }
+
+            if (!busyLids.insert(ports[i]->GetLid()).second) {
+                continue;
+            }
+
+            try {
+                ports[i]->ArmHardwareSample(m_config);
+                pending.push_back(i);
+            } catch (const IbPerfException &exception) {
+                addError(i, exception.what());
+            }
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + m_timeout;
+        auto pollInterval = GetPollInterval(ports, pending);
+
+        while (!pending.empty() && std::chrono::steady_clock::now() < deadline) {
+            // The last poll happens at the deadline, even if it is closer than a full interval.
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                    pollInterval, deadline - std::chrono::steady_clock::now()));
+
+            for (auto it = pending.begin(); it != pending.end();) {
+                try {
+                    if (!ports[*it]->CollectHardwareSample(samples[*it])) {
+                        it++;
+                        continue;
+                    }
+
+                    isDone[*it] = true;
+                    numRemaining--;
+                } catch (const IbPerfException &exception) {
+                    addError(*it, exception.what());
+                }
+
+                it = pending.erase(it);
+            }
+        }
+
+        for (size_t index : pending) {
+            timedOutLids.insert(ports[index]->GetLid());
+            addError(index, "Sample has not completed in time!");
+        }
+    }
+
+    return samples;
+}
+
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#ifndef DETECTOR_IBHARDWARESAMPLER_H
+#define DETECTOR_IBHARDWARESAMPLER_H
+
+#define HARDWARE_SAMPLE_MIN_POLL_INTERVAL 1000
+#define HARDWARE_SAMPLE_TICK_NS 5
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "IbHardwareSample.h"
+
+namespace Detector {
+
+class IbPort;
+
+/**
+ * Takes samples on a set of ports with the devices' own sampling mechanism (see IbPort::ArmHardwareSample()).
+ *
+ * The samples are armed on all devices at once, so that they cover roughly the same time. A device can only take
+ * one sample at a time, so if multiple ports of the same device (e.g. a switch) are given, they are sampled in
+ * rounds, one port per device and round. After arming a round, the results are polled once per expected sample
+ * duration (but at most every HARDWARE_SAMPLE_MIN_POLL_INTERVAL microseconds), until all samples are complete or
+ * the timeout has expired. A device, whose sample has timed out, may still be sampling, so its remaining ports are
+ * skipped for the rest of the call.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbHardwareSampler {
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param config The configuration of the samples, that are taken on every port
+     * @param timeout The maximum time to wait for the samples of a round, after they have been armed
+     */
+    IbHardwareSampler(const IbHardwareSampleConfig &config, std::chrono::milliseconds timeout);
+
+    /**
+     * Destructor.
+     */
+    ~IbHardwareSampler() = default;
+
+    /**
+     * Take a sample on every port and wait for the results.
+     * Errors do not abort the other ports. They are collected and can be retrieved via GetErrors().
+     *
+     * @param ports The ports
+     *
+     * @return The samples, in the same order as the ports. Samples of ports, that have failed, are not complete.
+     */
+    std::vector<IbHardwareSample> Sample(const std::vector<IbPort *> &ports);
+
+    /**
+     * Get the errors, that have occurred during the last call to Sample().
+     */
+    const std::vector<std::string> &GetErrors() const {
+        return m_errors;
+    }
+
+private:
+    /**
+     * Calculate, how long to wait between polling the results of a round.
+     * This is the time from arming to the end of the longest sample, but at least HARDWARE_SAMPLE_MIN_POLL_INTERVAL.
+     *
+     * @param ports The ports
+     * @param pending The indices of the ports, whose samples have been armed
+     */
+    std::chrono::microseconds GetPollInterval(const std::vector<IbPort *> &ports,
+                                              const std::vector<size_t> &pending) const;
+
+    /**
+     * The configuration of the samples.
+     */
+    IbHardwareSampleConfig m_config;
+
+    /**
+     * The maximum time to wait for the samples of a round.
+     */
+    std::chrono::milliseconds m_timeout;
+
+    /**
+     * The errors of the last call to Sample().
+     */
+    std::vector<std::string> m_errors;
+};
+
+}
+
+#endif
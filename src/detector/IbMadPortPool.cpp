@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IbMadPortPool.h"
+#include "detector/exception/IbMadException.h"
+
+namespace Detector {
+
+IbMadPortPool::IbMadPortPool(uint32_t maxPorts) :
+        m_maxPorts(maxPorts > 0 ? maxPorts : 1),
+        m_numOpenPorts(0) {
+
+}
+
+IbMadPortPool &IbMadPortPool::GetDefault() {
+    static IbMadPortPool pool(1);
+
+    return pool;
+}
+
+IbMadPortPool::~IbMadPortPool() {
+    for (ibmad_port *madPort : m_freePorts) {
+        mad_rpc_close_port(madPort);
+    }
+}
+
+ibmad_port *IbMadPortPool::Acquire() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_releaseCondition.wait(lock, [this] { return !m_freePorts.empty() || m_numOpenPorts < m_maxPorts; });
+
+    if (!m_freePorts.empty()) {
+        ibmad_port *madPort = m_freePorts.back();
+        m_freePorts.pop_back();
+
+        return madPort;
+    }
+
+    int mgmt_classes[3] = {IB_SMI_CLASS, IB_SA_CLASS, IB_PERFORMANCE_CLASS};
+
+    // Open a MAD-port. mad_rpc_open_port takes the following parameters:
+    //
+    // dev_name: The name of the local device from which all queries will be sent.
+    //           This seems to be optional, as passing a nullptr also works.
+    // dev_port: This seems to be number of the local port from which the all queries will be sent.
+    //           Passing a zero works fine. I guess, it then uses a default value.
+    // mgmt_classes: I guess, this array is used to declare the fields, that we want to access.
+    // num_classes: The amount of management-classes.
+    ibmad_port *madPort = mad_rpc_open_port(nullptr, 0, mgmt_classes, 3);
+
+    if (madPort == nullptr) {
+        throw IbMadException("MAD: Failed to open port! (mad_rpc_open_port failed)");
+    }
+
+    m_numOpenPorts++;
+
+    return madPort;
+}
+
+void IbMadPortPool::Release(ibmad_port *madPort) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_numOpenPorts > m_maxPorts) {
+            mad_rpc_close_port(madPort);
+            m_numOpenPorts--;
+        } else {
+            m_freePorts.push_back(madPort);
+        }
+    }
+
+    m_releaseCondition.notify_one();
+}
+
+void IbMadPortPool::SetMaxPorts(uint32_t maxPorts) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_maxPorts = maxPorts > 0 ? maxPorts : 1;
+
+        while (m_numOpenPorts > m_maxPorts && !m_freePorts.empty()) {
+            mad_rpc_close_port(m_freePorts.back());
+            m_freePorts.pop_back();
+            m_numOpenPorts--;
+        }
+    }
+
+    m_releaseCondition.notify_all();
+}
+
+uint32_t IbMadPortPool::GetNumOpenPorts() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_numOpenPorts;
+}
+
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBMADPORTPOOL_H
+#define DETECTOR_IBMADPORTPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <infiniband/mad.h>
+
+namespace Detector {
+
+/**
+ * A pool of MAD-ports, that is shared by all ports of a fabric.
+ *
+ * Opening a MAD-port allocates a umad file descriptor and registers the management classes with the kernel.
+ * Instead of doing this once per IbPort, ports borrow a MAD-port from the pool for the duration of a query.
+ * MAD-ports are opened lazily, up to a configurable maximum. If all of them are in use, Acquire() blocks,
+ * until another thread releases one. This way, the amount of file descriptors only depends on the amount of
+ * threads, that query the fabric concurrently, and not on the size of the fabric.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbMadPortPool {
+
+public:
+    /**
+     * Borrows a MAD-port from a pool and gives it back, when it goes out of scope.
+     */
+    class Lease {
+
+    public:
+        /**
+         * Constructor.
+         *
+         * @param pool The pool to borrow the MAD-port from
+         */
+        explicit Lease(IbMadPortPool &pool) :
+                m_pool(pool),
+                m_madPort(pool.Acquire()) {
+
+        }
+
+        /**
+         * Destructor.
+         */
+        ~Lease() {
+            m_pool.Release(m_madPort);
+        }
+
+        Lease(const Lease &copy) = delete;
+
+        Lease &operator=(const Lease &copy) = delete;
+
+        /**
+         * Get the borrowed MAD-port.
+         */
+        ibmad_port *Get() const {
+            return m_madPort;
+        }
+
+    private:
+
+        IbMadPortPool &m_pool;
+
+        ibmad_port *m_madPort;
+    };
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param maxPorts The maximum amount of MAD-ports, that may be open at the same time (0 is treated as 1)
+     */
+    explicit IbMadPortPool(uint32_t maxPorts = 1);
+
+    /**
+     * Destructor.
+     *
+     * Closes all MAD-ports. All leases must have been returned before.
+     */
+    ~IbMadPortPool();
+
+    IbMadPortPool(const IbMadPortPool &copy) = delete;
+
+    IbMadPortPool &operator=(const IbMadPortPool &copy) = delete;
+
+    /**
+     * Get the pool, that is used by ports and nodes, which have been created without a pool of their own.
+     * It is created on first use and opens at most one MAD-port.
+     */
+    static IbMadPortPool &GetDefault();
+
+    /**
+     * Borrow a MAD-port. If no MAD-port is available and the maximum amount of ports is already open,
+     * this function blocks until another thread releases a MAD-port.
+     *
+     * Prefer using a Lease instead of calling this function directly.
+     *
+     * @return The MAD-port
+     */
+    ibmad_port *Acquire();
+
+    /**
+     * Give a borrowed MAD-port back to the pool.
+     *
+     * @param madPort The MAD-port
+     */
+    void Release(ibmad_port *madPort);
+
+    /**
+     * Set the maximum amount of MAD-ports, that may be open at the same time.
+     * Surplus MAD-ports are closed, as soon as they are not in use anymore.
+     *
+     * @param maxPorts The maximum amount of MAD-ports (0 is treated as 1)
+     */
+    void SetMaxPorts(uint32_t maxPorts);
+
+    /**
+     * Get the amount of currently open MAD-ports.
+     */
+    uint32_t GetNumOpenPorts();
+
+private:
+    /**
+     * Protects all of the following members.
+     */
+    std::mutex m_mutex;
+
+    /**
+     * Used to wake up threads, that are waiting for a MAD-port.
+     */
+    std::condition_variable m_releaseCondition;
+
+    /**
+     * The maximum amount of MAD-ports, that may be open at the same time.
+     */
+    uint32_t m_maxPorts;
+
+    /**
+     * The amount of currently open MAD-ports (borrowed and free ones).
+     */
+    uint32_t m_numOpenPorts;
+
+    /**
+     * All open MAD-ports, that are currently not borrowed.
+     */
+    std::vector<ibmad_port *> m_freePorts;
+};
+
+}
+
+#endif
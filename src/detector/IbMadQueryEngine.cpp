@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IbMadQueryEngine.h"
+#include "IbSampler.h"
+#include "detector/exception/IbMadException.h"
+
+namespace Detector {
+
+IbMadQueryEngine::IbMadQueryEngine(IbMadPortPool &madPortPool, uint32_t windowSize, uint32_t timeout,
+                                   uint32_t retries) :
+        m_windowSize(windowSize > 0 ? windowSize : 1),
+        m_timeout(timeout),
+        m_retries(retries),
+        m_madPortPool(madPortPool),
+        m_umadFd(-1),
+        m_umadAgent(-1),
+        m_sendBuf(umad_size() + IB_MAD_SIZE),
+        m_rcvBuf(umad_size() + IB_MAD_SIZE),
+        m_nextTransactionId(1) {
+
+}
+
+void IbMadQueryEngine::RefreshCounters(IbPort *const *ports, size_t numPorts) {
+    size_t numFailed = 0;
+    size_t numUninitialized = 0;
+
+    // Lazily created ports need their capability masks, before their queries can be built. This must happen before
+    // the engine borrows its MAD-port, since the ports borrow their own one from the same pool.
+    for (size_t i = 0; i < numPorts; i++) {
+        if (!ports[i]->IsInitialized()) {
+            try {
+                ports[i]->Initialize();
+            } catch (const IbMadException &exception) {
+                numUninitialized++;
+            }
+        }
+    }
+
+    // Instead of using mad_rpc(), we use the borrowed MAD-port's umad file descriptor and agent directly.
+    IbMadPortPool::Lease madPort(m_madPortPool);
+
+    m_umadFd = mad_rpc_portid(madPort.Get());
+    m_umadAgent = mad_rpc_class_agent(madPort.Get(), IB_PERFORMANCE_CLASS);
+
+    if (m_umadFd < 0 || m_umadAgent < 0) {
+        throw IbMadException("MAD: Failed to get umad agent for the performance class!");
+    }
+
+    std::vector<Query> queries;
+    queries.reserve(numPorts * 2);
+
+    // Each port needs exactly the queries from its query plan.
+    for (size_t i = 0; i < numPorts; i++) {
+        for (size_t step = 0; step < ports[i]->m_queryPlan.size(); step++) {
+            queries.push_back({ports[i], static_cast<uint8_t>(step), 0});
+        }
+    }
+
+    size_t nextQuery = 0;
+
+    m_outstanding.clear();
+
+    // Keep the window filled, until all queries have been sent, and then wait for the remaining responses.
+    while (nextQuery < queries.size() || !m_outstanding.empty()) {
+        while (nextQuery < queries.size() && m_outstanding.size() < m_windowSize) {
+            try {
+                Send(queries[nextQuery], m_nextTransactionId++);
+            } catch (const IbMadException &exception) {
+                numFailed++;
+            }
+
+            nextQuery++;
+        }
+
+        if (!m_outstanding.empty()) {
+            numFailed += Receive();
+        }
+    }
+
+    // Ports, whose queries have failed, publish their old values again. Their history ignores them.
+    for (size_t i = 0; i < numPorts; i++) {
+        ports[i]->PublishSnapshot();
+    }
+
+    if (numUninitialized > 0) {
+        throw IbMadException("Failed to initialize " + std::to_string(numUninitialized) + " ports! (" +
+                             std::to_string(numFailed) + " of " + std::to_string(queries.size()) +
+                             " queries failed)");
+    }
+
+    if (numFailed > 0) {
+        throw IbMadException("Failed to query performance counters! (" + std::to_string(numFailed) + " of " +
+                             std::to_string(queries.size()) + " queries failed)");
+    }
+}
+
+void IbMadQueryEngine::Send(const Query &query, uint32_t transactionId) {
+    ib_rpc_t rpc{};
+    uint8_t data[IB_PC_DATA_SZ]{};
+    ib_portid_t portId = query.port->m_portId;
+
+    // Build the same request as pma_query_via() does: A GET for the given attribute,
+    // with the port number encoded in the PortSelect-field of the data.
+    rpc.mgtclass = IB_PERFORMANCE_CLASS;
+    rpc.method = IB_MAD_METHOD_GET;
+    rpc.attr.id = query.port->m_queryPlan[query.step].attributeId;
+    rpc.attr.mod = 0;
+    rpc.timeout = m_timeout;
+    rpc.datasz = IB_PC_DATA_SZ;
+    rpc.dataoffs = IB_PC_DATA_OFFS;
+    rpc.trid = transactionId;
+
+    mad_set_field(data, 0, IB_PC_PORT_SELECT_F, query.port->m_portNum);
+
+    if (portId.qp == 0) {
+        portId.qp = 1;
+    }
+
+    if (portId.qkey == 0) {
+        portId.qkey = IB_DEFAULT_QP1_QKEY;
+    }
+
+    int length = mad_build_pkt(m_sendBuf.data(), &rpc, &portId, nullptr, data);
+
+    if (length < 0) {
+        throw IbMadException("Failed to build query packet! (mad_build_pkt failed)");
+    }
+
+    // The kernel takes care of the timeout and resends the packet up to m_retries times.
+    // If no response arrives, the packet is returned via umad_recv() with a non-zero status.
+    uint64_t sendTime = IbSampler::GetMonotonicTime();
+
+    if (umad_send(m_umadFd, m_umadAgent, m_sendBuf.data(), length, m_timeout, m_retries) < 0) {
+        throw IbMadException("Failed to send query! (umad_send failed)");
+    }
+
+    m_outstanding[transactionId] = {query.port, query.step, sendTime};
+
+    // The first step of a port is always sent before its other steps,
+    // so this is the right time to keep the port's previous values.
+    if (query.step == 0) {
+        query.port->SaveSnapshot();
+    }
+}
+
+size_t IbMadQueryEngine::Receive() {
+    int length = IB_MAD_SIZE;
+
+    // The kernel reports a timeout after (m_retries + 1) * m_timeout, so we should never have to wait much longer.
+    int ret = umad_recv(m_umadFd, m_rcvBuf.data(), &length,
+                        static_cast<int>((m_retries + 2) * m_timeout));
+
+    if (ret < 0) {
+        // Nothing arrived in time. We cannot match this to a specific query, so we give up on all outstanding ones.
+        size_t numFailed = m_outstanding.size();
+        m_outstanding.clear();
+
+        return numFailed;
+    }
+
+    auto *mad = static_cast<uint8_t *>(umad_get_mad(m_rcvBuf.data()));
+    auto transactionId = static_cast<uint32_t>(mad_get_field64(mad, 0, IB_MAD_TRID_F) & 0xffffffffULL);
+
+    auto iterator = m_outstanding.find(transactionId);
+
+    if (iterator == m_outstanding.end()) {
+        // A late response to a query, that has already been given up on.
+        return 0;
+    }
+
+    Query query = iterator->second;
+    m_outstanding.erase(iterator);
+
+    // A non-zero umad status means, that the query has timed out. A non-zero MAD status means, that the PMA
+    // could not process the query.
+    if (umad_status(m_rcvBuf.data()) != 0 || mad_get_field(mad, 0, IB_MAD_STATUS_F) != 0) {
+        return 1;
+    }
+
+    query.port->DecodeResponse(query.port->m_queryPlan[query.step], mad + IB_PC_DATA_OFFS, *query.port);
+
+    // Like IbPort::ExecuteQueryPlan(), the values are timestamped with the middle of the first query's round trip.
+    if (query.step == 0) {
+        query.port->m_timestamp = query.sendTime + (IbSampler::GetMonotonicTime() - query.sendTime) / 2;
+    }
+
+    return 0;
+}
+
+}
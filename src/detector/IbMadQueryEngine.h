@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBMADQUERYENGINE_H
+#define DETECTOR_IBMADQUERYENGINE_H
+
+#define DEFAULT_QUERY_WINDOW 16
+#define ASYNC_QUERY_TIMEOUT 1000
+#define ASYNC_QUERY_RETRIES 2
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <infiniband/mad.h>
+#include <infiniband/umad.h>
+#include "IbMadPortPool.h"
+#include "IbPort.h"
+
+namespace Detector {
+
+/**
+ * Queries the performance counters of many ports at once, by keeping multiple PMA-queries in flight.
+ *
+ * pma_query_via() blocks until the response has arrived, so only a single MAD can be outstanding per thread.
+ * This engine instead sends the queries directly via umad_send() and keeps up to windowSize of them outstanding.
+ * The responses are matched to their requests by their transaction id and decoded into the respective IbPort.
+ * Timeouts and retries are handled by the kernel's MAD-layer.
+ *
+ * For the duration of RefreshCounters(), the engine borrows a MAD-port from a pool and uses its umad file descriptor
+ * exclusively. An engine must only be used by one thread at a time.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbMadQueryEngine {
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param madPortPool The pool, from which the engine borrows its MAD-port
+     * @param windowSize The maximum amount of outstanding queries
+     * @param timeout The time in milliseconds to wait for a single response
+     * @param retries The amount of times, a query is resent after a timeout
+     */
+    explicit IbMadQueryEngine(IbMadPortPool &madPortPool, uint32_t windowSize = DEFAULT_QUERY_WINDOW,
+                              uint32_t timeout = ASYNC_QUERY_TIMEOUT, uint32_t retries = ASYNC_QUERY_RETRIES);
+
+    /**
+     * Destructor.
+     */
+    ~IbMadQueryEngine() = default;
+
+    IbMadQueryEngine(const IbMadQueryEngine &copy) = delete;
+
+    IbMadQueryEngine &operator=(const IbMadQueryEngine &copy) = delete;
+
+    /**
+     * Refresh the counters of the given ports.
+     *
+     * All ports are processed, even if some of them do not respond.
+     * Ports, that have not been initialized yet (see IbPort::Initialize()), are initialized first.
+     * An IbMadException is thrown afterwards, if at least one query has failed.
+     *
+     * @param ports Pointer to the first port
+     * @param numPorts The amount of ports
+     */
+    void RefreshCounters(IbPort *const *ports, size_t numPorts);
+
+    /**
+     * Get the maximum amount of outstanding queries.
+     */
+    uint32_t GetWindowSize() const {
+        return m_windowSize;
+    }
+
+private:
+    /**
+     * A single query for one step of a port's query plan.
+     */
+    struct Query {
+        IbPort *port;
+        uint8_t step;
+        uint64_t sendTime;
+    };
+
+    /**
+     * Send a query.
+     *
+     * @param query The query
+     * @param transactionId The transaction id, that is used to match the response to the query
+     */
+    void Send(const Query &query, uint32_t transactionId);
+
+    /**
+     * Wait for a single response and decode it.
+     *
+     * @return The amount of queries, that have failed (1 for an error response,
+     *         all outstanding queries if no response could be received at all)
+     */
+    size_t Receive();
+
+private:
+    /**
+     * The maximum amount of outstanding queries.
+     */
+    uint32_t m_windowSize;
+
+    /**
+     * The time in milliseconds to wait for a single response.
+     */
+    uint32_t m_timeout;
+
+    /**
+     * The amount of times, a query is resent after a timeout.
+     */
+    uint32_t m_retries;
+
+    /**
+     * The pool, from which the engine borrows its MAD-port.
+     */
+    IbMadPortPool &m_madPortPool;
+
+    /**
+     * The umad file descriptor and agent id of the currently borrowed MAD-port.
+     */
+    int m_umadFd;
+    int m_umadAgent;
+
+    /**
+     * Buffers for a single umad-packet. umad_send() copies the packet to the kernel,
+     * so the send buffer can be reused as soon as it returns.
+     */
+    std::vector<uint8_t> m_sendBuf;
+    std::vector<uint8_t> m_rcvBuf;
+
+    /**
+     * The next transaction id.
+     */
+    uint32_t m_nextTransactionId;
+
+    /**
+     * All outstanding queries, indexed by the lower 32 bits of their transaction id.
+     */
+    std::unordered_map<uint32_t, Query> m_outstanding;
+};
+
+}
+
+#endif
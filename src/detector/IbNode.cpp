@@ -18,25 +18,40 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 
+#include <algorithm>
+#include "IbCounterKernels.h"
 #include "IbNode.h"
 #include "IbPortCompat.h"
+#include "IbTopologyCache.h"
+#include "detector/exception/IbMadException.h"
 
 namespace Detector {
 
-IbNode::IbNode(ibv_device *device, bool compat) : IbPerfCounter(),
-                                                   m_guid(0),
-                                                   m_numPorts(0) {
+IbNode::IbNode(ibv_device *device, bool compat) :
+        IbNode(device, compat, IbMadPortPool::GetDefault()) {
+
+}
+
+IbNode::IbNode(ibv_device *device, bool compat, IbMadPortPool &madPortPool) :
+        IbPerfCounter(),
+        m_guid(0),
+        m_numPorts(0),
+        m_nodeType(IB_NODE_CA),
+        m_isAllPortSelectSupported(false),
+        m_isAggregatedFromPorts(true) {
     m_desc = ibv_get_device_name(device);
 
-    ibv_context *context = ibv_open_device(device);
+    // The context is closed, when the constructor is left, regardless of whether it succeeds or throws.
+    std::unique_ptr<ibv_context, int (*)(ibv_context *)> context(ibv_open_device(device), &ibv_close_device);
+    std::vector<std::unique_ptr<IbPort>> ports;
 
-    if (device == nullptr) {
+    if (context == nullptr) {
         throw IbVerbsException("Unable to open context for device '" + m_desc + "'! Error: "+ strerror(errno));
     }
 
     ibv_device_attr attr{};
 
-    int ret = ibv_query_device(context, &attr);
+    int ret = ibv_query_device(context.get(), &attr);
 
     if(ret != 0) {
         throw IbVerbsException("Unable to query device attributes from '" + m_desc + "'! Error: " + strerror(ret));
@@ -48,39 +63,83 @@ IbNode::IbNode(ibv_device *device, bool compat) : IbPerfCounter(),
     // Iterate over all of the node's ports and create an instance of IbPortCompat for each one.
     for (uint8_t i = 0; i < m_numPorts; i++) {
         ibv_port_attr portAttributes{};
-        ret = ibv_query_port(context, static_cast<uint8_t>(i + 1), &portAttributes);
+        ret = ibv_query_port(context.get(), static_cast<uint8_t>(i + 1), &portAttributes);
 
         if(ret != 0) {
             throw IbVerbsException("Unable to query port attributes of '" + m_desc +
                                     + ", port " + std::to_string(i) + "'! Error: " + std::string(strerror(ret)));
         }
 
-        IbPort *port;
-
         if(compat) {
-            port = new IbPortCompat(m_desc, portAttributes, static_cast<uint8_t>(i + 1));
+            ports.emplace_back(new IbPortCompat(m_desc, portAttributes, static_cast<uint8_t>(i + 1)));
         } else {
-            port = new IbPort(portAttributes.lid, static_cast<uint8_t>(i + 1));
+            ports.emplace_back(new IbPort(portAttributes.lid, static_cast<uint8_t>(i + 1), madPortPool));
         }
-
-        m_ports.push_back(port);
     }
 
-    ibv_close_device(context);
+    AdoptPorts(ports);
+}
+
+IbNode::IbNode(ibnd_node_t *node) :
+        IbNode(node, IbMadPortPool::GetDefault(), false) {
+
 }
 
-IbNode::IbNode(ibnd_node_t *node) : IbPerfCounter(),
-                                    m_desc(node->nodedesc),
-                                    m_guid(node->guid),
-                                    m_numPorts(static_cast<uint8_t>(node->numports)) {
+IbNode::IbNode(ibnd_node_t *node, IbMadPortPool &madPortPool) :
+        IbNode(node, madPortPool, false) {
+
+}
+
+IbNode::IbNode(ibnd_node_t *node, IbMadPortPool &madPortPool, bool lazy) :
+        IbPerfCounter(),
+        m_desc(node->nodedesc),
+        m_guid(node->guid),
+        m_numPorts(static_cast<uint8_t>(node->numports)),
+        m_nodeType(node->type),
+        m_isAllPortSelectSupported(false),
+        m_isAggregatedFromPorts(true) {
+    std::vector<std::unique_ptr<IbPort>> ports;
+
     // Iterate over all of the node's ports and create an instance of IbPort for each one.
     for (uint8_t i = 0; i < m_numPorts; i++) {
         ibnd_port *currentPort = node->ports[i + 1];
 
-        if (currentPort != nullptr) {
-            m_ports.push_back(new IbPort(currentPort->base_lid, static_cast<uint8_t>(currentPort->portnum)));
+        if (currentPort == nullptr) {
+            continue;
+        }
+
+        if (lazy) {
+            ports.emplace_back(new IbPort(currentPort, madPortPool));
+        } else {
+            ports.emplace_back(new IbPort(currentPort->base_lid, static_cast<uint8_t>(currentPort->portnum),
+                                          madPortPool));
+            ports.back()->UpdateRemotePort(currentPort);
         }
     }
+
+    AdoptPorts(ports);
+    CheckAllPortSelect(node->type);
+}
+
+IbNode::IbNode(const IbTopologyCache &cache, uint32_t index, IbMadPortPool &madPortPool) :
+        IbPerfCounter(),
+        m_guid(cache.GetNode(index).guid),
+        m_numPorts(cache.GetNode(index).numPorts),
+        m_nodeType(cache.GetNode(index).nodeType),
+        m_isAllPortSelectSupported(false),
+        m_isAggregatedFromPorts(true) {
+    const IbTopologyCache::NodeRecord &node = cache.GetNode(index);
+
+    m_desc = std::string(node.description, strnlen(node.description, TOPOLOGY_CACHE_DESC_SIZE));
+
+    std::vector<std::unique_ptr<IbPort>> ports;
+
+    for (uint32_t i = 0; i < node.numPortRecords; i++) {
+        ports.emplace_back(new IbPort(cache.GetPortCapabilities(node, i), madPortPool));
+    }
+
+    AdoptPorts(ports);
+    CheckAllPortSelect(node.nodeType);
 }
 
 IbNode::~IbNode() {
@@ -89,44 +148,245 @@ IbNode::~IbNode() {
     }
 }
 
+void IbNode::AdoptPorts(std::vector<std::unique_ptr<IbPort>> &ports) {
+    // Reserve first, so that no port is released, before all of them fit into m_ports.
+    m_ports.reserve(m_ports.size() + ports.size());
+
+    for (std::unique_ptr<IbPort> &port : ports) {
+        m_ports.push_back(port.release());
+    }
+
+    ports.clear();
+}
+
+IbNode::PortChanges IbNode::UpdatePorts(ibnd_node_t *node, IbMadPortPool &madPortPool, bool lazy) {
+    PortChanges changes{};
+    std::vector<IbPort *> ports;
+
+    m_desc = node->nodedesc;
+    m_numPorts = static_cast<uint8_t>(node->numports);
+
+    for (uint8_t i = 0; i < m_numPorts; i++) {
+        ibnd_port *currentPort = node->ports[i + 1];
+
+        if (currentPort == nullptr) {
+            continue;
+        }
+
+        auto portNum = static_cast<uint8_t>(currentPort->portnum);
+        auto existing = std::find_if(m_ports.begin(), m_ports.end(),
+                                     [portNum](IbPort *port) { return port->GetNum() == portNum; });
+
+        if (existing != m_ports.end() && (*existing)->GetLid() == currentPort->base_lid) {
+            // The port may have been recabled, while keeping its LID.
+            (*existing)->UpdateRemotePort(currentPort);
+            ports.push_back(*existing);
+            m_ports.erase(existing);
+            continue;
+        }
+
+        try {
+            if (lazy) {
+                ports.push_back(new IbPort(currentPort, madPortPool));
+            } else {
+                ports.push_back(new IbPort(currentPort->base_lid, portNum, madPortPool));
+                ports.back()->UpdateRemotePort(currentPort);
+            }
+
+            changes.numAdded++;
+        } catch (const IbMadException &exception) {
+            changes.numFailed++;
+        }
+    }
+
+    // All ports, that are left, have vanished or changed their LID.
+    for (IbPort *port : m_ports) {
+        delete port;
+        changes.numRemoved++;
+    }
+
+    m_ports = ports;
+
+    // The sum over the new set of ports can not be compared with the old one, so the next refresh yields no rates
+    // and deltas for this node.
+    if (changes.numAdded > 0 || changes.numRemoved > 0) {
+        ResetSnapshots();
+    }
+
+    CheckAllPortSelect(node->type);
+
+    return changes;
+}
+
+void IbNode::CheckAllPortSelect(int nodeType) {
+    m_nodeType = nodeType;
+    m_isAllPortSelectSupported = false;
+
+    // AllPortSelect is only useful on switches, since an HCA's ports are queried via their own LIDs anyway.
+    // The device sums up all of its physical ports, so the query is only used, if every one of them is known to us.
+    // Otherwise, the aggregated values would cover other ports than the ones, that we check and refresh ourselves.
+    if (nodeType == IB_NODE_SWITCH && !m_ports.empty() && m_ports.size() == m_numPorts &&
+        m_ports[0]->IsInitialized()) {
+        m_isAllPortSelectSupported = true;
+
+        for (IbPort *port : m_ports) {
+            if ((port->IsInitialized() && !port->IsAllPortSelectSupported()) ||
+                port->GetLinkWidth() != m_ports[0]->GetLinkWidth()) {
+                m_isAllPortSelectSupported = false;
+                break;
+            }
+        }
+    }
+}
+
+void IbNode::UpdateCapabilities() {
+    CheckAllPortSelect(m_nodeType);
+}
+
 void IbNode::ResetCounters() {
+    // Values aggregated from the ports are relative to the ports' baselines already.
+    // Only values queried via AllPortSelect need a baseline of their own.
+    if (!m_isBaselineReset) {
+        ClearBaselines();
+    } else {
+        for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+            auto id = static_cast<IbCounterId>(i);
+
+            // Counters, that are not selected, are not refreshed and hold stale values.
+            // The values have been queried via the first port (see RefreshAggregateCounters()),
+            // so per-lane counters have been multiplied by its link width.
+            if (!m_isAggregatedFromPorts && m_timestamp != 0 && IsCounterSelected(id)) {
+                AdvanceBaseline(id, m_ports[0]->GetLinkWidth());
+            } else {
+                SetBaselinePending(id);
+            }
+        }
+    }
+
     ResetVariables();
+    ResetSnapshots();
 
     for (IbPort *port : m_ports) {
         port->ResetCounters();
     }
 }
 
-void IbNode::RefreshCounters() {
-    ResetVariables();
+void IbNode::SetBaselineReset(bool enabled) {
+    IbPerfCounter::SetBaselineReset(enabled);
 
+    for (IbPort *port : m_ports) {
+        port->SetBaselineReset(enabled);
+    }
+}
+
+void IbNode::SetCounterMask(uint32_t mask) {
+    IbPerfCounter::SetCounterMask(mask);
+
+    for (IbPort *port : m_ports) {
+        port->SetCounterMask(mask);
+    }
+}
+
+void IbNode::RefreshCounters() {
     for (IbPort *port : m_ports) {
         port->RefreshCounters();
+    }
+
+    AggregateCounters();
+}
+
+void IbNode::RefreshAggregateCounters() {
+    // Lazily created switches do not know yet, whether they support AllPortSelect.
+    if (m_nodeType == IB_NODE_SWITCH && !m_ports.empty() && !m_ports[0]->IsInitialized()) {
+        m_ports[0]->Initialize();
+        CheckAllPortSelect(m_nodeType);
+    }
+
+    // Ports from a topology cache query their capabilities again, before AllPortSelect is relied on.
+    if (std::any_of(m_ports.begin(), m_ports.end(), [](IbPort *port) { return !port->IsVerified(); })) {
+        size_t numUnverified = 0;
+
+        for (IbPort *port : m_ports) {
+            if (!port->TryVerify()) {
+                numUnverified++;
+            }
+        }
+
+        CheckAllPortSelect(m_nodeType);
+
+        if (numUnverified > 0) {
+            throw IbMadException("Failed to verify the capabilities of " + std::to_string(numUnverified) +
+                                 " ports!");
+        }
+    }
 
-        m_xmitDataBytes += port->GetXmitDataBytes();
-        m_rcvDataBytes += port->GetRcvDataBytes();
-        m_xmitPkts += port->GetXmitPkts();
-        m_rcvPkts += port->GetRcvPkts();
-
-        m_unicastXmitPkts += port->GetUnicastXmitPkts();
-        m_unicastRcvPkts += port->GetUnicastRcvPkts();
-        m_multicastXmitPkts += port->GetMulticastXmitPkts();
-        m_multicastRcvPkts += port->GetMulticastRcvPkts();
-
-        m_symbolErrors += port->GetSymbolErrors();
-        m_linkDowned += port->GetLinkDownedCounter();
-        m_linkRecoveries += port->GetLinkRecoveryCounter();
-        m_rcvErrors += port->GetRcvErrors();
-        m_rcvRemotePhysicalErrors += port->GetRcvRemotePhysicalErrors();
-        m_rcvSwitchRelayErrors += port->GetRcvSwitchRelayErrors();
-        m_xmitDiscards += port->GetXmitDiscards();
-        m_xmitConstraintErrors += port->GetXmitConstraintErrors();
-        m_rcvConstraintErrors += port->GetRcvConstraintErrors();
-        m_localLinkIntegrityErrors += port->GetLocalLinkIntegrityErrors();
-        m_excessiveBufferOverrunErrors += port->GetExcessiveBufferOverrunErrors();
-        m_vl15Dropped += port->GetVL15Dropped();
-        m_xmitWait += port->GetXmitWait();
+    if (m_isAllPortSelectSupported) {
+        // All ports of a switch share the same LID, so it does not matter, which port we use to send the query.
+        m_ports[0]->RefreshAllPortCounters(*this);
+        m_isAggregatedFromPorts = false;
+    } else {
+        RefreshCounters();
     }
 }
 
+void IbNode::AggregateCounters() {
+    // Sum up into a local snapshot first, so that the counter variables never hold partial sums.
+    IbPerfSnapshot sum{};
+
+    for (IbPort *port : m_ports) {
+        IbPerfSnapshot snapshot = port->GetSnapshot();
+
+        sum.timestamp = std::max(sum.timestamp, snapshot.timestamp);
+        IbCounterKernels::Add(sum.values, snapshot.values, NUM_COUNTERS);
+    }
+
+    SaveSnapshot();
+    SetCounters(sum);
+
+    m_isAggregatedFromPorts = true;
+
+    PublishSnapshot();
+}
+
+void IbNode::AggregateCounters(const IbCounterTable &portTable, size_t firstRow) {
+    IbPerfSnapshot sum{};
+
+    for (IbPort *port : m_ports) {
+        sum.timestamp = std::max(sum.timestamp, port->GetTimestamp());
+    }
+
+    // The node's ports occupy consecutive rows, so each counter is summed up over a contiguous part of its column.
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        sum.values[i] = IbCounterKernels::Sum(portTable.GetColumn(static_cast<IbCounterId>(i)) + firstRow,
+                                              m_ports.size());
+    }
+
+    SaveSnapshot();
+    SetCounters(sum);
+
+    m_isAggregatedFromPorts = true;
+
+    PublishSnapshot();
+}
+
+IbPerfRates IbNode::GetRates() const {
+    if (!m_isAggregatedFromPorts) {
+        return IbPerfCounter::GetRates();
+    }
+
+    IbPerfRates rates{};
+
+    for (const IbPort *port : m_ports) {
+        IbPerfRates portRates = port->GetRates();
+
+        rates.interval = std::max(rates.interval, portRates.interval);
+
+        for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+            rates.values[i] += portRates.values[i];
+        }
+    }
+
+    return rates;
+}
+
 }
\ No newline at end of file
@@ -21,12 +21,16 @@
 
 #include <cstdint>
 #include <ibnetdisc.h>
+#include <memory>
 #include <verbs.h>
 #include <vector>
+#include "IbCounterTable.h"
 #include "IbPort.h"
 
 namespace Detector {
 
+class IbTopologyCache;
+
 /**
  * Represents a node in an InfiniBand-fabric (e.g. a Switch or an HCA).
  * The performance counters are aggregated over all of the node's ports.
@@ -40,26 +44,110 @@ public:
     /**
      * Constructor.
      *
+     * The node's ports borrow their MAD-ports from the default pool (see IbMadPortPool::GetDefault()).
+     *
      * @param node Pointer to an ibnd_node-struct, that has been initialized by the ibnetdisc-library.
      */
     explicit IbNode(ibnd_node_t *node);
 
+    /**
+     * Constructor.
+     *
+     * @param node Pointer to an ibnd_node-struct, that has been initialized by the ibnetdisc-library.
+     * @param madPortPool The pool, from which the node's ports borrow their MAD-ports
+     */
+    IbNode(ibnd_node_t *node, IbMadPortPool &madPortPool);
+
+    /**
+     * Constructor.
+     *
+     * If lazy is set to true, the ports are created from the data, that the ibnetdisc-library has gathered,
+     * without sending any MADs. Each port queries its capabilities with its first refresh (see IbPort::Initialize()).
+     *
+     * @param node Pointer to an ibnd_node-struct, that has been initialized by the ibnetdisc-library.
+     * @param madPortPool The pool, from which the node's ports borrow their MAD-ports
+     * @param lazy Set to true, to defer the ports' capability queries until they are refreshed
+     */
+    IbNode(ibnd_node_t *node, IbMadPortPool &madPortPool, bool lazy);
+
     /**
      * Compatibility constructor.
      *
      * Initializes an instance of IbNode with information from an ibverbs-context instead of an ibnd_node-struct.
-     * Uses IbPortCompat instead of IbPort, when compatibility is set to true.
+     * Uses IbPortCompat instead of IbPort, when compatibility is set to true. Otherwise, the node's ports borrow
+     * their MAD-ports from the default pool (see IbMadPortPool::GetDefault()).
      *
      * @param device The device context to use for this node.
      * @param compatibility Whether to use IbPortCompat or IbPort
      */
     explicit IbNode(ibv_device *device, bool compatibility);
 
+    /**
+     * Compatibility constructor.
+     *
+     * Initializes an instance of IbNode with information from an ibverbs-context instead of an ibnd_node-struct.
+     * Uses IbPortCompat instead of IbPort, when compatibility is set to true.
+     *
+     * @param device The device context to use for this node.
+     * @param compatibility Whether to use IbPortCompat or IbPort
+     * @param madPortPool The pool, from which the node's ports borrow their MAD-ports (unused in compatibility mode)
+     */
+    IbNode(ibv_device *device, bool compatibility, IbMadPortPool &madPortPool);
+
+    /**
+     * Cache constructor.
+     *
+     * Initializes an instance of IbNode with a node from a topology cache. No MADs are sent (see IbPort::Capabilities).
+     *
+     * @param cache The topology cache
+     * @param index The node's index in the cache
+     * @param madPortPool The pool, from which the node's ports borrow their MAD-ports
+     */
+    IbNode(const IbTopologyCache &cache, uint32_t index, IbMadPortPool &madPortPool);
+
+    /**
+     * The changes of the node's ports, that have been made by UpdatePorts().
+     */
+    struct PortChanges {
+        /**
+         * The amount of ports, that have been created.
+         */
+        uint32_t numAdded;
+
+        /**
+         * The amount of ports, that have been deleted.
+         */
+        uint32_t numRemoved;
+
+        /**
+         * The amount of ports, that could not be created (e.g. because they did not answer the setup queries).
+         */
+        uint32_t numFailed;
+    };
+
     /**
      * Destructor.
      */
     ~IbNode() override;
 
+    /**
+     * Bring the node's ports up to date with a newly discovered version of the node.
+     *
+     * Ports, whose number and LID are unchanged, are kept with all of their counters, baselines and history.
+     * Ports, that have vanished or whose LID has changed, are deleted, and new ports are created.
+     * A port, that can not be created, is left out. If the set of ports has changed, the node's next refresh
+     * yields no rates or deltas, since its sums can not be compared with the previous ones.
+     *
+     * CAUTION: Pointers to deleted ports become invalid.
+     *
+     * @param node Pointer to the ibnd_node-struct, that describes the node now
+     * @param madPortPool The pool, from which new ports borrow their MAD-ports
+     * @param lazy Set to true, to create new ports without sending any MADs (see IbPort::Initialize())
+     *
+     * @return The changes, that have been made
+     */
+    PortChanges UpdatePorts(ibnd_node_t *node, IbMadPortPool &madPortPool, bool lazy);
+
     /**
      * Overriding function from IbPerfCounter.
      *
@@ -68,6 +156,13 @@ public:
      */
     void ResetCounters() override;
 
+    /**
+     * Overriding function from IbPerfCounter.
+     *
+     * The setting is applied to the node and all of its ports.
+     */
+    void SetBaselineReset(bool enabled) override;
+
     /**
      * Overriding function from IbPerfCounter.
      *
@@ -76,6 +171,60 @@ public:
      */
     void RefreshCounters() override;
 
+    /**
+     * Sum up the current counter values of all of the node's ports, without querying the ports again.
+     * This is used after the ports have been refreshed by someone else (e.g. IbFabric's worker pool).
+     */
+    void AggregateCounters();
+
+    /**
+     * Sum up the current counter values of all of the node's ports, like AggregateCounters(),
+     * but read the values directly from the columns of a counter table, that holds the node's ports.
+     *
+     * @param portTable The table, that the node's ports are attached to
+     * @param firstRow The row of the node's first port (the other ports must follow in order)
+     */
+    void AggregateCounters(const IbCounterTable &portTable, size_t firstRow);
+
+    /**
+     * Overriding function from IbPerfCounter.
+     *
+     * The mask is also applied to all of the node's ports.
+     */
+    void SetCounterMask(uint32_t mask) override;
+
+    /**
+     * Check again, whether the node can query all of its ports at once.
+     * This is needed, after the node's ports have been initialized or verified from outside (e.g. by IbFabric).
+     */
+    void UpdateCapabilities();
+
+    /**
+     * Refresh only the node's aggregated counters, without refreshing the counters of the single ports.
+     *
+     * On switches, that support AllPortSelect, this needs only a single query for the whole node,
+     * instead of one query per port. Otherwise, this falls back to RefreshCounters().
+     * If the ports have been created lazily, the first call initializes the first port to check for AllPortSelect.
+     *
+     * CAUTION: When AllPortSelect is used, the counters of the node's ports are not updated!
+     */
+    void RefreshAggregateCounters();
+
+    /**
+     * Overriding function from IbPerfCounter.
+     *
+     * If the node's counters have been aggregated from its ports, the rates are the sums of the ports' rates,
+     * so that each port's rate is calculated with the timestamps of its own queries.
+     */
+    IbPerfRates GetRates() const override;
+
+    /**
+     * Check, whether RefreshAggregateCounters() can query the whole node at once.
+     */
+    bool IsAllPortSelectSupported() const {
+        return m_isAllPortSelectSupported;
+    }
+
     /**
      * Get the node's description;
      */
@@ -123,6 +272,23 @@ public:
         return os;
     }
 
+private:
+    /**
+     * Check, whether the node can query all of its ports at once, and set m_isAllPortSelectSupported accordingly.
+     * Uninitialized ports share their switch's PMA with the first port, so only the first port needs to be initialized.
+     *
+     * @param nodeType The node's type, as reported by the ibnetdisc-library
+     */
+    void CheckAllPortSelect(int nodeType);
+
+    /**
+     * Take over the ports, that a constructor has created. Until then, the ports are owned by unique pointers,
+     * so that they are deleted, if the constructor throws (in which case the destructor is not called).
+     *
+     * @param ports The ports, which are left empty
+     */
+    void AdoptPorts(std::vector<std::unique_ptr<IbPort>> &ports);
+
 private:
     /**
      * A short string describing the node (e.g. hostname, manufacturer, ...)
@@ -139,10 +305,27 @@ private:
      */
     uint8_t m_numPorts;
 
+    /**
+     * The node's type, as reported by the ibnetdisc-library.
+     */
+    int m_nodeType;
+
     /**
      * All of the node's ports.
      */
     std::vector<IbPort *> m_ports;
+
+    /**
+     * Whether the node is a switch, that supports AllPortSelect, and all of its ports share the same link width.
+     * The link width must be the same, because the aggregated data counters are multiplied by it.
+     */
+    bool m_isAllPortSelectSupported;
+
+    /**
+     * Whether the node's counters have been aggregated from its ports by the last refresh
+     * (instead of being queried at once via AllPortSelect).
+     */
+    bool m_isAggregatedFromPorts;
 };
 
 }
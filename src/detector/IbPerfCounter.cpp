@@ -21,54 +21,159 @@
 namespace Detector {
 
 IbPerfCounter::IbPerfCounter() :
-        m_xmitDataBytes(0),
-        m_rcvDataBytes(0),
-        m_xmitPkts(0),
-        m_rcvPkts(0),
-        m_unicastXmitPkts(0),
-        m_unicastRcvPkts(0),
-        m_multicastXmitPkts(0),
-        m_multicastRcvPkts(0),
-        m_symbolErrors(0),
-        m_linkDowned(0),
-        m_linkRecoveries(0),
-        m_rcvErrors(0),
-        m_rcvRemotePhysicalErrors(0),
-        m_rcvSwitchRelayErrors(0),
-        m_xmitDiscards(0),
-        m_xmitConstraintErrors(0),
-        m_rcvConstraintErrors(0),
-        m_localLinkIntegrityErrors(0),
-        m_excessiveBufferOverrunErrors(0),
-        m_vl15Dropped(0),
-        m_xmitWait(0) {
+        m_timestamp(0),
+        m_previousSnapshot(),
+        m_isBaselineReset(false),
+        m_counterMask(COUNTER_MASK_ALL),
+        m_published(),
+        m_history(nullptr),
+        m_counters(m_ownCounters),
+        m_stride(1),
+        m_baseValues(),
+        m_pendingBaselines(0),
+        m_ownCounters() {
 
 }
 
+IbPerfCounter::~IbPerfCounter() {
+    delete m_history;
+}
+
+void IbPerfCounter::SetHistoryCapacity(size_t capacity) {
+    delete m_history;
+    m_history = capacity > 0 ? new IbSampleHistory(capacity) : nullptr;
+}
+
+IbPerfSnapshot IbPerfCounter::GetSnapshot() const {
+    IbPerfSnapshot snapshot{};
+    snapshot.timestamp = m_timestamp;
+
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        snapshot.values[i] = m_counters[i * m_stride];
+    }
+
+    return snapshot;
+}
+
+void IbPerfCounter::SetCounters(const IbPerfSnapshot &snapshot) {
+    m_timestamp = snapshot.timestamp;
+
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        m_counters[i * m_stride] = snapshot.values[i];
+    }
+}
+
+uint64_t IbPerfCounter::GetDelta(IbCounterId id) const {
+    uint64_t current = m_counters[id * m_stride];
+    uint64_t previous = m_previousSnapshot.values[id];
+
+    if (m_previousSnapshot.timestamp == 0 || current < previous) {
+        return 0;
+    }
+
+    return current - previous;
+}
+
+IbPerfRates IbPerfCounter::GetRates() const {
+    return CalculateRates(m_previousSnapshot, GetSnapshot());
+}
+
+IbPerfRates IbPerfCounter::CalculateRates(const IbPerfSnapshot &previous, const IbPerfSnapshot &current) {
+    IbPerfRates rates{};
+
+    if (previous.timestamp == 0 || current.timestamp <= previous.timestamp) {
+        return rates;
+    }
+
+    rates.interval = static_cast<double>(current.timestamp - previous.timestamp) / 1000000000.0;
+
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        if (current.values[i] >= previous.values[i]) {
+            rates.values[i] = static_cast<double>(current.values[i] - previous.values[i]) / rates.interval;
+        }
+    }
+
+    return rates;
+}
+
 void IbPerfCounter::ResetVariables() {
-    m_xmitDataBytes = 0;
-    m_rcvDataBytes = 0;
-    m_xmitPkts = 0;
-    m_rcvPkts = 0;
-
-    m_unicastXmitPkts = 0;
-    m_unicastRcvPkts = 0;
-    m_multicastXmitPkts = 0;
-    m_multicastRcvPkts = 0;
-
-    m_symbolErrors = 0;
-    m_linkDowned = 0;
-    m_linkRecoveries = 0;
-    m_rcvErrors = 0;
-    m_rcvRemotePhysicalErrors = 0;
-    m_rcvSwitchRelayErrors = 0;
-    m_xmitDiscards = 0;
-    m_xmitConstraintErrors = 0;
-    m_rcvConstraintErrors = 0;
-    m_localLinkIntegrityErrors = 0;
-    m_excessiveBufferOverrunErrors = 0;
-    m_vl15Dropped = 0;
-    m_xmitWait = 0;
-}
-
-}
\ No newline at end of file
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        m_counters[i * m_stride] = 0;
+    }
+}
+
+void IbPerfCounter::AttachStorage(uint64_t *counters, size_t stride) {
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        counters[i * stride] = m_counters[i * m_stride];
+    }
+
+    m_counters = counters;
+    m_stride = stride;
+}
+
+void IbPerfCounter::DetachStorage() {
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        m_ownCounters[i] = m_counters[i * m_stride];
+    }
+
+    m_counters = m_ownCounters;
+    m_stride = 1;
+}
+
+void IbPerfCounter::PublishSnapshot() {
+    IbPerfSnapshot snapshot = GetSnapshot();
+
+    m_published.Store(snapshot);
+
+    if (m_history != nullptr) {
+        m_history->Push(snapshot);
+    }
+}
+
+void IbPerfCounter::ResetSnapshots() {
+    m_timestamp = 0;
+    m_previousSnapshot = IbPerfSnapshot{};
+}
+
+void IbPerfCounter::SetBaseline(IbCounterId id, uint64_t rawValue) {
+    m_baseValues[id] = rawValue;
+    m_pendingBaselines &= ~(1u << id);
+}
+
+void IbPerfCounter::AdvanceBaseline(IbCounterId id, uint8_t linkWidth) {
+    uint64_t increase = GetCounter(id);
+
+    if (IbCounterRegistry::Get(id).isPerLane && linkWidth > 0) {
+        increase /= linkWidth;
+    }
+
+    SetBaseline(id, m_baseValues[id] + increase);
+}
+
+void IbPerfCounter::SetBaselinePending(IbCounterId id) {
+    m_baseValues[id] = 0;
+    m_pendingBaselines |= 1u << id;
+}
+
+void IbPerfCounter::ClearBaselines() {
+    for (uint64_t &baseValue : m_baseValues) {
+        baseValue = 0;
+    }
+
+    m_pendingBaselines = 0;
+}
+
+uint64_t IbPerfCounter::ApplyBaseline(IbCounterId id, uint64_t rawValue) {
+    if (m_pendingBaselines & (1u << id)) {
+        SetBaseline(id, rawValue);
+    }
+
+    // A raw value below the baseline means, that the counter has been reset on the device in the meantime.
+    if (rawValue < m_baseValues[id]) {
+        SetBaseline(id, 0);
+    }
+
+    return rawValue - m_baseValues[id];
+}
+
+}
@@ -19,8 +19,13 @@
 #ifndef DETECTOR_IBPERFCOUNTER_H
 #define DETECTOR_IBPERFCOUNTER_H
 
+#include <cstddef>
 #include <cstdint>
 #include <ostream>
+#include "IbCounterRegistry.h"
+#include "IbPerfSnapshot.h"
+#include "IbSampleHistory.h"
+#include "IbSeqLockedSnapshot.h"
 
 namespace Detector {
 
@@ -31,11 +36,17 @@ namespace Detector {
  *                 An implementation of IbPerfCounter should be aware of this and multiply the
  *                 these values by the port's link width.
  *
+ * Every refresh also records the time, at which the counters have been read, and keeps the values of the previous
+ * refresh. This way, deltas and rates can be calculated from the timestamps of the actual reads, instead of
+ * the time of the whole refresh.
+ *
  * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
  * @date May 2018
  */
 class IbPerfCounter {
 
+    friend class IbPort;
+
 public:
     /**
      * Constructor.
@@ -45,7 +56,11 @@ public:
     /**
      * Destructor.
      */
-    virtual ~IbPerfCounter() = default;
+    virtual ~IbPerfCounter();
+
+    IbPerfCounter(const IbPerfCounter &copy) = delete;
+
+    IbPerfCounter &operator=(const IbPerfCounter &copy) = delete;
 
     /**
      * Reset all counters.
@@ -58,213 +73,480 @@ public:
      */
     virtual void RefreshCounters() = 0;
 
+    /**
+     * Choose, how ResetCounters() works (default: disabled).
+     *
+     * If disabled, the counters are reset on the device. If enabled, the device is not touched at all:
+     * The current values are stored as a baseline, which is subtracted from all values read afterwards.
+     * This does not need any MADs and does not disturb other tools (e.g. the subnet manager), that read the counters.
+     *
+     * @param enabled Set to true, to reset the counters by storing a baseline
+     */
+    virtual void SetBaselineReset(bool enabled) {
+        m_isBaselineReset = enabled;
+    }
+
+    /**
+     * Check, whether ResetCounters() stores a baseline instead of resetting the counters on the device.
+     */
+    bool IsBaselineResetEnabled() const {
+        return m_isBaselineReset;
+    }
+
+    /**
+     * Choose, which counters are updated by RefreshCounters() (default: COUNTER_MASK_ALL).
+     *
+     * Queries and files, that only contain counters, which are not selected, are skipped entirely.
+     * Counters, that are not selected, keep their last values.
+     *
+     * @param mask The selected counters (e.g. COUNTER_MASK_DATA or a combination of CounterMaskBit())
+     */
+    virtual void SetCounterMask(uint32_t mask) {
+        m_counterMask = mask & COUNTER_MASK_ALL;
+    }
+
+    /**
+     * Get the counters, that are updated by RefreshCounters().
+     */
+    uint32_t GetCounterMask() const {
+        return m_counterMask;
+    }
+
+    /**
+     * Check, whether a counter is updated by RefreshCounters().
+     *
+     * @param id The counter's id
+     */
+    bool IsCounterSelected(IbCounterId id) const {
+        return (m_counterMask & CounterMaskBit(id)) != 0;
+    }
+
+    /**
+     * Get a single counter by its id.
+     *
+     * @param id The counter's id
+     */
+    uint64_t GetCounter(IbCounterId id) const {
+        return m_counters[id * m_stride];
+    }
+
+    /**
+     * Move the counter values into external storage, e.g. a row of an IbCounterTable.
+     * The current values are copied to the new storage.
+     *
+     * CAUTION: The storage must outlive this object or be detached via DetachStorage() before it is freed.
+     *
+     * @param counters Pointer to the first counter
+     * @param stride The distance between two counters (in elements)
+     */
+    void AttachStorage(uint64_t *counters, size_t stride);
+
+    /**
+     * Move the counter values back into the object's own storage.
+     */
+    void DetachStorage();
+
+    /**
+     * Get the time, at which the counters have been read by the last refresh (in nanoseconds on CLOCK_MONOTONIC).
+     * A value of 0 means, that the counters have not been refreshed since the last reset.
+     */
+    uint64_t GetTimestamp() const {
+        return m_timestamp;
+    }
+
+    /**
+     * Get the current counter values and their timestamp.
+     */
+    IbPerfSnapshot GetSnapshot() const;
+
+    /**
+     * Get the counter values and timestamp of the refresh before the last one.
+     */
+    const IbPerfSnapshot &GetPreviousSnapshot() const {
+        return m_previousSnapshot;
+    }
+
+    /**
+     * Get the difference of a counter between the last two refreshes.
+     * Returns 0, if the counter has decreased (e.g. because it has been reset in between).
+     *
+     * @param id The counter's id
+     */
+    uint64_t GetDelta(IbCounterId id) const;
+
+    /**
+     * Get the rates of all counters per second between the last two refreshes.
+     */
+    virtual IbPerfRates GetRates() const;
+
+    /**
+     * Get the rate of a single counter per second between the last two refreshes.
+     *
+     * @param id The counter's id
+     */
+    double GetRate(IbCounterId id) const {
+        return GetRates().values[id];
+    }
+
+    /**
+     * Get a consistent copy of the counters, as they have been after the last completed refresh.
+     *
+     * In contrary to the other getters, this may be called by any amount of threads, while another thread is
+     * refreshing the counters. It never blocks the refreshing thread and never returns half-updated values.
+     */
+    IbPerfSnapshot GetPublishedSnapshot() const {
+        return m_published.Load();
+    }
+
+    /**
+     * Keep the most recent snapshots in a history (default: 0, which disables the history).
+     * After every refresh, the new snapshot is appended to the history.
+     *
+     * CAUTION: This replaces the current history and must not be called, while other threads are reading it.
+     *
+     * @param capacity The maximum amount of snapshots to keep
+     */
+    void SetHistoryCapacity(size_t capacity);
+
+    /**
+     * Get the history of recent snapshots. Other threads may read it, while the counters are being refreshed.
+     *
+     * @return The history, or a nullptr, if the history is disabled
+     */
+    const IbSampleHistory *GetHistory() const {
+        return m_history;
+    }
+
+    /**
+     * Calculate the rates of all counters per second between two snapshots.
+     * Counters, that have decreased, get a rate of 0. If one of the snapshots is empty or the current
+     * snapshot is not newer than the previous one, all rates and the interval are 0.
+     *
+     * @param previous The older snapshot
+     * @param current The newer snapshot
+     */
+    static IbPerfRates CalculateRates(const IbPerfSnapshot &previous, const IbPerfSnapshot &current);
+
     /**
      * Get the amount of transmitted data.
      */
     uint64_t GetXmitDataBytes() const {
-        return m_xmitDataBytes;
+        return GetCounter(COUNTER_XMIT_DATA_BYTES);
     }
 
     /**
      * Get the amount of received data.
      */
     uint64_t GetRcvDataBytes() const {
-        return m_rcvDataBytes;
+        return GetCounter(COUNTER_RCV_DATA_BYTES);
     }
 
     /**
      * Get the amount of transmitted packets.
      */
     uint64_t GetXmitPkts() const {
-        return m_xmitPkts;
+        return GetCounter(COUNTER_XMIT_PKTS);
     }
 
     /**
      * Get the amount of received packets.
      */
     uint64_t GetRcvPkts() const {
-        return m_rcvPkts;
+        return GetCounter(COUNTER_RCV_PKTS);
     }
 
     /**
      * Get the amount of transmitted unicast packets.
      */
     uint64_t GetUnicastXmitPkts() const {
-        return m_unicastXmitPkts;
+        return GetCounter(COUNTER_UNICAST_XMIT_PKTS);
     }
 
     /**
      * Get the amount of received unicast packets.
      */
     uint64_t GetUnicastRcvPkts() const {
-        return m_unicastRcvPkts;
+        return GetCounter(COUNTER_UNICAST_RCV_PKTS);
     }
 
     /**
      * Get the amount of transmitted multicast packets.
      */
     uint64_t GetMulticastXmitPkts() const {
-        return m_multicastXmitPkts;
+        return GetCounter(COUNTER_MULTICAST_XMIT_PKTS);
     }
 
     /**
      * Get the amount of received multicast packets.
      */
     uint64_t GetMulticastRcvPkts() const {
-        return m_multicastRcvPkts;
+        return GetCounter(COUNTER_MULTICAST_RCV_PKTS);
     }
 
     /**
      * Get the symbol-error counter.
      */
     uint64_t GetSymbolErrors() const {
-        return m_symbolErrors;
+        return GetCounter(COUNTER_SYMBOL_ERRORS);
     }
 
     /**
      * Get the Link-downed counter.
      */
     uint64_t GetLinkDownedCounter() const {
-        return m_linkDowned;
+        return GetCounter(COUNTER_LINK_DOWNED);
     }
 
     /**
      * Get the Link-recovery counter.
      */
     uint64_t GetLinkRecoveryCounter() const {
-        return m_linkRecoveries;
+        return GetCounter(COUNTER_LINK_RECOVERIES);
     }
 
     /**
      * Get the receive-error counter.
      */
     uint64_t GetRcvErrors() const {
-        return m_rcvErrors;
+        return GetCounter(COUNTER_RCV_ERRORS);
     }
 
     /**
      * Get the receive-error counter for physical errors.
      */
     uint64_t GetRcvRemotePhysicalErrors() const {
-        return m_rcvRemotePhysicalErrors;
+        return GetCounter(COUNTER_RCV_REMOTE_PHYSICAL_ERRORS);
     }
 
     /**
      * Get the receive-error counter for switch errors.
      */
     uint64_t GetRcvSwitchRelayErrors() const {
-        return m_rcvSwitchRelayErrors;
+        return GetCounter(COUNTER_RCV_SWITCH_RELAY_ERRORS);
     }
 
     /**
      * Get the amount of discarded transmissions.
      */
     uint64_t GetXmitDiscards() const {
-        return m_xmitDiscards;
+        return GetCounter(COUNTER_XMIT_DISCARDS);
     }
 
     /**
      * Get the transmit-error counter for constraint errors.
      */
     uint64_t GetXmitConstraintErrors() const {
-        return m_xmitConstraintErrors;
+        return GetCounter(COUNTER_XMIT_CONSTRAINT_ERRORS);
     }
 
     /**
      * Get the receive-error counter for constraint errors.
      */
     uint64_t GetRcvConstraintErrors() const {
-        return m_rcvConstraintErrors;
+        return GetCounter(COUNTER_RCV_CONSTRAINT_ERRORS);
     }
 
     /**
      * Get the amount of link integrity errors, that occurred.
      */
     uint64_t GetLocalLinkIntegrityErrors() const {
-        return m_localLinkIntegrityErrors;
+        return GetCounter(COUNTER_LOCAL_LINK_INTEGRITY_ERRORS);
     }
 
     /**
      * Get the amount of buffer overrun errors, that occurred.
      */
     uint64_t GetExcessiveBufferOverrunErrors() const {
-        return m_excessiveBufferOverrunErrors;
+        return GetCounter(COUNTER_EXCESSIVE_BUFFER_OVERRUN_ERRORS);
     }
 
     /**
      * Get the amount of dropped packets on virtual lane 15.
      */
     uint64_t GetVL15Dropped() const {
-        return m_vl15Dropped;
+        return GetCounter(COUNTER_VL15_DROPPED);
     }
 
     /**
      * Get the transmission-wait counter.
      */
     uint64_t GetXmitWait() const {
-        return m_xmitWait;
+        return GetCounter(COUNTER_XMIT_WAIT);
     }
 
     /**
      * Write all counters to an output stream.
      */
     friend std::ostream &operator<<(std::ostream &os, const IbPerfCounter &o) {
-        return os
-                << "XmitData: " << o.m_xmitDataBytes << " Bytes" << std::endl
-                << "RcvData: " << o.m_rcvDataBytes << " Bytes" << std::endl
-                << "XmitPkts: " << o.m_xmitPkts << std::endl
-                << "RcvPkts: " << o.m_rcvPkts << std::endl << std::endl
-                << "UnicastXmitPkts: " << o.m_unicastXmitPkts << std::endl
-                << "UnicastRcvPkts: " << o.m_unicastRcvPkts << std::endl
-                << "MulitcastXmitPkts: " << o.m_multicastXmitPkts << std::endl
-                << "MulitcastRcvPkts: " << o.m_multicastRcvPkts << std::endl << std::endl
-                << "SymbolErrors: " << o.m_symbolErrors << std::endl
-                << "LinkDownedCounter: " << o.m_linkDowned << std::endl
-                << "LinkRecoveryCounter: " << o.m_linkDowned << std::endl
-                << "RcvErrors: " << o.m_rcvErrors << std::endl
-                << "RcvRemotePhysicalErrors: " << o.m_rcvRemotePhysicalErrors << std::endl
-                << "RcvSwitchRelayErrors: " << o.m_rcvSwitchRelayErrors << std::endl
-                << "XmitDiscards: " << o.m_xmitDiscards << std::endl
-                << "XmitConstraintErrors: " << o.m_xmitConstraintErrors << std::endl
-                << "RcvConstraintErrors: " << o.m_rcvConstraintErrors << std::endl
-                << "LocalLinkIntegrityErrors: " << o.m_localLinkIntegrityErrors << std::endl
-                << "ExcessiveBufferOverrunErrors: " << o.m_excessiveBufferOverrunErrors << std::endl
-                << "VL15Dropped: " << o.m_vl15Dropped << std::endl
-                << "XmitWait: " << o.m_xmitWait;
+        for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+            const IbCounterDescriptor &counter = IbCounterRegistry::COUNTERS[i];
+
+            os << counter.name << ": " << o.GetCounter(counter.id);
+
+            if (counter.unit[0] != '\0') {
+                os << " " << counter.unit;
+            }
+
+            // The data and packet counters are separated from the following counters by an empty line.
+            if (i + 1 < NUM_COUNTERS) {
+                os << std::endl;
+
+                if (counter.group < COUNTER_GROUP_ERRORS && IbCounterRegistry::COUNTERS[i + 1].group != counter.group) {
+                    os << std::endl;
+                }
+            }
+        }
+
+        return os;
     }
 
 protected:
-    /* Counter variables */
-
-    uint64_t m_xmitDataBytes;
-    uint64_t m_rcvDataBytes;
-    uint64_t m_xmitPkts;
-    uint64_t m_rcvPkts;
-
-    uint64_t m_unicastXmitPkts;
-    uint64_t m_unicastRcvPkts;
-    uint64_t m_multicastXmitPkts;
-    uint64_t m_multicastRcvPkts;
-
-    uint64_t m_symbolErrors;
-    uint64_t m_linkDowned;
-    uint64_t m_linkRecoveries;
-    uint64_t m_rcvErrors;
-    uint64_t m_rcvRemotePhysicalErrors;
-    uint64_t m_rcvSwitchRelayErrors;
-    uint64_t m_xmitDiscards;
-    uint64_t m_xmitConstraintErrors;
-    uint64_t m_rcvConstraintErrors;
-    uint64_t m_localLinkIntegrityErrors;
-    uint64_t m_excessiveBufferOverrunErrors;
-    uint64_t m_vl15Dropped;
-    uint64_t m_xmitWait;
+    /**
+     * The time, at which the counters have been read by the last refresh.
+     */
+    uint64_t m_timestamp;
+
+    /**
+     * The counter values and timestamp of the refresh before the last one.
+     */
+    IbPerfSnapshot m_previousSnapshot;
+
+    /**
+     * Whether ResetCounters() stores a baseline instead of resetting the counters on the device.
+     */
+    bool m_isBaselineReset;
+
+    /**
+     * The counters, that are updated by RefreshCounters() (see SetCounterMask()).
+     */
+    uint32_t m_counterMask;
 
 protected:
     /**
      * Reset all counter variables to 0.
      */
     void ResetVariables();
+
+    /**
+     * Set a single counter.
+     *
+     * @param id The counter's id
+     * @param value The new value
+     */
+    void SetCounter(IbCounterId id, uint64_t value) {
+        m_counters[id * m_stride] = value;
+    }
+
+    /**
+     * Overwrite all counter variables and the timestamp with the values of a snapshot.
+     *
+     * @param snapshot The snapshot
+     */
+    void SetCounters(const IbPerfSnapshot &snapshot);
+
+    /**
+     * Save the current counter values as the previous snapshot. Call this before new values are written.
+     */
+    void SaveSnapshot() {
+        m_previousSnapshot = GetSnapshot();
+    }
+
+    /**
+     * Forget the current timestamp and the previous snapshot, so that no rates are calculated across a reset.
+     */
+    void ResetSnapshots();
+
+    /**
+     * Get the baseline of a counter, i.e. the raw value, that has been read at the last reset.
+     *
+     * @param id The counter's id
+     */
+    uint64_t GetBaseline(IbCounterId id) const {
+        return m_baseValues[id];
+    }
+
+    /**
+     * Set the baseline of a counter.
+     *
+     * @param id The counter's id
+     * @param rawValue The raw value, that has been read at the reset
+     */
+    void SetBaseline(IbCounterId id, uint64_t rawValue);
+
+    /**
+     * Move the baseline of a counter forward by its current value, so that the counter restarts at 0.
+     * Per-lane counters have been multiplied by the link width after the baseline has been subtracted
+     * (see IbCounterRegistry), so their value is divided by the link width again, to get the raw increase.
+     *
+     * @param id The counter's id
+     * @param linkWidth The link width, that the counter's value has been multiplied by
+     */
+    void AdvanceBaseline(IbCounterId id, uint8_t linkWidth);
+
+    /**
+     * Take the next raw value of a counter as its baseline (used, if the current raw value is not known at a reset).
+     *
+     * @param id The counter's id
+     */
+    void SetBaselinePending(IbCounterId id);
+
+    /**
+     * Set all baselines to 0 (e.g. after the counters have been reset on the device).
+     */
+    void ClearBaselines();
+
+    /**
+     * Subtract the baseline from a raw value. If the counter's baseline is pending, the raw value becomes the baseline.
+     *
+     * @param id The counter's id
+     * @param rawValue The raw value
+     *
+     * @return The value relative to the last reset
+     */
+    uint64_t ApplyBaseline(IbCounterId id, uint64_t rawValue);
+
+    /**
+     * Publish the current snapshot for concurrent readers (see GetPublishedSnapshot())
+     * and append it to the history, if the history is enabled. Call this after a refresh.
+     */
+    void PublishSnapshot();
+
+private:
+    /**
+     * The snapshot of the last completed refresh, published for concurrent readers.
+     */
+    IbSeqLockedSnapshot m_published;
+
+    /**
+     * The history of recent snapshots. Null, if the history is disabled.
+     */
+    IbSampleHistory *m_history;
+
+    /**
+     * The storage of the counter values. Counter i is found at m_counters[i * m_stride].
+     * Points to m_ownCounters (stride 1), or into a row of an IbCounterTable (stride = the table's column size).
+     */
+    uint64_t *m_counters;
+
+    /**
+     * The distance between two counters in m_counters.
+     */
+    size_t m_stride;
+
+    /**
+     * The raw values at the last reset, indexed by IbCounterId.
+     */
+    uint64_t m_baseValues[NUM_COUNTERS];
+
+    /**
+     * Bit i is set, if the baseline of counter i is taken from its next raw value.
+     */
+    uint32_t m_pendingBaselines;
+
+    /**
+     * The object's own counter storage, which is used, if the counters are not stored in an IbCounterTable.
+     */
+    uint64_t m_ownCounters[NUM_COUNTERS];
 };
 
 }
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBPERFSNAPSHOT_H
+#define DETECTOR_IBPERFSNAPSHOT_H
+
+#include <cstdint>
+
+namespace Detector {
+
+/**
+ * Identifies a single performance counter. Each counter is described by an entry of IbCounterRegistry.
+ */
+enum IbCounterId {
+    COUNTER_XMIT_DATA_BYTES,
+    COUNTER_RCV_DATA_BYTES,
+    COUNTER_XMIT_PKTS,
+    COUNTER_RCV_PKTS,
+    COUNTER_UNICAST_XMIT_PKTS,
+    COUNTER_UNICAST_RCV_PKTS,
+    COUNTER_MULTICAST_XMIT_PKTS,
+    COUNTER_MULTICAST_RCV_PKTS,
+    COUNTER_SYMBOL_ERRORS,
+    COUNTER_LINK_DOWNED,
+    COUNTER_LINK_RECOVERIES,
+    COUNTER_RCV_ERRORS,
+    COUNTER_RCV_REMOTE_PHYSICAL_ERRORS,
+    COUNTER_RCV_SWITCH_RELAY_ERRORS,
+    COUNTER_XMIT_DISCARDS,
+    COUNTER_XMIT_CONSTRAINT_ERRORS,
+    COUNTER_RCV_CONSTRAINT_ERRORS,
+    COUNTER_LOCAL_LINK_INTEGRITY_ERRORS,
+    COUNTER_EXCESSIVE_BUFFER_OVERRUN_ERRORS,
+    COUNTER_VL15_DROPPED,
+    COUNTER_XMIT_WAIT,
+    NUM_COUNTERS
+};
+
+/**
+ * Get the bit, that selects a single counter in a counter mask (see IbPerfCounter::SetCounterMask()).
+ *
+ * @param id The counter's id
+ */
+constexpr uint32_t CounterMaskBit(IbCounterId id) {
+    return 1u << id;
+}
+
+/**
+ * Selects all counters.
+ */
+constexpr uint32_t COUNTER_MASK_ALL = (1u << NUM_COUNTERS) - 1;
+
+/**
+ * The values of all performance counters at a single point in time.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+struct IbPerfSnapshot {
+    /**
+     * The time, at which the counters have been read (in nanoseconds on CLOCK_MONOTONIC).
+     * A value of 0 means, that the snapshot does not contain any values yet.
+     */
+    uint64_t timestamp;
+
+    /**
+     * The counter values, indexed by IbCounterId.
+     */
+    uint64_t values[NUM_COUNTERS];
+};
+
+/**
+ * The rates of change of all performance counters between two snapshots.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+struct IbPerfRates {
+    /**
+     * The time between the two snapshots in seconds (0, if no rates could be calculated).
+     */
+    double interval;
+
+    /**
+     * The counter rates per second, indexed by IbCounterId (e.g. bytes/s for COUNTER_XMIT_DATA_BYTES).
+     */
+    double values[NUM_COUNTERS];
+};
+
+}
+
+#endif
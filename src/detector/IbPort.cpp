@@ -16,59 +16,100 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 
+#include <algorithm>
 #include "IbPort.h"
+#include "IbSampler.h"
+#include "detector/exception/IbArgumentException.h"
 #include "detector/exception/IbMadException.h"
 
 namespace Detector {
 
+/**
+ * Describes, where the counters of a QoS-attribute come from.
+ */
+struct QosAttributeInfo {
+    /**
+     * The attribute's id.
+     */
+    uint16_t attributeId;
+
+    /**
+     * The field of the counter for level 0. The fields of the other levels follow directly.
+     */
+    MAD_FIELDS firstField;
+
+    /**
+     * The amount of bits of each counter.
+     */
+    uint8_t width;
+
+    /**
+     * The port counter, that sums up the attribute's counters. Its descriptor provides the unit and capability.
+     */
+    IbCounterId portCounter;
+};
+
+/**
+ * The QoS-attributes, indexed by IbQosAttribute.
+ */
+static const QosAttributeInfo QOS_ATTRIBUTES[NUM_QOS_ATTRIBUTES] = {
+        {IB_GSI_PORT_XMIT_DATA_SL, IB_PC_XMIT_DATA_SL0_F, 32, COUNTER_XMIT_DATA_BYTES},
+        {IB_GSI_PORT_RCV_DATA_SL, IB_PC_RCV_DATA_SL0_F, 32, COUNTER_RCV_DATA_BYTES},
+        {IB_GSI_PORT_PORT_VL_XMIT_WAIT_COUNTERS, IB_PC_VL_XMIT_WAIT0_F, 16, COUNTER_XMIT_WAIT}
+};
+
 IbPort::IbPort(ibv_port_attr attributes, uint8_t portNum) : IbPerfCounter(),
                                                             m_lid(attributes.lid),
                                                             m_portNum(portNum),
                                                             m_linkWidth(CalcLinkWidth(attributes.active_width)),
-                                                            m_madPort(nullptr),
+                                                            m_madPortPool(nullptr),
                                                             m_portId({0}),
                                                             m_nodeType(IB_NODE_CA),
                                                             m_isExtendedWidthSupported(false),
                                                             m_isAdditionalExtendedPortCountersSupported(false),
-                                                            m_isXmitWaitSupported(false) {
+                                                            m_isXmitWaitSupported(false),
+                                                            m_isAllPortSelectSupported(false),
+                                                            m_isResetOnSaturation(false),
+                                                            m_isVerified(true),
+                                                            m_verifyBackoff(0),
+                                                            m_numSkippedVerifications(0),
+                                                            m_capabilities(),
+                                                            m_qosCounters(),
+                                                            m_qosRawValues(),
+                                                            m_qosAttributeMask(0),
+                                                            m_isQosProbed(false),
+                                                            m_hardwareSample() {
 
 }
 
-IbPort::IbPort(uint16_t lid, uint8_t portNum) : IbPerfCounter(),
-                                                m_lid(lid),
-                                                m_portNum(portNum),
-                                                m_linkWidth(0),
-                                                m_madPort(nullptr),
-                                                m_portId({0}),
-                                                m_nodeType(IB_NODE_CA),
-                                                m_isExtendedWidthSupported(false),
-                                                m_isAdditionalExtendedPortCountersSupported(false),
-                                                m_isXmitWaitSupported(false) {
-    uint8_t pmaQueryBuf[QUERY_BUF_SIZE];
-    uint8_t smpQueryBuf[IB_SMP_DATA_SIZE];
-    int mgmt_classes[3] = {IB_SMI_CLASS, IB_SA_CLASS, IB_PERFORMANCE_CLASS};
-    uint16_t capabilityMask;
-    uint32_t capabilityMask2;
-    uint8_t activeWidth;
-
-    memset(pmaQueryBuf, 0, sizeof(pmaQueryBuf));
-    memset(smpQueryBuf, 0, sizeof(smpQueryBuf));
-
-    // Open a MAD-port. mad_rpc_open_port takes the following parameters:
-    //
-    // dev_name: The name of the local device from which all queries will be sent.
-    //           This seems to be optional, as passing a nullptr also works.
-    // dev_port: This seems to be number of the local port from which the all queries will be sent.
-    //           Passing a zero works fine. I guess, it then uses a default value.
-    // mgmt_classes: I guess, this array is used to declare the fields, that we want to access.
-    // num_classes: The amount of management-classes.
-    m_madPort = mad_rpc_open_port(nullptr, 0, mgmt_classes, 3);
+IbPort::IbPort(uint16_t lid, uint8_t portNum) :
+        IbPort(lid, portNum, IbMadPortPool::GetDefault()) {
 
-    if (m_madPort == nullptr) {
-        throw IbMadException("MAD: Failed to open port! (mad_rpc_open_port failed)");
-    }
+}
 
-    // Once the MAD-port has been opened, we can use ib_portid_set to initialize m_portId.
+IbPort::IbPort(uint16_t lid, uint8_t portNum, IbMadPortPool &madPortPool) :
+        IbPerfCounter(),
+        m_lid(lid),
+        m_portNum(portNum),
+        m_linkWidth(0),
+        m_madPortPool(&madPortPool),
+        m_portId({0}),
+        m_nodeType(IB_NODE_CA),
+        m_isExtendedWidthSupported(false),
+        m_isAdditionalExtendedPortCountersSupported(false),
+        m_isXmitWaitSupported(false),
+        m_isAllPortSelectSupported(false),
+        m_isResetOnSaturation(false),
+        m_isVerified(true),
+        m_verifyBackoff(0),
+        m_numSkippedVerifications(0),
+        m_capabilities(),
+        m_qosCounters(),
+        m_qosRawValues(),
+        m_qosAttributeMask(0),
+        m_isQosProbed(false),
+        m_hardwareSample() {
+    // We can use ib_portid_set to initialize m_portId.
     // It takes the following parameters:
     //
     // portid: A pointer to the ib_portid_t-struct, that shall be initialized.
@@ -77,6 +118,81 @@ IbPort::IbPort(uint16_t lid, uint8_t portNum) : IbPerfCounter(),
     // qkey: Again, setting this to 0 works flawlessy.
     ib_portid_set(&m_portId, m_lid, 0, 0);
 
+    ApplyCapabilities(QueryCapabilities());
+}
+
+IbPort::IbPort(const Capabilities &capabilities, IbMadPortPool &madPortPool) :
+        IbPerfCounter(),
+        m_lid(capabilities.lid),
+        m_portNum(capabilities.portNum),
+        m_linkWidth(0),
+        m_madPortPool(&madPortPool),
+        m_portId({0}),
+        m_nodeType(IB_NODE_CA),
+        m_isExtendedWidthSupported(false),
+        m_isAdditionalExtendedPortCountersSupported(false),
+        m_isXmitWaitSupported(false),
+        m_isAllPortSelectSupported(false),
+        m_isResetOnSaturation(false),
+        m_isVerified(false),
+        m_verifyBackoff(0),
+        m_numSkippedVerifications(0),
+        m_capabilities(),
+        m_qosCounters(),
+        m_qosRawValues(),
+        m_qosAttributeMask(0),
+        m_isQosProbed(false),
+        m_hardwareSample() {
+    ib_portid_set(&m_portId, m_lid, 0, 0);
+
+    ApplyCapabilities(capabilities);
+}
+
+IbPort::IbPort(ibnd_port_t *port, IbMadPortPool &madPortPool) :
+        IbPort(GetDiscoveredCapabilities(port), madPortPool) {
+    // The capabilities are fresh from the discovery, so there is nothing to verify.
+    m_isVerified = true;
+}
+
+IbPort::Capabilities IbPort::GetDiscoveredCapabilities(ibnd_port_t *port) {
+    uint8_t activeWidth = 0;
+
+    Capabilities capabilities{};
+    capabilities.lid = port->base_lid;
+    capabilities.portNum = static_cast<uint8_t>(port->portnum);
+    capabilities.nodeType = static_cast<uint8_t>(port->node->type);
+
+    // The discovery has already read the PortInfo-attribute of every port.
+    mad_decode_field(port->info, IB_PORT_LINK_WIDTH_ACTIVE_F, &activeWidth);
+    capabilities.linkWidth = CalcLinkWidth(activeWidth);
+
+    GetRemotePort(port, capabilities);
+
+    return capabilities;
+}
+
+void IbPort::GetRemotePort(ibnd_port_t *port, Capabilities &capabilities) {
+    ibnd_port_t *remotePort = port->remoteport;
+
+    if (remotePort == nullptr || remotePort->node == nullptr) {
+        capabilities.remoteGuid = 0;
+        capabilities.remotePortNum = 0;
+        capabilities.remoteNodeType = 0;
+        return;
+    }
+
+    capabilities.remoteGuid = remotePort->node->guid;
+    capabilities.remotePortNum = static_cast<uint8_t>(remotePort->portnum);
+    capabilities.remoteNodeType = static_cast<uint8_t>(remotePort->node->type);
+}
+
+void IbPort::QueryClassPortInfo(Capabilities &capabilities) {
+    uint8_t pmaQueryBuf[QUERY_BUF_SIZE];
+    memset(pmaQueryBuf, 0, sizeof(pmaQueryBuf));
+
+    // Borrow a MAD-port from the pool (see IbMadPortPool). It is given back, when madPort goes out of scope.
+    IbMadPortPool::Lease madPort(*m_madPortPool);
+
     // Query the Performance Management Agent for meta-information. We do this to get the device's capability masks.
     // pma_query_via() takes the following parameters:
     //
@@ -87,58 +203,154 @@ IbPort::IbPort(uint16_t lid, uint8_t portNum) : IbPerfCounter(),
     // timeout: Setting the timeout to 0 works fine.
     // id: The type of information we want to query.
     // srcport: The MAD-port.
-    if (!pma_query_via(pmaQueryBuf, &m_portId, 0, DEFAULT_QUERY_TIMEOUT, CLASS_PORT_INFO, m_madPort)) {
+    if (!pma_query_via(pmaQueryBuf, &m_portId, 0, DEFAULT_QUERY_TIMEOUT, CLASS_PORT_INFO, madPort.Get())) {
         throw IbMadException("MAD: Failed to query port information! (pma_query_via failed)");
     }
 
     // Get the capability masks from the buffer.
-    memcpy(&capabilityMask, pmaQueryBuf + 2, sizeof(capabilityMask));
-    memcpy(&capabilityMask2, pmaQueryBuf + 4, sizeof(capabilityMask2));
-    capabilityMask2 = htonl(ntohl(capabilityMask2) >> 5u);
+    memcpy(&capabilities.capabilityMask, pmaQueryBuf + 2, sizeof(capabilities.capabilityMask));
+    memcpy(&capabilities.capabilityMask2, pmaQueryBuf + 4, sizeof(capabilities.capabilityMask2));
+    capabilities.capabilityMask2 = htonl(ntohl(capabilities.capabilityMask2) >> 5u);
+    capabilities.hasClassPortInfo = true;
+}
 
-    if (capabilityMask & static_cast<uint16_t>(IB_PM_EXT_WIDTH_SUPPORTED)) {
-        m_isExtendedWidthSupported = true;
-    }
+IbPort::Capabilities IbPort::QueryCapabilities() {
+    uint8_t smpQueryBuf[IB_SMP_DATA_SIZE];
+    uint32_t nodeType = IB_NODE_CA;
+    uint8_t activeWidth;
 
-    if (capabilityMask & static_cast<uint16_t>(IB_PM_PC_XMIT_WAIT_SUP)) {
-        m_isXmitWaitSupported = true;
-    }
+    memset(smpQueryBuf, 0, sizeof(smpQueryBuf));
 
-    if (capabilityMask2 & static_cast<uint32_t>(IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP)) {
-        m_isAdditionalExtendedPortCountersSupported = true;
-    }
+    // The link partner can not be queried from the port itself, so it is kept.
+    Capabilities capabilities = m_capabilities;
+    capabilities.lid = m_lid;
+    capabilities.portNum = m_portNum;
+
+    QueryClassPortInfo(capabilities);
+
+    IbMadPortPool::Lease madPort(*m_madPortPool);
 
     // Query the Subnet Management Agent for device-information. We do this to get the node type.
     // This function works similar to pma_query_via() (see above).
-    if (!smp_query_via(smpQueryBuf, &m_portId, IB_ATTR_NODE_INFO, 0, 0, m_madPort)) {
+    if (!smp_query_via(smpQueryBuf, &m_portId, IB_ATTR_NODE_INFO, 0, 0, madPort.Get())) {
         throw IbMadException("MAD: Failed to query device information! (smp_query_via failed)");
     }
 
-    mad_decode_field(smpQueryBuf, IB_NODE_TYPE_F, &m_nodeType);
+    mad_decode_field(smpQueryBuf, IB_NODE_TYPE_F, &nodeType);
+    capabilities.nodeType = static_cast<uint8_t>(nodeType);
 
     // Query the Subnet Management Agent for port-information. We do this to get the port's link width.
     // This function works similar to pma_query_via() (see above).
-    if (!smp_query_via(smpQueryBuf, &m_portId, IB_ATTR_PORT_INFO, 0, 0, m_madPort)) {
+    if (!smp_query_via(smpQueryBuf, &m_portId, IB_ATTR_PORT_INFO, 0, 0, madPort.Get())) {
         throw IbMadException("MAD: Failed to query port information! (smp_query_via failed)");
     }
 
     mad_decode_field(smpQueryBuf, IB_PORT_LINK_WIDTH_ACTIVE_F, &activeWidth);
 
-    m_linkWidth = CalcLinkWidth(activeWidth);
+    capabilities.linkWidth = CalcLinkWidth(activeWidth);
+
+    return capabilities;
+}
+
+void IbPort::ApplyCapabilities(const Capabilities &capabilities) {
+    m_capabilities = capabilities;
+    m_nodeType = static_cast<MAD_NODE_TYPE>(capabilities.nodeType);
+    m_linkWidth = capabilities.linkWidth;
+
+    m_isExtendedWidthSupported = (capabilities.capabilityMask & static_cast<uint16_t>(IB_PM_EXT_WIDTH_SUPPORTED)) != 0;
+    m_isXmitWaitSupported = (capabilities.capabilityMask & static_cast<uint16_t>(IB_PM_PC_XMIT_WAIT_SUP)) != 0;
+    m_isAllPortSelectSupported = (capabilities.capabilityMask & static_cast<uint16_t>(IB_PM_ALL_PORT_SELECT)) != 0;
+    m_isAdditionalExtendedPortCountersSupported =
+            (capabilities.capabilityMask2 & static_cast<uint32_t>(IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP)) != 0;
+
+    // Without the capability masks, it is unknown which attributes to query.
+    if (capabilities.hasClassPortInfo) {
+        CompileQueryPlan();
+    } else {
+        m_queryPlan.clear();
+    }
+}
+
+void IbPort::SetCounterMask(uint32_t mask) {
+    IbPerfCounter::SetCounterMask(mask);
+
+    if (IsInitialized()) {
+        CompileQueryPlan();
+    }
+}
+
+void IbPort::Verify() {
+    ApplyCapabilities(QueryCapabilities());
+    m_isVerified = true;
+    m_isQosProbed = false;
+    m_verifyBackoff = 0;
+    m_numSkippedVerifications = 0;
+}
+
+bool IbPort::TryVerify() {
+    if (m_isVerified) {
+        return true;
+    }
+
+    // A port, that does not answer (e.g. because it has been removed), would otherwise cost a timeout per refresh.
+    if (m_numSkippedVerifications > 0) {
+        m_numSkippedVerifications--;
+        return false;
+    }
+
+    try {
+        Verify();
+    } catch (const IbMadException &exception) {
+        m_verifyBackoff = std::min<uint32_t>(m_verifyBackoff == 0 ? 1 : m_verifyBackoff * 2, VERIFY_MAX_BACKOFF);
+        m_numSkippedVerifications = m_verifyBackoff;
+
+        return false;
+    }
+
+    return true;
 }
 
-IbPort::~IbPort() {
-    // Close the MAD-port.
-    if(m_madPort != nullptr) {
-        mad_rpc_close_port(m_madPort);
+void IbPort::Initialize() {
+    if (IsInitialized() || m_madPortPool == nullptr) {
+        return;
     }
+
+    Capabilities capabilities = m_capabilities;
+
+    QueryClassPortInfo(capabilities);
+    ApplyCapabilities(capabilities);
 }
 
+IbPort::~IbPort() = default;
+
 void IbPort::ResetCounters() {
     char resetBuf[RESET_BUF_SIZE];
     memset(resetBuf, 0, sizeof(resetBuf));
 
     ResetVariables();
+    ResetSnapshots();
+
+    if (m_isBaselineReset) {
+        // The virtual counters hold the raw values of the last refresh. Counters, that have not been read yet or
+        // are not selected (and thus hold stale values), take their baseline from the next refresh, that reads them.
+        // No MADs are sent.
+        for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+            auto id = static_cast<IbCounterId>(i);
+
+            if (IsCounterSelected(id) && m_virtualCounters.HasValue(id)) {
+                SetBaseline(id, m_virtualCounters.GetValue(id));
+            } else {
+                SetBaselinePending(id);
+            }
+        }
+
+        return;
+    }
+
+    ClearBaselines();
+    m_virtualCounters.Reset();
+
+    IbMadPortPool::Lease madPort(*m_madPortPool);
 
     // Resetting the performance counters can be accomplished by calling performance_reset_via().
     // It takes the following parameters:
@@ -153,167 +365,514 @@ void IbPort::ResetCounters() {
     //       and IB_GSI_PORT_COUNTERS_EXT are the 64-bit extended performance counters.
     // srcport: The MAD-port.
     if (!performance_reset_via(resetBuf, &m_portId, m_portNum, 0xffffffff, DEFAULT_QUERY_TIMEOUT,
-                               IB_GSI_PORT_COUNTERS, m_madPort)) {
+                               IB_GSI_PORT_COUNTERS, madPort.Get())) {
         throw IbMadException("Failed to reset performance counters!");
     }
 
     if (!performance_reset_via(resetBuf, &m_portId, m_portNum, 0xffffffff, DEFAULT_QUERY_TIMEOUT,
-                               IB_GSI_PORT_COUNTERS_EXT, m_madPort)) {
+                               IB_GSI_PORT_COUNTERS_EXT, madPort.Get())) {
         throw IbMadException("Failed to reset extended performance counters!");
     }
 }
 
 void IbPort::RefreshCounters() {
-    uint64_t value64;
-    uint32_t value32;
+    Initialize();
+
+    // The port's capabilities have been loaded from a cache and may be stale (e.g. the link width), even if the
+    // cached query plan still gets answered. So they are queried once again, before they are relied on.
+    if (!TryVerify()) {
+        throw IbMadException("Failed to verify the port's capabilities!");
+    }
+
+    ExecuteQueryPlan(m_portNum, *this);
+
+    ResetSaturatedCounters();
+}
+
+void IbPort::ResetSaturatedCounters() {
+    if (!m_isResetOnSaturation || m_madPortPool == nullptr || !m_virtualCounters.IsAnySaturated()) {
+        return;
+    }
+
+    uint32_t mask = 0;
+
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        if (m_virtualCounters.IsSaturated(static_cast<IbCounterId>(i))) {
+            mask |= IbCounterRegistry::COUNTERS[i].counterSelectBit;
+        }
+    }
+
+    if (mask == 0) {
+        return;
+    }
+
+    char resetBuf[RESET_BUF_SIZE];
+    memset(resetBuf, 0, sizeof(resetBuf));
+
+    IbMadPortPool::Lease madPort(*m_madPortPool);
+
+    // Only the saturated counters are selected, so that the other counters keep running undisturbed.
+    // performance_reset_via() writes the lower 16 bits of the mask to CounterSelect and the rest to CounterSelect2.
+    if (!performance_reset_via(resetBuf, &m_portId, m_portNum, mask, DEFAULT_QUERY_TIMEOUT,
+                               IB_GSI_PORT_COUNTERS, madPort.Get())) {
+        throw IbMadException("Failed to reset saturated performance counters!");
+    }
+
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        if (mask & IbCounterRegistry::COUNTERS[i].counterSelectBit) {
+            m_virtualCounters.RestartCounter(static_cast<IbCounterId>(i));
+        }
+    }
+}
+
+void IbPort::RefreshAllPortCounters(IbPerfCounter &target) {
+    Initialize();
+
+    if (!m_isAllPortSelectSupported) {
+        throw IbMadException("AllPortSelect is not supported by the device!");
+    }
+
+    ExecuteQueryPlan(ALL_PORT_SELECT, target);
+}
+
+void IbPort::ExecuteQueryPlan(uint8_t portSelect, IbPerfCounter &target) {
     uint8_t pmaQueryBuf[QUERY_BUF_SIZE];
 
+    IbMadPortPool::Lease madPort(*m_madPortPool);
+
     // Query the port's performance counters.
     //
     // Reading the performance counters works as follows:
     // 1. Call pma_query_via() to query the counters. Pass either IB_GSI_PORT_COUNTERS or IB_GSI_PORT_COUNTERS_EXT
     //    to read either the normal 32-bit or the extended 64-bit counters.
-    // 2. Call mad_decode_field() for every counter we want to get. mad_decode_field() takes the following parameters:
+    // 2. Call mad_decode_field() for every counter we want to get (see DecodeResponse()).
     //
-    //    buf: The buffer, that has been filled by pma_query_via().
-    //    field: The counter, that we want to read.
-    //    val: A pointer to the variable that the counter will be saved in. Make sure it has the correct size.
+    // The query plan contains exactly the queries and counters, that are supported by this port.
+    //
+    // The values are timestamped with the middle of the first query's round trip, since this query carries the data
+    // counters, which are the ones, that rates are usually calculated from.
+    uint64_t timestamp = 0;
 
-    // Get the extended 64-bit transmit- and receive-counters.
-    memset(pmaQueryBuf, 0, sizeof(pmaQueryBuf));
+    target.SaveSnapshot();
+
+    for (const QueryStep &step : m_queryPlan) {
+        // pma_query_via() sends the first IB_PC_DATA_SZ bytes of the buffer as request data,
+        // so we only need to clear these instead of the whole buffer.
+        memset(pmaQueryBuf, 0, IB_PC_DATA_SZ);
 
-    if (!pma_query_via(pmaQueryBuf, &m_portId, m_portNum, 0, IB_GSI_PORT_COUNTERS_EXT, m_madPort)) {
-        throw IbMadException("Failed to query extended performance counters!");
+        uint64_t sendTime = IbSampler::GetMonotonicTime();
+
+        if (!pma_query_via(pmaQueryBuf, &m_portId, portSelect, 0, step.attributeId, madPort.Get())) {
+            throw IbMadException(step.attributeId == IB_GSI_PORT_COUNTERS_EXT ?
+                                 "Failed to query extended performance counters!" :
+                                 "Failed to query performance counters!");
+        }
+
+        if (timestamp == 0) {
+            timestamp = sendTime + (IbSampler::GetMonotonicTime() - sendTime) / 2;
+        }
+
+        DecodeResponse(step, pmaQueryBuf, target);
     }
 
-    mad_decode_field(pmaQueryBuf, IB_PC_EXT_XMT_BYTES_F, &value64);
-    m_xmitDataBytes = value64 * m_linkWidth;
+    target.m_timestamp = timestamp;
+    target.PublishSnapshot();
+}
 
-    mad_decode_field(pmaQueryBuf, IB_PC_EXT_RCV_BYTES_F, &value64);
+bool IbPort::HasCapability(IbCounterCapability capability) const {
+    switch (capability) {
+        case CAPABILITY_EXTENDED_WIDTH:
+            return m_isExtendedWidthSupported;
+        case CAPABILITY_ADDITIONAL_EXTENDED:
+            return m_isAdditionalExtendedPortCountersSupported;
+        case CAPABILITY_XMIT_WAIT:
+            return m_isXmitWaitSupported;
+        default:
+            return true;
+    }
+}
 
-    /*
-     *  TODO (Fabian Ruhland): For some reason, when I reset the counters on our switch, only the lower 40-bits of
-     *  the RCV_BYTES counter are set to zero. The most significant 24-bits are set to 0x0000ff, which leads to a value
-     *  of more than 1 peta-byte after a reset. As a quick fix, I always set the the most significant 24-bits of
-     *  this counter to zero manually by performing a bitwise AND with 0x000000ffffffffff.
-     *  This issue should be investigated further and, if possible, a better solution should be developed.
-     */
-    if(m_nodeType == IB_NODE_SWITCH) {
-        value64 &= 0x000000ffffffffffULL;
+void IbPort::CompileQueryPlan() {
+    QueryStep extendedStep{IB_GSI_PORT_COUNTERS_EXT, {}};
+    QueryStep step{IB_GSI_PORT_COUNTERS, {}};
+
+    // TODO (Fabian Ruhland): For some reason, when I reset the counters on our switch, only the lower 40-bits of
+    // the RCV_BYTES counter are set to zero. The most significant 24-bits are set to 0x0000ff, which leads to a value
+    // of more than 1 peta-byte after a reset. As a quick fix, I always set the the most significant 24-bits of
+    // this counter to zero manually by performing a bitwise AND with 0x000000ffffffffff.
+    // This issue should be investigated further and, if possible, a better solution should be developed.
+    bool isSwitch = m_nodeType == IB_NODE_SWITCH;
+
+    m_queryPlan.clear();
+
+    for (const IbCounterDescriptor &counter : IbCounterRegistry::COUNTERS) {
+        // Counters, that are not selected or not supported by the device, are not decoded. If none of an attribute's
+        // counters are left, the attribute is not queried at all.
+        if (!IsCounterSelected(counter.id) || !HasCapability(counter.capability)) {
+            continue;
+        }
+
+        // Every counter is taken from PortCountersExtended, if the device supports it there.
+        // Otherwise, the 32-bit PortCounters-attribute is used, whose counters stop at their maximum value.
+        if (counter.extendedField != IB_NO_FIELD && HasCapability(counter.extendedCapability)) {
+            bool isMaskedTo40Bits = isSwitch && counter.id == COUNTER_RCV_DATA_BYTES;
+
+            // The masked counter has only 40 valid bits, so it runs over into 0 after 2^40 bytes.
+            extendedStep.fields.push_back({counter.extendedField, counter.id, 64, counter.isPerLane,
+                                           isMaskedTo40Bits});
+            m_virtualCounters.SetWidth(counter.id, isMaskedTo40Bits ? 40 : 64, isMaskedTo40Bits ?
+                                       IbVirtualCounters::OVERFLOW_WRAP : IbVirtualCounters::OVERFLOW_SATURATE);
+        } else if (counter.field != IB_NO_FIELD) {
+            step.fields.push_back({counter.field, counter.id, counter.width, counter.isPerLane, false});
+            m_virtualCounters.SetWidth(counter.id, counter.width, IbVirtualCounters::OVERFLOW_SATURATE);
+        }
     }
 
-    m_rcvDataBytes = value64 * m_linkWidth;
+    if (!extendedStep.fields.empty()) {
+        m_queryPlan.push_back(extendedStep);
+    }
 
-    mad_decode_field(pmaQueryBuf, IB_PC_EXT_XMT_PKTS_F, &value64);
-    m_xmitPkts = value64;
+    if (!step.fields.empty()) {
+        m_queryPlan.push_back(step);
+    }
+}
 
-    mad_decode_field(pmaQueryBuf, IB_PC_EXT_RCV_PKTS_F, &value64);
-    m_rcvPkts = value64;
+void IbPort::DecodeResponse(const QueryStep &step, uint8_t *pmaQueryBuf, IbPerfCounter &target) {
+    uint64_t value64;
+    uint32_t value32;
 
-    // Get the extended 64-bit uni- and multicast-counters, if supported by the device.
-    if (m_isExtendedWidthSupported) {
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_XMT_UPKTS_F, &value64);
-        m_unicastXmitPkts = value64;
+    // mad_decode_field() takes the following parameters:
+    //
+    // buf: The buffer, that has been filled by pma_query_via().
+    // field: The counter, that we want to read.
+    // val: A pointer to the variable that the counter will be saved in. Make sure it has the correct size.
+    for (const CounterField &field : step.fields) {
+        if (field.width > 32) {
+            mad_decode_field(pmaQueryBuf, field.field, &value64);
+        } else {
+            mad_decode_field(pmaQueryBuf, field.field, &value32);
+            value64 = value32;
+        }
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_RCV_UPKTS_F, &value64);
-        m_unicastRcvPkts = value64;
+        // Only the port's own counters are masked and tracked. Aggregated values (AllPortSelect) are sums over
+        // many ports and may legitimately exceed 40 bits, so they are taken as they are.
+        if (&target == this) {
+            if (field.isMaskedTo40Bits) {
+                value64 &= 0x000000ffffffffffULL;
+            }
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_XMT_MPKTS_F, &value64);
-        m_multicastXmitPkts = value64;
+            value64 = m_virtualCounters.Update(field.counter, value64);
+        }
+
+        value64 = target.ApplyBaseline(field.counter, value64);
+
+        if (field.isPerLane) {
+            value64 *= m_linkWidth;
+        }
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_RCV_MPKTS_F, &value64);
-        m_multicastRcvPkts = value64;
+        target.SetCounter(field.counter, value64);
     }
+}
 
-#if USE_ADDITIONAL_EXTENDED_COUNTERS
-    // Get the extended 64-bit error-counters, if supported by the device.
-    if (m_isAdditionalExtendedPortCountersSupported) {
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_ERR_RCV_F, &value64);
-        m_rcvErrors = value64;
+void IbPort::ProbeQosAttributes() {
+    uint8_t pmaQueryBuf[QUERY_BUF_SIZE];
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_ERR_PHYSRCV_F, &value64);
-        m_rcvRemotePhysicalErrors = value64;
+    uint32_t attributeMask = 0;
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_ERR_SWITCH_REL_F, &value64);
-        m_rcvSwitchRelayErrors = value64;
+    // There are no capability bits for the per-SL data counters, so the only way to find out, whether the device
+    // supports an attribute, is to query it. The per-VL wait counters additionally require the device to support
+    // the transmission-wait counter of PortCounters.
+    //
+    // An unsupported attribute is answered with an error status. A missing response (e.g. a transient timeout)
+    // says nothing about the attribute, so CallPma() throws and the next refresh probes all attributes again.
+    for (uint32_t i = 0; i < NUM_QOS_ATTRIBUTES; i++) {
+        const QosAttributeInfo &info = QOS_ATTRIBUTES[i];
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_XMT_DISCARDS_F, &value64);
-        m_xmitDiscards = value64;
+        if (!HasCapability(IbCounterRegistry::Get(info.portCounter).capability)) {
+            continue;
+        }
+
+        memset(pmaQueryBuf, 0, IB_PC_DATA_SZ);
+        mad_set_field(pmaQueryBuf, 0, IB_PC_PORT_SELECT_F, m_portNum);
+
+        if (CallPma(IB_MAD_METHOD_GET, info.attributeId, pmaQueryBuf) == 0) {
+            attributeMask |= QosAttributeBit(static_cast<IbQosAttribute>(i));
+        }
+    }
+
+    m_qosAttributeMask = attributeMask;
+    m_isQosProbed = true;
+}
+
+void IbPort::RefreshQosCounters() {
+    if (m_madPortPool == nullptr) {
+        return;
+    }
+
+    Initialize();
+
+    if (!m_isQosProbed) {
+        ProbeQosAttributes();
+    }
+
+    uint8_t pmaQueryBuf[QUERY_BUF_SIZE];
+    uint16_t saturatedLevels[NUM_QOS_ATTRIBUTES] = {};
+    uint64_t timestamp = 0;
+
+    {
+        IbMadPortPool::Lease madPort(*m_madPortPool);
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_ERR_XMTCONSTR_F, &value64);
-        m_xmitConstraintErrors = value64;
+        // The attributes are queried and decoded like the ones of the query plan (see ExecuteQueryPlan()).
+        for (uint32_t i = 0; i < NUM_QOS_ATTRIBUTES; i++) {
+            auto attribute = static_cast<IbQosAttribute>(i);
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_ERR_RCVCONSTR_F, &value64);
-        m_rcvConstraintErrors = value64;
+            if (!IsQosAttributeSupported(attribute)) {
+                continue;
+            }
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_ERR_LOCALINTEG_F, &value64);
-        m_localLinkIntegrityErrors = value64;
+            memset(pmaQueryBuf, 0, IB_PC_DATA_SZ);
 
-        mad_decode_field(pmaQueryBuf, IB_PC_EXT_ERR_EXCESS_OVR_F, &value64);
-        m_excessiveBufferOverrunErrors = value64;
+            uint64_t sendTime = IbSampler::GetMonotonicTime();
 
-        if (m_isXmitWaitSupported) {
-            mad_decode_field(pmaQueryBuf, IB_PC_EXT_XMT_WAIT_F, &value64);
-            m_xmitWait = value64;
+            if (!pma_query_via(pmaQueryBuf, &m_portId, m_portNum, DEFAULT_QUERY_TIMEOUT,
+                               QOS_ATTRIBUTES[i].attributeId, madPort.Get())) {
+                throw IbMadException("Failed to query per-SL/per-VL performance counters!");
+            }
+
+            if (timestamp == 0) {
+                timestamp = sendTime + (IbSampler::GetMonotonicTime() - sendTime) / 2;
+            }
+
+            saturatedLevels[i] = DecodeQosResponse(attribute, pmaQueryBuf);
         }
-    } else {
-#endif
-    //Get the normal 32-Bit error-counters, if the device does not support the extended error-counters
-    memset(pmaQueryBuf, 0, sizeof(pmaQueryBuf));
+    }
+
+    m_qosCounters.timestamp = timestamp;
+
+    if (!m_isResetOnSaturation) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < NUM_QOS_ATTRIBUTES; i++) {
+        if (saturatedLevels[i] != 0) {
+            ResetQosLevels(static_cast<IbQosAttribute>(i), saturatedLevels[i]);
+        }
+    }
+}
+
+void IbPort::ResetQosCounters() {
+    if (m_madPortPool == nullptr) {
+        return;
+    }
 
-    if (!pma_query_via(pmaQueryBuf, &m_portId, m_portNum, 0, IB_GSI_PORT_COUNTERS, m_madPort)) {
-        throw IbMadException("Failed to query performance counters!");
+    // The values are accumulated from the increases of the raw values (see DecodeQosResponse()). So in baseline
+    // mode, setting them to 0 is enough, and the counters keep running undisturbed on the device.
+    if (!m_isBaselineReset) {
+        Initialize();
+
+        if (!m_isQosProbed) {
+            ProbeQosAttributes();
+        }
+
+        for (uint32_t i = 0; i < NUM_QOS_ATTRIBUTES; i++) {
+            auto attribute = static_cast<IbQosAttribute>(i);
+
+            if (IsQosAttributeSupported(attribute)) {
+                ResetQosLevels(attribute, 0xffff);
+            }
+        }
+    }
+
+    memset(&m_qosCounters, 0, sizeof(m_qosCounters));
+}
+
+void IbPort::ResetQosLevels(IbQosAttribute attribute, uint16_t levelMask) {
+    char resetBuf[RESET_BUF_SIZE];
+    memset(resetBuf, 0, sizeof(resetBuf));
+
+    IbMadPortPool::Lease madPort(*m_madPortPool);
+
+    // The QoS-attributes have one bit per level in their CounterSelect-field, just like PortCounters.
+    if (!performance_reset_via(resetBuf, &m_portId, m_portNum, levelMask, DEFAULT_QUERY_TIMEOUT,
+                               QOS_ATTRIBUTES[attribute].attributeId, madPort.Get())) {
+        throw IbMadException("Failed to reset per-SL/per-VL performance counters!");
+    }
+
+    // The values keep their totals and continue counting from 0 on the device.
+    for (uint32_t level = 0; level < NUM_QOS_LEVELS; level++) {
+        if (levelMask & (1u << level)) {
+            m_qosRawValues[attribute][level] = 0;
+        }
     }
+}
 
-    mad_decode_field(pmaQueryBuf, IB_PC_ERR_RCV_F, &value32);
-    m_rcvErrors = value32;
+uint16_t IbPort::DecodeQosResponse(IbQosAttribute attribute, uint8_t *pmaQueryBuf) {
+    const QosAttributeInfo &info = QOS_ATTRIBUTES[attribute];
+    uint32_t maxRaw = info.width >= 32 ? 0xffffffff : (1u << info.width) - 1;
+    uint64_t multiplier = IbCounterRegistry::Get(info.portCounter).isPerLane ? m_linkWidth : 1;
+    uint16_t saturatedLevels = 0;
+    uint32_t raw;
 
-    mad_decode_field(pmaQueryBuf, IB_PC_ERR_PHYSRCV_F, &value32);
-    m_rcvRemotePhysicalErrors = value32;
+    for (uint32_t level = 0; level < NUM_QOS_LEVELS; level++) {
+        mad_decode_field(pmaQueryBuf, static_cast<MAD_FIELDS>(info.firstField + level), &raw);
 
-    mad_decode_field(pmaQueryBuf, IB_PC_ERR_SWITCH_REL_F, &value32);
-    m_rcvSwitchRelayErrors = value32;
+        uint32_t &lastRaw = m_qosRawValues[attribute][level];
 
-    mad_decode_field(pmaQueryBuf, IB_PC_XMT_DISCARDS_F, &value32);
-    m_xmitDiscards = value32;
+        // A value, that is smaller than the last one, means that the counter has been reset on the device.
+        uint64_t increase = raw >= lastRaw ? raw - lastRaw : raw;
 
-    mad_decode_field(pmaQueryBuf, IB_PC_ERR_XMTCONSTR_F, &value32);
-    m_xmitConstraintErrors = value32;
+        m_qosCounters.values[attribute][level] += increase * multiplier;
+        lastRaw = raw;
 
-    mad_decode_field(pmaQueryBuf, IB_PC_ERR_RCVCONSTR_F, &value32);
-    m_rcvConstraintErrors = value32;
+        // Like PortCounters, these counters stop at their maximum value.
+        if (raw == maxRaw) {
+            saturatedLevels |= static_cast<uint16_t>(1u << level);
+        }
+    }
 
-    mad_decode_field(pmaQueryBuf, IB_PC_ERR_LOCALINTEG_F, &value32);
-    m_localLinkIntegrityErrors = value32;
+    return saturatedLevels;
+}
 
-    mad_decode_field(pmaQueryBuf, IB_PC_ERR_EXCESS_OVR_F, &value32);
-    m_excessiveBufferOverrunErrors = value32;
+uint16_t IbPort::CallPma(uint8_t method, uint16_t attributeId, uint8_t *data) {
+    ib_rpc_t rpc;
+    memset(&rpc, 0, sizeof(rpc));
+
+    // pma_query_via() and performance_reset_via() do not allow to write arbitrary attributes and do not tell
+    // a missing response from an error status, so the request is built by hand, like they do internally.
+    rpc.mgtclass = IB_PERFORMANCE_CLASS;
+    rpc.method = method;
+    rpc.attr.id = attributeId;
+    rpc.attr.mod = 0;
+    rpc.timeout = DEFAULT_QUERY_TIMEOUT;
+    rpc.datasz = IB_PC_DATA_SZ;
+    rpc.dataoffs = IB_PC_DATA_OFFS;
+
+    // The PMA is reached via QP1, which needs the well-known QKey.
+    ib_portid_t portId = m_portId;
+
+    if (portId.qp == 0) {
+        portId.qp = 1;
+    }
 
-    if (m_isXmitWaitSupported) {
-        mad_decode_field(pmaQueryBuf, IB_PC_XMT_WAIT_F, &value32);
-        m_xmitWait = value32;
+    if (portId.qkey == 0) {
+        portId.qkey = IB_DEFAULT_QP1_QKEY;
     }
-#if USE_ADDITIONAL_EXTENDED_COUNTERS
+
+    IbMadPortPool::Lease madPort(*m_madPortPool);
+
+    // mad_rpc() fails on both, a missing response and an error status. Only the latter sets rpc.rstatus.
+    if (!mad_rpc(madPort.Get(), &rpc, &portId, data, data) && rpc.rstatus == 0) {
+        throw IbMadException("No response from the performance management agent! (mad_rpc failed)");
+    }
+
+    return static_cast<uint16_t>(rpc.rstatus);
+}
+
+void IbPort::SetPmaAttribute(uint16_t attributeId, uint8_t *data) {
+    if (CallPma(IB_MAD_METHOD_SET, attributeId, data) != 0) {
+        throw IbMadException("Failed to set performance management attribute! (error status)");
+    }
+}
+
+void IbPort::ArmHardwareSample(const IbHardwareSampleConfig &config) {
+    if (m_madPortPool == nullptr) {
+        throw IbMadException("Hardware sampling is not available in compatibility mode!");
     }
-#endif
-    // Get the rest of the counters, that only have 32-bit variants.
+
+    if (config.numCounters == 0 || config.numCounters > MAX_SAMPLE_COUNTERS) {
+        throw IbArgumentException("Invalid amount of sample counters!");
+    }
+
+    if (config.sampleInterval == 0) {
+        throw IbArgumentException("The sample interval must not be 0!");
+    }
+
+    uint8_t pmaQueryBuf[QUERY_BUF_SIZE];
     memset(pmaQueryBuf, 0, sizeof(pmaQueryBuf));
 
-    if (!pma_query_via(pmaQueryBuf, &m_portId, m_portNum, 0, IB_GSI_PORT_COUNTERS, m_madPort)) {
-        throw IbMadException("Failed to query performance counters!");
+    // Read the current control-attribute first. It tells, whether the device is idle,
+    // and contains the device's tick and counter width, which are needed to interpret the result.
+    {
+        IbMadPortPool::Lease madPort(*m_madPortPool);
+
+        if (!pma_query_via(pmaQueryBuf, &m_portId, m_portNum, DEFAULT_QUERY_TIMEOUT, IB_GSI_PORT_SAMPLES_CONTROL,
+                           madPort.Get())) {
+            throw IbMadException("Failed to query sample control! (pma_query_via failed)");
+        }
     }
 
-    mad_decode_field(pmaQueryBuf, IB_PC_ERR_SYM_F, &value32);
-    m_symbolErrors = value32;
+    if (mad_get_field(pmaQueryBuf, 0, IB_PSC_SAMPLE_STATUS_F) != SAMPLE_STATUS_DONE) {
+        throw IbMadException("The device is already taking a sample!");
+    }
+
+    IbHardwareSample sample{};
+    sample.tag = config.tag;
+    sample.tick = static_cast<uint8_t>(mad_get_field(pmaQueryBuf, 0, IB_PSC_TICK_F));
+    // CounterWidth encodes 16, 20, 24, 28 or 32 bits.
+    sample.counterWidth = static_cast<uint8_t>(16 + 4 * mad_get_field(pmaQueryBuf, 0, IB_PSC_COUNTER_WIDTH_F));
+    sample.sampleInterval = config.sampleInterval;
+    sample.numCounters = config.numCounters;
+
+    // The read-only fields are sent back unchanged. Writing the control-attribute starts the sample.
+    mad_set_field(pmaQueryBuf, 0, IB_PSC_PORT_SELECT_F, m_portNum);
+    mad_set_field(pmaQueryBuf, 0, IB_PSC_SAMPLE_START_F, config.sampleStart);
+    mad_set_field(pmaQueryBuf, 0, IB_PSC_SAMPLE_INTVL_F, config.sampleInterval);
+    mad_set_field(pmaQueryBuf, 0, IB_PSC_TAG_F, config.tag);
+
+    for (uint32_t i = 0; i < MAX_SAMPLE_COUNTERS; i++) {
+        IbSampleCounter counter = i < config.numCounters ? config.counters[i] : SAMPLE_COUNTER_NONE;
+
+        mad_set_field(pmaQueryBuf, 0, static_cast<MAD_FIELDS>(IB_PSC_COUNTER_SEL0_F + i), counter);
+        sample.counters[i] = counter;
+    }
 
-    mad_decode_field(pmaQueryBuf, IB_PC_LINK_DOWNED_F, &value32);
-    m_linkDowned = value32;
+    SetPmaAttribute(IB_GSI_PORT_SAMPLES_CONTROL, pmaQueryBuf);
 
-    mad_decode_field(pmaQueryBuf, IB_PC_LINK_RECOVERS_F, &value32);
-    m_linkRecoveries = value32;
+    m_hardwareSample = sample;
+}
+
+bool IbPort::CollectHardwareSample(IbHardwareSample &sample) {
+    uint8_t pmaQueryBuf[QUERY_BUF_SIZE];
+    memset(pmaQueryBuf, 0, sizeof(pmaQueryBuf));
+
+    sample = m_hardwareSample;
+
+    {
+        IbMadPortPool::Lease madPort(*m_madPortPool);
+
+        // PortSamplesResult has no PortSelect-field, since it always belongs to the last armed sample.
+        if (!pma_query_via(pmaQueryBuf, &m_portId, 0, DEFAULT_QUERY_TIMEOUT, IB_GSI_PORT_SAMPLES_RESULT,
+                           madPort.Get())) {
+            throw IbMadException("Failed to query sample result! (pma_query_via failed)");
+        }
+    }
+
+    sample.tag = static_cast<uint16_t>(mad_get_field(pmaQueryBuf, 0, IB_PSR_TAG_F));
+    sample.isComplete = mad_get_field(pmaQueryBuf, 0, IB_PSR_SAMPLE_STATUS_F) == SAMPLE_STATUS_DONE;
+
+    // A sample with another tag has been armed by someone else in the meantime.
+    if (!sample.isComplete || sample.tag != m_hardwareSample.tag) {
+        sample.isComplete = false;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < sample.numCounters; i++) {
+        uint64_t value = mad_get_field(pmaQueryBuf, 0, static_cast<MAD_FIELDS>(IB_PSR_COUNTER0_F + i));
+
+        // The data counters are converted like the port's own data counters.
+        if (sample.counters[i] == SAMPLE_COUNTER_XMIT_DATA || sample.counters[i] == SAMPLE_COUNTER_RCV_DATA) {
+            IbCounterId id = sample.counters[i] == SAMPLE_COUNTER_XMIT_DATA ? COUNTER_XMIT_DATA_BYTES :
+                             COUNTER_RCV_DATA_BYTES;
+
+            if (IbCounterRegistry::Get(id).isPerLane) {
+                value *= m_linkWidth;
+            }
+        }
+
+        sample.values[i] = value;
+    }
 
-    mad_decode_field(pmaQueryBuf, IB_PC_VL15_DROPPED_F, &value32);
-    m_vl15Dropped = value32;
+    return true;
 }
 
 uint8_t IbPort::CalcLinkWidth(uint8_t activeWidth) {
@@ -19,16 +19,15 @@
 #ifndef DETECTOR_IBPORTCOUNTER_H
 #define DETECTOR_IBPORTCOUNTER_H
 
-// The extended 64-bit versions of rcvErrors, rcvRemotePhysicalErrors, rcvSwitchRelayErrors, xmitDiscards,
-// xmitConstraintErrors, rcvConstraintErrors, localLinkIntegrityErrors, excessiveBufferOverrunErrors, xmitWait
-// are only available in new versions of libibmad. By default build script checks, if the counters are availabe.
-#ifndef USE_ADDITIONAL_EXTENDED_COUNTERS
-#define USE_ADDITIONAL_EXTENDED_COUNTERS 0
-#endif
-
 #define DEFAULT_QUERY_TIMEOUT 0
 #define QUERY_BUF_SIZE 1536
 #define RESET_BUF_SIZE 1024
+#define ALL_PORT_SELECT 0xff
+#define VERIFY_MAX_BACKOFF 64
+
+#ifndef IB_PM_ALL_PORT_SELECT
+#define IB_PM_ALL_PORT_SELECT (CL_HTON16(((uint16_t)1)<<8))
+#endif
 
 #ifndef IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP
 #define IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP (CL_HTON32(((uint32_t)1)<<1))
@@ -36,13 +35,22 @@
 
 #include <cstdint>
 #include <iostream>
+#include <vector>
 #include <infiniband/mad.h>
 #include <infiniband/iba/ib_types.h>
 #include <infiniband/verbs.h>
+#include <ibnetdisc.h>
+#include "IbCounterRegistry.h"
+#include "IbHardwareSample.h"
+#include "IbMadPortPool.h"
 #include "IbPerfCounter.h"
+#include "IbQosCounters.h"
+#include "IbVirtualCounters.h"
 
 namespace Detector {
 
+class IbSysfsBatch;
+
 /**
  * Reads performance counters from a single port of an InfiniBand device.
  *
@@ -51,31 +59,327 @@ namespace Detector {
  */
 class IbPort : public IbPerfCounter {
 
+    friend class IbMadQueryEngine;
+
 public:
+    /**
+     * Everything, that the port learns about itself from the setup queries.
+     * This can be stored (e.g. in an IbTopologyCache), to create the port later without sending any MADs.
+     */
+    struct Capabilities {
+        /**
+         * The port's local id.
+         */
+        uint16_t lid;
+
+        /**
+         * The number, that the port has on its device.
+         */
+        uint8_t portNum;
+
+        /**
+         * The type of the port's device (see MAD_NODE_TYPE).
+         */
+        uint8_t nodeType;
+
+        /**
+         * The port's active link width.
+         */
+        uint8_t linkWidth;
+
+        /**
+         * The CapabilityMask from ClassPortInfo (in network byte order).
+         */
+        uint16_t capabilityMask;
+
+        /**
+         * The CapabilityMask2 from ClassPortInfo (in network byte order, shifted to the bit positions of ib_types.h).
+         */
+        uint32_t capabilityMask2;
+
+        /**
+         * Whether the capability masks are known. Lazily created ports only know them after their first refresh.
+         */
+        bool hasClassPortInfo;
+
+        /**
+         * The GUID of the node at the other end of the port's link (0, if unknown or not connected).
+         */
+        uint64_t remoteGuid;
+
+        /**
+         * The number of the port at the other end of the port's link.
+         */
+        uint8_t remotePortNum;
+
+        /**
+         * The type of the node at the other end of the port's link (see MAD_NODE_TYPE, 0, if unknown).
+         */
+        uint8_t remoteNodeType;
+    };
+
     /**
      * Constructor.
      *
+     * Borrows its MAD-ports from the default pool (see IbMadPortPool::GetDefault()).
+     *
      * @param lid The port's local id
      * @param portNum The number, that the port has on its device
      */
     IbPort(uint16_t lid, uint8_t portNum);
 
+    /**
+     * Constructor.
+     *
+     * @param lid The port's local id
+     * @param portNum The number, that the port has on its device
+     * @param madPortPool The pool, from which MAD-ports are borrowed for every query
+     */
+    IbPort(uint16_t lid, uint8_t portNum, IbMadPortPool &madPortPool);
+
+    /**
+     * Constructor.
+     *
+     * Creates the port from known capabilities, without sending any MADs. The port is not verified, so its first
+     * refresh queries the capabilities again (see Verify()), since they may have changed in the meantime.
+     *
+     * @param capabilities The port's capabilities (e.g. from an IbTopologyCache)
+     * @param madPortPool The pool, from which MAD-ports are borrowed for every query
+     */
+    IbPort(const Capabilities &capabilities, IbMadPortPool &madPortPool);
+
+    /**
+     * Constructor.
+     *
+     * Creates a lazy port from the data, that has been gathered by the network discovery, without sending any MADs.
+     * The capability masks are queried by the first refresh (see Initialize()), so that ports, which are never
+     * refreshed, do not cost any MADs.
+     *
+     * @param port The port, as it has been found by ibnd_discover_fabric()
+     * @param madPortPool The pool, from which MAD-ports are borrowed for every query
+     */
+    IbPort(ibnd_port_t *port, IbMadPortPool &madPortPool);
+
     /**
      * Destructor.
      */
     ~IbPort() override;
 
+    /**
+     * Query the port's capabilities again and rebuild the query plan.
+     * This is needed, if the capabilities have changed, while the LID stayed the same (e.g. the link width).
+     */
+    void Verify();
+
+    /**
+     * Verify the port, if it has not been verified yet (see Verify()). If the verification fails, the following
+     * attempts are skipped for an exponentially growing amount of calls (at most VERIFY_MAX_BACKOFF), so that a port,
+     * which does not answer, does not cost a timeout on every refresh.
+     *
+     * CAUTION: This must not be called concurrently for the same port.
+     *
+     * @return true, if the port is verified
+     */
+    bool TryVerify();
+
+    /**
+     * Set the port's link partner (see Capabilities::remoteGuid), as it has been found by the network discovery.
+     *
+     * @param port The port, as it has been found by ibnd_discover_fabric()
+     */
+    void UpdateRemotePort(ibnd_port_t *port) {
+        GetRemotePort(port, m_capabilities);
+    }
+
+    /**
+     * Query the port's capability masks and compile the query plan, if this has not been done yet.
+     * This is called automatically by RefreshCounters() and RefreshAllPortCounters().
+     */
+    void Initialize();
+
+    /**
+     * Check, whether the port's capability masks are known, so that it can be refreshed without further setup queries.
+     */
+    bool IsInitialized() const {
+        return m_capabilities.hasClassPortInfo;
+    }
+
+    /**
+     * Check, whether the port's capabilities have been queried from the device (i.e. not only loaded from a cache).
+     */
+    bool IsVerified() const {
+        return m_isVerified;
+    }
+
+    /**
+     * Get the port's capabilities.
+     */
+    const Capabilities &GetCapabilities() const {
+        return m_capabilities;
+    }
+
     /**
      * Reset all MAD-counters.
      */
     void ResetCounters() override;
 
+    /**
+     * Overriding function from IbPerfCounter.
+     *
+     * Rebuilds the query plan, so that attributes without any selected counters are not queried at all
+     * (e.g. PortCounters, if no error counters are selected).
+     */
+    void SetCounterMask(uint32_t mask) override;
+
     /**
      * Query all MAD-counters from all ports and aggregate the results.
      * The resulting values will be saved in the counter variables.
      */
     void RefreshCounters() override;
 
+    /**
+     * Query the counters of all ports of the device at once, by setting PortSelect to 0xFF (AllPortSelect).
+     * The resulting values are the sums over all ports and are written to the given target instead of this port.
+     *
+     * Only call this, if IsAllPortSelectSupported() returns true (after the port has been initialized).
+     *
+     * @param target The object, whose counter variables are overwritten with the aggregated values (e.g. the node)
+     */
+    void RefreshAllPortCounters(IbPerfCounter &target);
+
+    /**
+     * Enable or disable resetting saturated counters (default: disabled).
+     *
+     * The port keeps 64-bit virtual counters, even if the device only offers counters with fewer bits
+     * (see IbVirtualCounters). Counters of the PortCounters-attribute stop at their maximum value, which makes
+     * them useless until they are reset. If enabled, every refresh, that finds saturated counters, resets exactly
+     * these counters on the device, while the virtual counters keep their totals.
+     * This setting has no effect in compatibility mode.
+     *
+     * @param enabled Set to true, to reset saturated counters
+     */
+    void SetResetOnSaturation(bool enabled) {
+        m_isResetOnSaturation = enabled;
+    }
+
+    /**
+     * Check, whether saturated counters are reset.
+     */
+    bool IsResetOnSaturationEnabled() const {
+        return m_isResetOnSaturation;
+    }
+
+    /**
+     * Reset all counters, that are currently saturated, on the device (only, if enabled via SetResetOnSaturation()).
+     * This is done automatically by RefreshCounters(). Callers, that refresh the port by other means
+     * (e.g. IbMadQueryEngine), need to call this afterwards.
+     */
+    void ResetSaturatedCounters();
+
+    /**
+     * Get the state of the port's virtual counters (e.g. to check, how often a counter has overflown).
+     */
+    const IbVirtualCounters &GetVirtualCounters() const {
+        return m_virtualCounters;
+    }
+
+    /**
+     * Query the per-SL and per-VL counters of the port (see IbQosCounters).
+     *
+     * These counters are not refreshed by RefreshCounters(), since every attribute costs an additional query.
+     * The first call probes, which of the attributes are supported by the device. PortVLXmitWaitCounters is only
+     * probed, if the device supports the transmission-wait counter. Counters of unsupported attributes stay at 0.
+     * Saturated counters are reset on the device, if enabled via SetResetOnSaturation().
+     * In compatibility mode, this does nothing.
+     */
+    void RefreshQosCounters();
+
+    /**
+     * Set the values of the per-SL and per-VL counters to 0. Unless baseline reset is enabled
+     * (see IbPerfCounter::SetBaselineReset()), the counters are also reset on the device.
+     */
+    void ResetQosCounters();
+
+    /**
+     * Check, whether the device supports a QoS-attribute. Returns false, until RefreshQosCounters() has been called.
+     *
+     * @param attribute The attribute
+     */
+    bool IsQosAttributeSupported(IbQosAttribute attribute) const {
+        return (m_qosAttributeMask & QosAttributeBit(attribute)) != 0;
+    }
+
+    /**
+     * Get the per-SL and per-VL counters, as they have been read by the last call to RefreshQosCounters().
+     */
+    const IbQosCounters &GetQosCounters() const {
+        return m_qosCounters;
+    }
+
+    /**
+     * Get a single per-SL or per-VL counter, as it has been read by the last call to RefreshQosCounters().
+     *
+     * @param attribute The attribute, that the counter belongs to
+     * @param level The service level or virtual lane (0 to NUM_QOS_LEVELS - 1)
+     */
+    uint64_t GetQosCounter(IbQosAttribute attribute, uint8_t level) const {
+        return m_qosCounters.values[attribute][level];
+    }
+
+    /**
+     * Start a sample, that is taken by the device's PMA itself (PortSamplesControl).
+     *
+     * The device counts the selected counters of this port for the configured interval, which resolves bursts,
+     * that are far too short to be seen by polling the counters. A device can only take one sample at a time,
+     * so ports of the same switch need to be sampled one after another (see IbHardwareSampler).
+     * Throws an IbArgumentException, if the configuration is invalid,
+     * and an IbMadException, if the device is already sampling or does not support sampling.
+     *
+     * @param config The sample's configuration
+     */
+    void ArmHardwareSample(const IbHardwareSampleConfig &config);
+
+    /**
+     * Read the result of the sample, that has been started by ArmHardwareSample() (PortSamplesResult).
+     *
+     * @param sample Set to the result. Its values are only valid, if the sample is complete.
+     *
+     * @return true, if the sample is complete
+     */
+    bool CollectHardwareSample(IbHardwareSample &sample);
+
+    /**
+     * Get the sample, that has been started by the last call to ArmHardwareSample().
+     * Its tick and interval are known right after arming, its values only after CollectHardwareSample().
+     */
+    const IbHardwareSample &GetArmedHardwareSample() const {
+        return m_hardwareSample;
+    }
+
+    /**
+     * Register the files, that the port reads its counters from, at a batch (only in compatibility mode).
+     * MAD-ports do not read any files, so this does nothing by default.
+     *
+     * @param batch The batch
+     */
+    virtual void RegisterFiles(IbSysfsBatch &batch) {
+
+    }
+
+    /**
+     * Check, whether the port's device supports the transmission-wait counter.
+     */
+    bool IsXmitWaitSupported() const {
+        return m_isXmitWaitSupported;
+    }
+
+    /**
+     * Check, whether the port's device supports querying all of its ports at once (AllPortSelect).
+     */
+    bool IsAllPortSelectSupported() const {
+        return m_isAllPortSelectSupported;
+    }
+
     /**
      * Get the port's local id.
      */
@@ -110,12 +414,170 @@ public:
     }
 
 private:
+    /**
+     * Describes, how a single counter is decoded from the data of a PMA-response.
+     */
+    struct CounterField {
+        /**
+         * The field inside the response data.
+         */
+        MAD_FIELDS field;
+
+        /**
+         * The counter, that the decoded value is written to.
+         */
+        IbCounterId counter;
+
+        /**
+         * The amount of bits of the field. Fields with up to 32 bits are decoded as 32-bit values.
+         */
+        uint8_t width;
+
+        /**
+         * Whether the value is counted per lane and needs to be multiplied by the link width.
+         */
+        bool isPerLane;
+
+        /**
+         * Whether only the lower 40 bits of the value are valid (see CompileQueryPlan()).
+         */
+        bool isMaskedTo40Bits;
+    };
+
+    /**
+     * A single PMA-query, that is part of a query plan, and the counters, that are decoded from its response.
+     */
+    struct QueryStep {
+        /**
+         * The attribute, that is queried (IB_GSI_PORT_COUNTERS or IB_GSI_PORT_COUNTERS_EXT).
+         */
+        uint16_t attributeId;
+
+        /**
+         * The counters, that are decoded from the response.
+         */
+        std::vector<CounterField> fields;
+    };
+
     /**
      * Calculate the real link witdh by using the active_width from ibv_port_attr.
      *
      * @param The value active_width from an ibv_port_attr_struct.
      */
-    uint8_t CalcLinkWidth(uint8_t activeWidth);
+    static uint8_t CalcLinkWidth(uint8_t activeWidth);
+
+    /**
+     * Get the capabilities, that are known from the network discovery (everything but the capability masks).
+     *
+     * @param port The port, as it has been found by ibnd_discover_fabric()
+     */
+    static Capabilities GetDiscoveredCapabilities(ibnd_port_t *port);
+
+    /**
+     * Set the link partner of a port's capabilities from the data, that has been gathered by the network discovery.
+     *
+     * @param port The port, as it has been found by ibnd_discover_fabric()
+     * @param capabilities The capabilities, whose link partner is set
+     */
+    static void GetRemotePort(ibnd_port_t *port, Capabilities &capabilities);
+
+    /**
+     * Check, whether the port's device has a capability, that a counter needs (see IbCounterDescriptor).
+     *
+     * @param capability The capability (CAPABILITY_NONE is always available)
+     */
+    bool HasCapability(IbCounterCapability capability) const;
+
+    /**
+     * Query the port's capabilities via one PMA- and two SMP-queries.
+     */
+    Capabilities QueryCapabilities();
+
+    /**
+     * Query the capability masks from the port's Performance Management Agent (ClassPortInfo).
+     *
+     * @param capabilities The capabilities, whose masks are set
+     */
+    void QueryClassPortInfo(Capabilities &capabilities);
+
+    /**
+     * Set the port's properties from its capabilities and compile the query plan.
+     *
+     * @param capabilities The port's capabilities
+     */
+    void ApplyCapabilities(const Capabilities &capabilities);
+
+    /**
+     * Build m_queryPlan from the port's capabilities and the selected counters.
+     *
+     * Every counter is taken from the widest attribute, that supports it. PortCounters is only queried,
+     * if at least one counter is not available in PortCountersExtended. On devices supporting the additional
+     * extended port counters, this leaves a single query per refresh.
+     */
+    void CompileQueryPlan();
+
+    /**
+     * Execute all queries of the query plan and decode the responses.
+     *
+     * @param portSelect The value of the PortSelect-field (the port number or ALL_PORT_SELECT)
+     * @param target The object, whose counter variables are overwritten with the decoded values
+     */
+    void ExecuteQueryPlan(uint8_t portSelect, IbPerfCounter &target);
+
+    /**
+     * Decode all counters of a query step from the data of a PMA-response.
+     *
+     * @param step The query step, that the response belongs to
+     * @param pmaQueryBuf The response data, as it is returned by pma_query_via()
+     * @param target The object, whose counter variables are overwritten with the decoded values
+     */
+    void DecodeResponse(const QueryStep &step, uint8_t *pmaQueryBuf, IbPerfCounter &target);
+
+    /**
+     * Send a request to the port's Performance Management Agent. In contrary to pma_query_via(), any method can be
+     * used and the MAD status of the response is returned, instead of being treated like a missing response.
+     * Throws an IbMadException, if no response arrives.
+     *
+     * @param method The request's method (e.g. IB_MAD_METHOD_GET or IB_MAD_METHOD_SET)
+     * @param attributeId The attribute's id
+     * @param data The attribute's data (IB_PC_DATA_SZ bytes). The response is written to the same buffer.
+     *
+     * @return The MAD status of the response (0, if the request has succeeded)
+     */
+    uint16_t CallPma(uint8_t method, uint16_t attributeId, uint8_t *data);
+
+    /**
+     * Write an attribute of the port's Performance Management Agent (a Set-request, in contrary to pma_query_via()).
+     * Throws an IbMadException, if no response arrives or the PMA rejects the request.
+     *
+     * @param attributeId The attribute's id
+     * @param data The attribute's data (IB_PC_DATA_SZ bytes). The response is written to the same buffer.
+     */
+    void SetPmaAttribute(uint16_t attributeId, uint8_t *data);
+
+    /**
+     * Find out, which QoS-attributes are supported by the device, by querying each of them once.
+     * Throws an IbMadException, if the device does not answer, so that the attributes are probed again later.
+     */
+    void ProbeQosAttributes();
+
+    /**
+     * Decode the counters of a QoS-attribute from the data of a PMA-response and add their increase to m_qosCounters.
+     *
+     * @param attribute The attribute, that the response belongs to
+     * @param pmaQueryBuf The response data, as it is returned by pma_query_via()
+     *
+     * @return A mask of the levels, whose counters are saturated
+     */
+    uint16_t DecodeQosResponse(IbQosAttribute attribute, uint8_t *pmaQueryBuf);
+
+    /**
+     * Reset some counters of a QoS-attribute on the device.
+     *
+     * @param attribute The attribute
+     * @param levelMask A mask of the levels, whose counters are reset
+     */
+    void ResetQosLevels(IbQosAttribute attribute, uint16_t levelMask);
 
 protected:
     /**
@@ -142,12 +604,18 @@ protected:
      */
     uint8_t m_linkWidth;
 
+    /**
+     * Turns the raw counter values into monotonic 64-bit values.
+     */
+    IbVirtualCounters m_virtualCounters;
+
 private:
     /**
-     * Pointer to a mad-port. A port can be opened by calling mad_rpc_open_port().
-     * A port must be opened before it is possible to query any data from the InfiniBand device.
+     * The pool, from which a MAD-port is borrowed for every query.
+     * A MAD-port must be opened before it is possible to query any data from the InfiniBand device.
+     * The pool takes care of this, so that not every port needs to open its own MAD-port.
      */
-    ibmad_port *m_madPort;
+    IbMadPortPool *m_madPortPool;
 
     /**
      * Contains information about an InfiniBand device/port. This struct can be initialized by calling ib_portid_set().
@@ -173,6 +641,67 @@ private:
      * Indicates, whether or not the InfiniBand device supports the transmission-wait counter.
      */
     bool m_isXmitWaitSupported;
+
+    /**
+     * Indicates, whether or not the InfiniBand device supports querying all of its ports at once.
+     */
+    bool m_isAllPortSelectSupported;
+
+    /**
+     * Whether saturated counters are reset after each refresh.
+     */
+    bool m_isResetOnSaturation;
+
+    /**
+     * Whether the port's capabilities have been queried from the device (i.e. not only loaded from a cache).
+     */
+    bool m_isVerified;
+
+    /**
+     * The amount of verification attempts, that are skipped after the last failed one (see TryVerify()).
+     */
+    uint32_t m_verifyBackoff;
+
+    /**
+     * The amount of verification attempts, that are still skipped, before the port is verified again.
+     */
+    uint32_t m_numSkippedVerifications;
+
+    /**
+     * The port's capabilities.
+     */
+    Capabilities m_capabilities;
+
+    /**
+     * The queries, that are necessary to refresh the port's counters.
+     * Compiled by the constructor, or by Initialize() for lazily created ports.
+     */
+    std::vector<QueryStep> m_queryPlan;
+
+    /**
+     * The per-SL and per-VL counters.
+     */
+    IbQosCounters m_qosCounters;
+
+    /**
+     * The raw values of the per-SL and per-VL counters, as they have been read by the last refresh.
+     */
+    uint32_t m_qosRawValues[NUM_QOS_ATTRIBUTES][NUM_QOS_LEVELS];
+
+    /**
+     * The QoS-attributes, that are supported by the device (see QosAttributeBit()).
+     */
+    uint8_t m_qosAttributeMask;
+
+    /**
+     * Whether the QoS-attributes have been probed.
+     */
+    bool m_isQosProbed;
+
+    /**
+     * The properties of the last sample, that has been armed (without values).
+     */
+    IbHardwareSample m_hardwareSample;
 };
 
 }
@@ -16,99 +16,108 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 
-#include <cstring>
-#include <iostream>
 #include "IbPortCompat.h"
+#include "IbSampler.h"
+#include "IbSysfsBatch.h"
 #include "detector/exception/IbFileException.h"
 
 namespace Detector {
 
-IbPortCompat::IbPortCompat(std::string deviceName, ibv_port_attr attributes, uint8_t portNum) :
-        IbPort(attributes, portNum),
-        m_deviceName(std::move(deviceName)) {
-    std::string path = "/sys/class/infiniband/" + m_deviceName + "/ports/" + std::to_string(m_portNum) + "/counters/";
-
-    files[0] = std::ifstream(path + "port_xmit_data", std::ios::in);
-    files[1] = std::ifstream(path + "port_rcv_data", std::ios::in);
-    files[2] = std::ifstream(path + "port_xmit_packets", std::ios::in);
-    files[3] = std::ifstream(path + "port_rcv_packets", std::ios::in);
-    files[4] = std::ifstream(path + "unicast_xmit_packets", std::ios::in);
-    files[5] = std::ifstream(path + "unicast_rcv_packets", std::ios::in);
-    files[6] = std::ifstream(path + "multicast_xmit_packets", std::ios::in);
-    files[7] = std::ifstream(path + "multicast_rcv_packets", std::ios::in);
-    files[8] = std::ifstream(path + "symbol_error", std::ios::in);
-    files[9] = std::ifstream(path + "link_downed", std::ios::in);
-    files[10] = std::ifstream(path + "link_error_recovery", std::ios::in);
-    files[11] = std::ifstream(path + "port_rcv_errors", std::ios::in);
-    files[12] = std::ifstream(path + "port_rcv_remote_physical_errors", std::ios::in);
-    files[13] = std::ifstream(path + "port_rcv_switch_relay_errors", std::ios::in);
-    files[14] = std::ifstream(path + "port_xmit_discards", std::ios::in);
-    files[15] = std::ifstream(path + "port_xmit_constraint_errors", std::ios::in);
-    files[16] = std::ifstream(path + "port_rcv_constraint_errors", std::ios::in);
-    files[17] = std::ifstream(path + "local_link_integrity_errors", std::ios::in);
-    files[18] = std::ifstream(path + "excessive_buffer_overrun_errors", std::ios::in);
-    files[19] = std::ifstream(path + "VL15_dropped", std::ios::in);
-    files[20] = std::ifstream(path + "port_xmit_wait", std::ios::in);
-
-    for (const std::ifstream &file : files) {
-        if (!file.is_open()) {
-            throw IbFileException("Unable to open file in '" + path + "'!");
+/**
+ * Get the names of the counter files, indexed by IbCounterId.
+ */
+static const char *const *GetCounterFiles() {
+    struct Files {
+        const char *names[NUM_COUNTERS];
+
+        Files() : names() {
+            for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+                names[i] = IbCounterRegistry::COUNTERS[i].sysfsFile;
+            }
         }
-    }
+    };
+
+    static const Files files;
 
-    std::memset(baseValues, 0, sizeof(baseValues));
+    return files.names;
 }
 
-IbPortCompat::~IbPortCompat() {
-    for (std::ifstream &file : files) {
-        file.close();
+IbPortCompat::IbPortCompat(std::string deviceName, ibv_port_attr attributes, uint8_t portNum) :
+        IbPort(attributes, portNum),
+        m_deviceName(std::move(deviceName)),
+        m_reader("/sys/class/infiniband/" + m_deviceName + "/ports/" + std::to_string(m_portNum) + "/counters/",
+                 GetCounterFiles(), NUM_COUNTERS) {
+    m_isBaselineReset = true;
+
+    // The files contain the values of the PortCounters-attribute, whose counters saturate. On devices, that support
+    // the extended counters, the kernel provides 64-bit values instead, which is detected by IbVirtualCounters,
+    // as soon as a value exceeds the width. A value, that becomes smaller, is always taken as an external reset
+    // (e.g. by perfquery), since treating it as a wrap would add almost 2^32 to a 32-bit counter.
+    for (const IbCounterDescriptor &counter : IbCounterRegistry::COUNTERS) {
+        m_virtualCounters.SetWidth(counter.id, counter.width, IbVirtualCounters::OVERFLOW_SATURATE);
     }
 }
 
+IbPortCompat::~IbPortCompat() = default;
+
 void IbPortCompat::ResetCounters() {
-    for(uint32_t i = 0; i < sizeof(files) / sizeof(std::ifstream); i++) {
-        files[i].seekg(0, std::ios::beg);
-        files[i].getline(buffer, sizeof(buffer));
+    m_reader.DiscardBufferedValues();
+    ResetSnapshots();
 
-        baseValues[i] = strtoull(buffer, nullptr, 10);
+    // Counters, that are not selected, take their baseline from the first read after they have been selected.
+    for(uint32_t i = 0; i < m_reader.GetNumFiles(); i++) {
+        auto id = static_cast<IbCounterId>(i);
+
+        if(IsCounterSelected(id)) {
+            SetBaseline(id, m_virtualCounters.Update(id, m_reader.Read(i)));
+        } else {
+            SetBaselinePending(id);
+        }
     }
 }
 
-void IbPortCompat::RefreshCounters() {
-    m_xmitDataBytes = ReadCounter(0) * m_linkWidth;
-    m_rcvDataBytes = ReadCounter(1) * m_linkWidth;
-    m_xmitPkts = ReadCounter(2);
-    m_rcvPkts = ReadCounter(3);
-    m_unicastXmitPkts = ReadCounter(4);
-    m_unicastRcvPkts = ReadCounter(5);
-    m_multicastXmitPkts = ReadCounter(6);
-    m_multicastRcvPkts = ReadCounter(7);
-    m_symbolErrors = ReadCounter(8);
-    m_linkDowned = ReadCounter(9);
-    m_linkRecoveries = ReadCounter(10);
-    m_rcvErrors = ReadCounter(11);
-    m_rcvRemotePhysicalErrors = ReadCounter(12);
-    m_rcvSwitchRelayErrors = ReadCounter(13);
-    m_xmitDiscards = ReadCounter(14);
-    m_xmitConstraintErrors = ReadCounter(15);
-    m_rcvConstraintErrors = ReadCounter(16);
-    m_localLinkIntegrityErrors = ReadCounter(17);
-    m_excessiveBufferOverrunErrors = ReadCounter(18);
-    m_vl15Dropped = ReadCounter(19);
-    m_xmitWait = ReadCounter(20);
+void IbPortCompat::SetCounterMask(uint32_t mask) {
+    IbPerfCounter::SetCounterMask(mask);
+
+    for(uint32_t i = 0; i < m_reader.GetNumFiles(); i++) {
+        m_reader.SetFileEnabled(i, IsCounterSelected(static_cast<IbCounterId>(i)));
+    }
 }
 
-uint64_t IbPortCompat::ReadCounter(uint8_t index) {
-    std::memset(buffer, 0, sizeof(buffer));
+void IbPortCompat::RefreshCounters() {
+    SaveSnapshot();
+
+    // The values are timestamped with the time, at which the data counters have been read.
+    uint64_t readTime = IbSampler::GetMonotonicTime();
+    uint64_t dataTime = readTime;
+
+    for(uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        auto id = static_cast<IbCounterId>(i);
+
+        if(IsCounterSelected(id)) {
+            uint64_t value = ReadCounter(id);
+            SetCounter(id, IbCounterRegistry::Get(id).isPerLane ? value * m_linkWidth : value);
+        }
 
-    if(!files[index].good()) {
-        throw IbFileException("Unable to read file!");
+        if(id == COUNTER_RCV_DATA_BYTES) {
+            dataTime = IbSampler::GetMonotonicTime();
+        }
     }
 
-    files[index].seekg(0, std::ios::beg);
-    files[index].getline(buffer, sizeof(buffer));
+    m_timestamp = m_reader.HasBufferedValues() ? m_reader.GetBufferedTimestamp() :
+                  readTime + (dataTime - readTime) / 2;
+
+    m_reader.DiscardBufferedValues();
+
+    PublishSnapshot();
+}
+
+void IbPortCompat::RegisterFiles(IbSysfsBatch &batch) {
+    batch.Register(m_reader);
+}
 
-    return strtoull(buffer, nullptr, 10) - baseValues[index];
+uint64_t IbPortCompat::ReadCounter(IbCounterId id) {
+    return ApplyBaseline(id, m_virtualCounters.Update(id, m_reader.Read(id)));
 }
 
 }
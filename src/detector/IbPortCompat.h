@@ -20,8 +20,9 @@
 #define DETECTOR_IBPORTCOMPAT_H
 
 #include <cstdint>
-#include <fstream>
+#include <string>
 #include "IbPort.h"
+#include "IbSysfsReader.h"
 
 namespace Detector {
 
@@ -56,22 +57,45 @@ public:
      */
     void RefreshCounters() override;
 
+    /**
+     * Overriding function from IbPort.
+     */
+    void RegisterFiles(IbSysfsBatch &batch) override;
+
+    /**
+     * Overriding function from IbPerfCounter.
+     *
+     * The files of counters, that are not selected, are neither read by RefreshCounters() nor by an IbSysfsBatch.
+     * Batches, that the port has already been registered at, need to be set up again.
+     */
+    void SetCounterMask(uint32_t mask) override;
+
+    /**
+     * Overriding function from IbPerfCounter.
+     *
+     * The counter files can not be written, so compatibility ports always reset their counters by storing a baseline
+     * (see ResetCounters()). The setting is ignored on purpose, so that IsBaselineResetEnabled() keeps returning true
+     * and an IbNode or IbFabric, that forwards its own setting to all of its ports, can not turn this off.
+     *
+     * @param enabled Ignored
+     */
+    void SetBaselineReset(bool enabled) override {
+        // Nothing to do, since baseline reset is always enabled (see above).
+    }
+
 private:
     /**
      * Read a single counter.
      *
-     * @param index Index into files array
+     * @param index Index into the counter files
      */
-    uint64_t ReadCounter(uint8_t index);
+    uint64_t ReadCounter(IbCounterId id);
 
 private:
 
     std::string m_deviceName;
 
-    char buffer[128]{};
-
-    std::ifstream files[21]{};
-    uint64_t baseValues[21]{};
+    IbSysfsReader m_reader;
 
 };
 
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#ifndef DETECTOR_IBQOSCOUNTERS_H
+#define DETECTOR_IBQOSCOUNTERS_H
+
+#define NUM_QOS_LEVELS 16
+
+#include <cstdint>
+
+namespace Detector {
+
+/**
+ * Identifies a PMA-attribute, that holds one counter per service level or virtual lane.
+ */
+enum IbQosAttribute {
+    QOS_XMIT_DATA_SL,
+    QOS_RCV_DATA_SL,
+    QOS_XMIT_WAIT_VL,
+    NUM_QOS_ATTRIBUTES
+};
+
+/**
+ * Get the bit, that represents a single QoS-attribute in a mask.
+ *
+ * @param attribute The attribute
+ */
+constexpr uint8_t QosAttributeBit(IbQosAttribute attribute) {
+    return static_cast<uint8_t>(1u << attribute);
+}
+
+/**
+ * The values of the per-SL and per-VL counters of a port at a single point in time.
+ *
+ * The data counters (QOS_XMIT_DATA_SL, QOS_RCV_DATA_SL) are indexed by service level and are given in the same
+ * unit as COUNTER_XMIT_DATA_BYTES and COUNTER_RCV_DATA_BYTES, so that their sum equals the port's total.
+ * The wait counters (QOS_XMIT_WAIT_VL) are indexed by virtual lane and are given in ticks, like COUNTER_XMIT_WAIT.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+struct IbQosCounters {
+    /**
+     * The time, at which the counters have been read (in nanoseconds on CLOCK_MONOTONIC).
+     * A value of 0 means, that the counters have not been read yet.
+     */
+    uint64_t timestamp;
+
+    /**
+     * The counter values, indexed by IbQosAttribute and service level or virtual lane.
+     */
+    uint64_t values[NUM_QOS_ATTRIBUTES][NUM_QOS_LEVELS];
+};
+
+}
+
+#endif
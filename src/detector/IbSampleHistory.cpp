@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <algorithm>
+#include "IbSampleHistory.h"
+
+namespace Detector {
+
+IbSampleHistory::IbSampleHistory(size_t capacity) :
+        m_capacity(capacity > 0 ? capacity : 1),
+        m_slots(new IbSeqLockedSnapshot[m_capacity]),
+        m_numPushed(0),
+        m_lastTimestamp(0) {
+
+}
+
+IbSampleHistory::~IbSampleHistory() {
+    delete[] m_slots;
+}
+
+void IbSampleHistory::Push(const IbPerfSnapshot &snapshot) {
+    if (snapshot.timestamp == 0 || snapshot.timestamp == m_lastTimestamp) {
+        return;
+    }
+
+    m_lastTimestamp = snapshot.timestamp;
+
+    uint64_t number = m_numPushed.load(std::memory_order_relaxed);
+
+    m_slots[number % m_capacity].Store(snapshot);
+    m_numPushed.store(number + 1, std::memory_order_release);
+}
+
+size_t IbSampleHistory::GetLatest(IbPerfSnapshot *samples, size_t maxSamples) const {
+    uint64_t numPushed = m_numPushed.load(std::memory_order_acquire);
+    uint64_t count = std::min<uint64_t>(std::min<uint64_t>(maxSamples, m_capacity), numPushed);
+    size_t numCopied = 0;
+
+    for (uint64_t number = numPushed - count; number < numPushed; number++) {
+        uint64_t sequence;
+
+        // The slot holds the sample with this number, if it has been written exactly (number / capacity + 1) times.
+        if (m_slots[number % m_capacity].TryLoad(samples[numCopied], sequence) &&
+            sequence == 2 * (number / m_capacity + 1)) {
+            numCopied++;
+        }
+    }
+
+    return numCopied;
+}
+
+}
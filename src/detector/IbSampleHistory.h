@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBSAMPLEHISTORY_H
+#define DETECTOR_IBSAMPLEHISTORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "IbPerfSnapshot.h"
+#include "IbSeqLockedSnapshot.h"
+
+namespace Detector {
+
+/**
+ * A fixed-size ring buffer, that keeps the most recent snapshots of a port or node.
+ *
+ * The ring is written by a single thread (the one, that refreshes the counters) and can be read by any amount of
+ * threads at the same time. Neither side ever blocks: Every slot is an IbSeqLockedSnapshot, whose sequence number
+ * also tells, how often the slot has been written. If a slot has been changed, while a reader copies it,
+ * the sample has been overwritten and is skipped.
+ *
+ * All memory is allocated by the constructor.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbSampleHistory {
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param capacity The maximum amount of samples, that are kept (0 is treated as 1)
+     */
+    explicit IbSampleHistory(size_t capacity);
+
+    /**
+     * Destructor.
+     */
+    ~IbSampleHistory();
+
+    IbSampleHistory(const IbSampleHistory &copy) = delete;
+
+    IbSampleHistory &operator=(const IbSampleHistory &copy) = delete;
+
+    /**
+     * Append a sample, overwriting the oldest one, if the history is full.
+     * Samples without a timestamp or with the same timestamp as the last sample are ignored,
+     * so that a counter, whose refresh has failed, does not record its old values again.
+     *
+     * CAUTION: This function must only be called by a single thread.
+     *
+     * @param snapshot The sample
+     */
+    void Push(const IbPerfSnapshot &snapshot);
+
+    /**
+     * Copy the most recent samples, ordered from the oldest to the newest one.
+     * Samples, that are overwritten while being copied, are left out.
+     *
+     * @param samples The array to copy the samples to
+     * @param maxSamples The maximum amount of samples to copy
+     *
+     * @return The amount of copied samples
+     */
+    size_t GetLatest(IbPerfSnapshot *samples, size_t maxSamples) const;
+
+    /**
+     * Get the maximum amount of samples, that are kept.
+     */
+    size_t GetCapacity() const {
+        return m_capacity;
+    }
+
+    /**
+     * Get the amount of samples, that have been pushed since the history has been created.
+     */
+    uint64_t GetNumPushed() const {
+        return m_numPushed.load(std::memory_order_acquire);
+    }
+
+private:
+    /**
+     * The maximum amount of samples.
+     */
+    size_t m_capacity;
+
+    /**
+     * The ring's slots.
+     */
+    IbSeqLockedSnapshot *m_slots;
+
+    /**
+     * The amount of samples, that have been pushed. The next sample is written to m_slots[m_numPushed % m_capacity].
+     */
+    std::atomic<uint64_t> m_numPushed;
+
+    /**
+     * The timestamp of the last sample. Only accessed by the writer.
+     */
+    uint64_t m_lastTimestamp;
+};
+
+}
+
+#endif
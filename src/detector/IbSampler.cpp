@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <ctime>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "IbSampler.h"
+#include "detector/exception/IbFileException.h"
+
+namespace Detector {
+
+IbSampler::IbSampler(std::chrono::nanoseconds period) :
+        m_period(period.count() > 0 ? period : std::chrono::nanoseconds(1)),
+        m_timerFd(-1),
+        m_nextSweepNumber(0),
+        m_numOverruns(0),
+        m_lastSweep{0, 0, 0, 0} {
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+
+    if (m_timerFd < 0) {
+        throw IbFileException("Unable to create timer (timerfd_create failed)! Error: " +
+                              std::string(strerror(errno)));
+    }
+
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // The first deadline is now, all further deadlines are multiples of the period after it.
+    // Since the timer is absolute, the kernel keeps the deadlines on this grid, no matter how long a sweep takes.
+    itimerspec schedule{};
+    schedule.it_value = now;
+    schedule.it_interval.tv_sec = static_cast<time_t>(m_period.count() / 1000000000);
+    schedule.it_interval.tv_nsec = static_cast<long>(m_period.count() % 1000000000);
+
+    if (timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &schedule, nullptr) < 0) {
+        int error = errno;
+        close(m_timerFd);
+
+        throw IbFileException("Unable to start timer (timerfd_settime failed)! Error: " + std::string(strerror(error)));
+    }
+}
+
+IbSampler::~IbSampler() {
+    close(m_timerFd);
+}
+
+IbSampler::Sweep IbSampler::Sample(const std::function<void()> &refresh) {
+    uint64_t expirations = WaitForDeadline();
+
+    m_lastSweep.number = m_nextSweepNumber++;
+    m_lastSweep.missedPeriods = expirations - 1;
+    m_lastSweep.startTime = GetMonotonicTime();
+
+    if (m_lastSweep.missedPeriods > 0) {
+        m_numOverruns++;
+    }
+
+    try {
+        refresh();
+    } catch (...) {
+        m_lastSweep.endTime = GetMonotonicTime();
+        throw;
+    }
+
+    m_lastSweep.endTime = GetMonotonicTime();
+
+    return m_lastSweep;
+}
+
+uint64_t IbSampler::GetMonotonicTime() {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+}
+
+uint64_t IbSampler::WaitForDeadline() {
+    uint64_t expirations = 0;
+
+    while (read(m_timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        if (errno != EINTR) {
+            throw IbFileException("Unable to read timer! Error: " + std::string(strerror(errno)));
+        }
+    }
+
+    return expirations;
+}
+
+}
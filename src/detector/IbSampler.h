@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBSAMPLER_H
+#define DETECTOR_IBSAMPLER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace Detector {
+
+/**
+ * Runs a refresh function at a fixed rate.
+ *
+ * The schedule is kept by a timerfd with absolute deadlines on CLOCK_MONOTONIC, which are placed on a fixed grid
+ * starting at the sampler's creation. In contrary to sleeping for the period after every refresh, the time needed
+ * for a refresh does not delay the following sweeps. If a sweep takes longer than a period, the missed deadlines
+ * are reported as an overrun and the next sweep starts immediately.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbSampler {
+
+public:
+    /**
+     * Timing information about a single sweep.
+     */
+    struct Sweep {
+        /**
+         * The sweep's sequence number, starting at 0.
+         */
+        uint64_t number;
+
+        /**
+         * The time, at which the refresh has been started (in nanoseconds on CLOCK_MONOTONIC).
+         */
+        uint64_t startTime;
+
+        /**
+         * The time, at which the refresh has finished (in nanoseconds on CLOCK_MONOTONIC).
+         */
+        uint64_t endTime;
+
+        /**
+         * The amount of deadlines, that have passed without a sweep, because the previous sweep took too long.
+         */
+        uint64_t missedPeriods;
+    };
+
+public:
+    /**
+     * Constructor.
+     *
+     * The first deadline is the time of construction, so the first call of Sample() does not wait.
+     *
+     * @param period The time between the start of two sweeps
+     */
+    explicit IbSampler(std::chrono::nanoseconds period);
+
+    /**
+     * Destructor.
+     */
+    ~IbSampler();
+
+    IbSampler(const IbSampler &copy) = delete;
+
+    IbSampler &operator=(const IbSampler &copy) = delete;
+
+    /**
+     * Wait for the next deadline and execute a sweep.
+     *
+     * If the refresh function throws an exception, the sweep is still recorded and the exception is passed on.
+     *
+     * @param refresh The function, that refreshes the counters
+     *
+     * @return Timing information about the sweep
+     */
+    Sweep Sample(const std::function<void()> &refresh);
+
+    /**
+     * Get the time between the start of two sweeps.
+     */
+    std::chrono::nanoseconds GetPeriod() const {
+        return m_period;
+    }
+
+    /**
+     * Get timing information about the last sweep.
+     */
+    const Sweep &GetLastSweep() const {
+        return m_lastSweep;
+    }
+
+    /**
+     * Get the amount of sweeps, that have missed at least one deadline.
+     */
+    uint64_t GetNumOverruns() const {
+        return m_numOverruns;
+    }
+
+    /**
+     * Get the current time on CLOCK_MONOTONIC in nanoseconds.
+     */
+    static uint64_t GetMonotonicTime();
+
+private:
+    /**
+     * Block until the timer expires.
+     *
+     * @return The amount of expirations since the last call
+     */
+    uint64_t WaitForDeadline();
+
+private:
+    /**
+     * The time between the start of two sweeps.
+     */
+    std::chrono::nanoseconds m_period;
+
+    /**
+     * The timerfd, that keeps the schedule.
+     */
+    int m_timerFd;
+
+    /**
+     * The sequence number of the next sweep.
+     */
+    uint64_t m_nextSweepNumber;
+
+    /**
+     * The amount of sweeps, that have missed at least one deadline.
+     */
+    uint64_t m_numOverruns;
+
+    /**
+     * Timing information about the last sweep.
+     */
+    Sweep m_lastSweep;
+};
+
+}
+
+#endif
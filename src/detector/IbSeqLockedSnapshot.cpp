@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <thread>
+#include "IbSeqLockedSnapshot.h"
+
+namespace Detector {
+
+IbSeqLockedSnapshot::IbSeqLockedSnapshot() :
+        m_sequence(0) {
+    for (std::atomic<uint64_t> &word : m_data) {
+        word.store(0, std::memory_order_relaxed);
+    }
+}
+
+void IbSeqLockedSnapshot::Store(const IbPerfSnapshot &snapshot) {
+    uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+
+    // Mark the snapshot as being written. The fence keeps the following stores from becoming visible before this one.
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_data[0].store(snapshot.timestamp, std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        m_data[i + 1].store(snapshot.values[i], std::memory_order_relaxed);
+    }
+
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+IbPerfSnapshot IbSeqLockedSnapshot::Load() const {
+    IbPerfSnapshot snapshot{};
+    uint64_t sequence;
+
+    while (!TryLoad(snapshot, sequence)) {
+        std::this_thread::yield();
+    }
+
+    return snapshot;
+}
+
+bool IbSeqLockedSnapshot::TryLoad(IbPerfSnapshot &snapshot, uint64_t &sequence) const {
+    sequence = m_sequence.load(std::memory_order_acquire);
+
+    if (sequence & 1u) {
+        return false;
+    }
+
+    snapshot.timestamp = m_data[0].load(std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        snapshot.values[i] = m_data[i + 1].load(std::memory_order_relaxed);
+    }
+
+    // Check, that the writer has not started to change the snapshot, while we were copying it.
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return m_sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBSEQLOCKEDSNAPSHOT_H
+#define DETECTOR_IBSEQLOCKEDSNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include "IbPerfSnapshot.h"
+
+namespace Detector {
+
+/**
+ * Holds a single snapshot, that is written by one thread and can be read by any amount of threads (seqlock).
+ *
+ * The sequence number is odd, while the writer is changing the snapshot. A reader copies the snapshot and checks,
+ * that the sequence number has been even and unchanged before and afterwards. Otherwise, it tries again.
+ * The writer never waits for readers. The snapshot is stored in atomic words, so that copying it
+ * while it is being written does not invoke undefined behaviour.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbSeqLockedSnapshot {
+
+public:
+    /**
+     * Constructor.
+     *
+     * Initializes the snapshot with zeros and the sequence number with 0.
+     */
+    IbSeqLockedSnapshot();
+
+    /**
+     * Destructor.
+     */
+    ~IbSeqLockedSnapshot() = default;
+
+    IbSeqLockedSnapshot(const IbSeqLockedSnapshot &copy) = delete;
+
+    IbSeqLockedSnapshot &operator=(const IbSeqLockedSnapshot &copy) = delete;
+
+    /**
+     * Replace the snapshot. Increases the sequence number by 2.
+     *
+     * CAUTION: This function must not be called by more than one thread at a time.
+     *
+     * @param snapshot The new snapshot
+     */
+    void Store(const IbPerfSnapshot &snapshot);
+
+    /**
+     * Copy the snapshot. Retries, until the copy is consistent.
+     */
+    IbPerfSnapshot Load() const;
+
+    /**
+     * Try to copy the snapshot once.
+     *
+     * @param snapshot The snapshot to copy to
+     * @param sequence Set to the sequence number, that the copied snapshot belongs to
+     *
+     * @return true, if the copy is consistent, false, if the snapshot has been written in the meantime
+     */
+    bool TryLoad(IbPerfSnapshot &snapshot, uint64_t &sequence) const;
+
+    /**
+     * Get the current sequence number. It equals 2 * (the amount of completed Store()-calls), if no Store() is running.
+     */
+    uint64_t GetSequence() const {
+        return m_sequence.load(std::memory_order_acquire);
+    }
+
+private:
+    /**
+     * Odd, while the snapshot is being written.
+     */
+    std::atomic<uint64_t> m_sequence;
+
+    /**
+     * The timestamp, followed by the counter values.
+     */
+    std::atomic<uint64_t> m_data[NUM_COUNTERS + 1];
+};
+
+}
+
+#endif
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "IbSysfsBatch.h"
+#include "IbSampler.h"
+#include "detector/exception/IbFileException.h"
+
+namespace Detector {
+
+IbSysfsBatch::IbSysfsBatch() :
+        m_ringFd(-1),
+        m_sqRing(nullptr),
+        m_sqRingSize(0),
+        m_cqRing(nullptr),
+        m_cqRingSize(0),
+        m_sqes(nullptr),
+        m_sqesSize(0) {
+    SetupRing();
+}
+
+IbSysfsBatch::~IbSysfsBatch() {
+    DestroyRing();
+}
+
+void IbSysfsBatch::Register(IbSysfsReader &reader) {
+    for (size_t i = 0; i < reader.GetNumFiles(); i++) {
+        if (reader.IsFileEnabled(i)) {
+            m_entries.push_back(Entry{&reader, i});
+        }
+    }
+
+    // The buffers may have moved, so all I/O vectors need to be rebuilt.
+    m_buffers.resize(m_entries.size() * SYSFS_READ_BUF_SIZE);
+    m_iovecs.resize(m_entries.size());
+
+    for (size_t i = 0; i < m_entries.size(); i++) {
+        m_iovecs[i].iov_base = &m_buffers[i * SYSFS_READ_BUF_SIZE];
+        m_iovecs[i].iov_len = SYSFS_READ_BUF_SIZE;
+    }
+}
+
+void IbSysfsBatch::Clear() {
+    m_entries.clear();
+    m_buffers.clear();
+    m_iovecs.clear();
+}
+
+#if USE_IO_URING
+
+void IbSysfsBatch::SetupRing() {
+    std::memset(&m_params, 0, sizeof(m_params));
+
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, SYSFS_BATCH_RING_ENTRIES, &m_params));
+
+    if (fd < 0) {
+        return;
+    }
+
+    m_sqRingSize = m_params.sq_off.array + m_params.sq_entries * sizeof(uint32_t);
+    m_cqRingSize = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+    m_sqesSize = m_params.sq_entries * sizeof(io_uring_sqe);
+
+    // Since Linux 5.4, both rings can be mapped with a single call.
+    bool isSingleMmap = (m_params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+    if (isSingleMmap) {
+        m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+    if (m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        close(fd);
+        return;
+    }
+
+    if (isSingleMmap) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                        IORING_OFF_CQ_RING);
+
+        if (m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            munmap(m_sqRing, m_sqRingSize);
+            m_sqRing = nullptr;
+            close(fd);
+            return;
+        }
+    }
+
+    m_sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (m_sqes == MAP_FAILED) {
+        m_sqes = nullptr;
+        m_ringFd = fd;
+        DestroyRing();
+        return;
+    }
+
+    m_ringFd = fd;
+}
+
+void IbSysfsBatch::DestroyRing() {
+    if (m_sqes != nullptr) {
+        munmap(m_sqes, m_sqesSize);
+    }
+
+    if (m_cqRing != nullptr && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+
+    if (m_sqRing != nullptr) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+
+    if (m_ringFd >= 0) {
+        close(m_ringFd);
+    }
+
+    m_sqes = nullptr;
+    m_cqRing = nullptr;
+    m_sqRing = nullptr;
+    m_ringFd = -1;
+}
+
+void IbSysfsBatch::Submit() {
+    if (m_ringFd < 0 || m_entries.empty()) {
+        return;
+    }
+
+    for (const Entry &entry : m_entries) {
+        entry.reader->m_hasBufferedValues = false;
+    }
+
+    for (size_t begin = 0; begin < m_entries.size(); begin += m_params.sq_entries) {
+        SubmitRange(begin, std::min<size_t>(m_params.sq_entries, m_entries.size() - begin));
+    }
+
+    for (const Entry &entry : m_entries) {
+        entry.reader->m_hasBufferedValues = true;
+    }
+}
+
+void IbSysfsBatch::SubmitRange(size_t begin, size_t count) {
+    auto *sqRing = static_cast<uint8_t *>(m_sqRing);
+    auto *cqRing = static_cast<uint8_t *>(m_cqRing);
+
+    auto *sqTail = reinterpret_cast<uint32_t *>(sqRing + m_params.sq_off.tail);
+    auto *sqArray = reinterpret_cast<uint32_t *>(sqRing + m_params.sq_off.array);
+    uint32_t sqMask = *reinterpret_cast<uint32_t *>(sqRing + m_params.sq_off.ring_mask);
+
+    auto *cqHead = reinterpret_cast<uint32_t *>(cqRing + m_params.cq_off.head);
+    auto *cqTail = reinterpret_cast<uint32_t *>(cqRing + m_params.cq_off.tail);
+    auto *cqes = reinterpret_cast<io_uring_cqe *>(cqRing + m_params.cq_off.cqes);
+    uint32_t cqMask = *reinterpret_cast<uint32_t *>(cqRing + m_params.cq_off.ring_mask);
+
+    auto *sqes = static_cast<io_uring_sqe *>(m_sqes);
+
+    // Only this thread writes the submission queue's tail, so it can be read without synchronization.
+    uint32_t tail = *sqTail;
+
+    for (size_t i = begin; i < begin + count; i++) {
+        const Entry &entry = m_entries[i];
+        uint32_t index = tail & sqMask;
+        io_uring_sqe *sqe = &sqes[index];
+
+        // IORING_OP_READV is used instead of IORING_OP_READ, because it is available since the first io_uring kernel.
+        std::memset(sqe, 0, sizeof(io_uring_sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = entry.reader->m_fds[entry.index];
+        sqe->addr = reinterpret_cast<uint64_t>(&m_iovecs[i]);
+        sqe->len = 1;
+        sqe->off = 0;
+        sqe->user_data = i;
+
+        sqArray[index] = index;
+        tail++;
+    }
+
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+    size_t toSubmit = count;
+    size_t numCompleted = 0;
+    int error = 0;
+    uint64_t submitTime = IbSampler::GetMonotonicTime();
+
+    while (numCompleted < count) {
+        // Submit all reads and wait for all of them to complete with a single system call.
+        long ret = syscall(__NR_io_uring_enter, m_ringFd, toSubmit, count - numCompleted, IORING_ENTER_GETEVENTS,
+                           nullptr, 0);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw IbFileException("Unable to submit reads (io_uring_enter failed)! Error: " +
+                                  std::string(strerror(errno)));
+        }
+
+        toSubmit -= std::min<size_t>(toSubmit, static_cast<size_t>(ret));
+
+        uint32_t head = *cqHead;
+        uint32_t completedTail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+        for (; head != completedTail; head++) {
+            const io_uring_cqe &cqe = cqes[head & cqMask];
+            const Entry &entry = m_entries[cqe.user_data];
+
+            if (cqe.res < 0) {
+                error = -cqe.res;
+            } else {
+                entry.reader->m_bufferedValues[entry.index] = IbSysfsReader::ParseUnsigned(
+                        &m_buffers[cqe.user_data * SYSFS_READ_BUF_SIZE], static_cast<size_t>(cqe.res));
+            }
+
+            numCompleted++;
+        }
+
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    if (error != 0) {
+        throw IbFileException("Unable to read file! Error: " + std::string(strerror(error)));
+    }
+
+    // All reads of this range have been executed between submitting and reaping them.
+    uint64_t timestamp = submitTime + (IbSampler::GetMonotonicTime() - submitTime) / 2;
+
+    for (size_t i = begin; i < begin + count; i++) {
+        m_entries[i].reader->m_bufferedTimestamp = timestamp;
+    }
+}
+
+#else
+
+void IbSysfsBatch::SetupRing() {
+
+}
+
+void IbSysfsBatch::DestroyRing() {
+
+}
+
+void IbSysfsBatch::Submit() {
+
+}
+
+void IbSysfsBatch::SubmitRange(size_t begin, size_t count) {
+
+}
+
+#endif
+
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBSYSFSBATCH_H
+#define DETECTOR_IBSYSFSBATCH_H
+
+#include <sys/syscall.h>
+
+// io_uring is only used, if the kernel headers provide it. Otherwise, the batch always falls back to synchronous reads.
+#ifndef USE_IO_URING
+#if defined(__has_include) && defined(__NR_io_uring_setup)
+#if __has_include(<linux/io_uring.h>)
+#define USE_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifndef USE_IO_URING
+#define USE_IO_URING 0
+#endif
+
+#define SYSFS_BATCH_RING_ENTRIES 256
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <sys/uio.h>
+#include "IbSysfsReader.h"
+
+#if USE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace Detector {
+
+/**
+ * Reads the counter files of many IbSysfsReaders with a single io_uring submission.
+ *
+ * Submit() queues one read for every file of every registered reader, submits them all at once and collects
+ * the completions with the same system call. The values are then buffered in the readers, so that their next
+ * refresh does not need any system calls at all.
+ *
+ * If io_uring is not available (old kernel, seccomp, missing headers), Submit() does nothing
+ * and the readers keep reading their files synchronously.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbSysfsBatch {
+
+public:
+    /**
+     * Constructor.
+     *
+     * Tries to set up an io_uring instance. Failing to do so is not an error.
+     */
+    IbSysfsBatch();
+
+    /**
+     * Destructor.
+     */
+    ~IbSysfsBatch();
+
+    IbSysfsBatch(const IbSysfsBatch &copy) = delete;
+
+    IbSysfsBatch &operator=(const IbSysfsBatch &copy) = delete;
+
+    /**
+     * Add all files of a reader to the batch. The reader must outlive the batch or be removed via Clear().
+     *
+     * @param reader The reader
+     */
+    void Register(IbSysfsReader &reader);
+
+    /**
+     * Remove all readers from the batch.
+     */
+    void Clear();
+
+    /**
+     * Read all registered files and buffer the values in their readers.
+     * Does nothing, if io_uring is not available.
+     */
+    void Submit();
+
+    /**
+     * Check, whether io_uring is available. If not, Submit() does nothing.
+     */
+    bool IsAvailable() const {
+        return m_ringFd >= 0;
+    }
+
+    /**
+     * Get the amount of registered files.
+     */
+    size_t GetNumFiles() const {
+        return m_entries.size();
+    }
+
+private:
+    /**
+     * A single file of a registered reader.
+     */
+    struct Entry {
+        /**
+         * The reader, that the file belongs to.
+         */
+        IbSysfsReader *reader;
+
+        /**
+         * The file's index inside the reader.
+         */
+        size_t index;
+    };
+
+    /**
+     * Set up the io_uring instance and map its rings into memory.
+     */
+    void SetupRing();
+
+    /**
+     * Unmap the rings and close the io_uring instance.
+     */
+    void DestroyRing();
+
+    /**
+     * Queue, submit and complete the reads for a contiguous range of entries.
+     *
+     * @param begin Index of the first entry
+     * @param count The amount of entries (at most the size of the submission queue)
+     */
+    void SubmitRange(size_t begin, size_t count);
+
+private:
+    /**
+     * The io_uring's file descriptor (-1, if io_uring is not available).
+     */
+    int m_ringFd;
+
+    /**
+     * All registered files.
+     */
+    std::vector<Entry> m_entries;
+
+    /**
+     * One buffer of SYSFS_READ_BUF_SIZE bytes per registered file.
+     */
+    std::vector<char> m_buffers;
+
+    /**
+     * One I/O vector per registered file, pointing into m_buffers.
+     */
+    std::vector<iovec> m_iovecs;
+
+#if USE_IO_URING
+    /**
+     * The parameters, that have been returned by io_uring_setup().
+     */
+    io_uring_params m_params;
+#endif
+
+    /**
+     * The mapped submission queue ring.
+     */
+    void *m_sqRing;
+
+    /**
+     * The size of the mapping of the submission queue ring.
+     */
+    size_t m_sqRingSize;
+
+    /**
+     * The mapped completion queue ring. Equals m_sqRing, if the kernel maps both rings at once.
+     */
+    void *m_cqRing;
+
+    /**
+     * The size of the mapping of the completion queue ring.
+     */
+    size_t m_cqRingSize;
+
+    /**
+     * The mapped array of submission queue entries.
+     */
+    void *m_sqes;
+
+    /**
+     * The size of the mapping of the submission queue entries.
+     */
+    size_t m_sqesSize;
+};
+
+}
+
+#endif
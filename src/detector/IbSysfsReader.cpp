@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "IbSysfsReader.h"
+#include "detector/exception/IbFileException.h"
+
+namespace Detector {
+
+IbSysfsReader::IbSysfsReader(const std::string &directory, const char *const *fileNames, size_t numFiles) :
+        m_bufferedValues(numFiles, 0),
+        m_isFileEnabled(numFiles, true),
+        m_bufferedTimestamp(0),
+        m_hasBufferedValues(false) {
+    m_fds.reserve(numFiles);
+
+    for (size_t i = 0; i < numFiles; i++) {
+        std::string path = directory + fileNames[i];
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+            int error = errno;
+
+            for (int openFd : m_fds) {
+                close(openFd);
+            }
+
+            throw IbFileException("Unable to open file '" + path + "'! Error: " + strerror(error));
+        }
+
+        m_fds.push_back(fd);
+    }
+}
+
+IbSysfsReader::~IbSysfsReader() {
+    for (int fd : m_fds) {
+        close(fd);
+    }
+}
+
+uint64_t IbSysfsReader::Read(size_t index) const {
+    if (m_hasBufferedValues) {
+        return m_bufferedValues[index];
+    }
+
+    char buffer[SYSFS_READ_BUF_SIZE];
+
+    // sysfs generates the file's content anew on every read from offset 0,
+    // so there is no need to seek or reopen the file.
+    ssize_t length = pread(m_fds[index], buffer, sizeof(buffer), 0);
+
+    if (length < 0) {
+        throw IbFileException("Unable to read file! Error: " + std::string(strerror(errno)));
+    }
+
+    return ParseUnsigned(buffer, static_cast<size_t>(length));
+}
+
+uint64_t IbSysfsReader::ParseUnsigned(const char *buffer, size_t length) {
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        auto digit = static_cast<uint8_t>(buffer[i] - '0');
+
+        if (digit > 9) {
+            break;
+        }
+
+        value = value * 10 + digit;
+    }
+
+    return value;
+}
+
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBSYSFSREADER_H
+#define DETECTOR_IBSYSFSREADER_H
+
+#define SYSFS_READ_BUF_SIZE 32
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Detector {
+
+class IbSysfsBatch;
+
+/**
+ * Reads numeric counter values from a set of files in a sysfs-directory.
+ *
+ * All files are opened once by the constructor. Reading a counter is a single pread() into a buffer on the stack,
+ * followed by a simple decimal parser. No memory is allocated and no stream state is involved.
+ *
+ * A reader can be registered at an IbSysfsBatch, which reads the files of many readers with a single submission.
+ * The values of the last submission are buffered and returned by Read(), until DiscardBufferedValues() is called.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbSysfsReader {
+
+    friend class IbSysfsBatch;
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param directory The directory, that contains the files (including a trailing '/')
+     * @param fileNames The names of the files
+     * @param numFiles The amount of files
+     */
+    IbSysfsReader(const std::string &directory, const char *const *fileNames, size_t numFiles);
+
+    /**
+     * Destructor.
+     */
+    ~IbSysfsReader();
+
+    IbSysfsReader(const IbSysfsReader &copy) = delete;
+
+    IbSysfsReader &operator=(const IbSysfsReader &copy) = delete;
+
+    /**
+     * Read the current value of a counter.
+     * If the reader holds buffered values from an IbSysfsBatch, the buffered value is returned instead.
+     *
+     * @param index Index into the file names, that have been passed to the constructor
+     */
+    uint64_t Read(size_t index) const;
+
+    /**
+     * Check, whether the reader holds values, that have been read by an IbSysfsBatch.
+     */
+    bool HasBufferedValues() const {
+        return m_hasBufferedValues;
+    }
+
+    /**
+     * Get the time, at which the buffered values have been read (in nanoseconds on CLOCK_MONOTONIC).
+     */
+    uint64_t GetBufferedTimestamp() const {
+        return m_bufferedTimestamp;
+    }
+
+    /**
+     * Drop the values, that have been read by an IbSysfsBatch, so that Read() accesses the files again.
+     */
+    void DiscardBufferedValues() {
+        m_hasBufferedValues = false;
+    }
+
+    /**
+     * Get the amount of files.
+     */
+    size_t GetNumFiles() const {
+        return m_fds.size();
+    }
+
+    /**
+     * Choose, whether a file is read by an IbSysfsBatch (default: enabled).
+     * Batches, that the reader has already been registered at, need to be set up again.
+     *
+     * @param index Index into the file names, that have been passed to the constructor
+     * @param enabled Set to false, to leave the file out of batches
+     */
+    void SetFileEnabled(size_t index, bool enabled) {
+        m_isFileEnabled[index] = enabled;
+    }
+
+    /**
+     * Check, whether a file is read by an IbSysfsBatch.
+     *
+     * @param index Index into the file names, that have been passed to the constructor
+     */
+    bool IsFileEnabled(size_t index) const {
+        return m_isFileEnabled[index];
+    }
+
+    /**
+     * Parse an unsigned decimal number. Parsing stops at the first character, that is not a digit.
+     *
+     * @param buffer The characters to parse
+     * @param length The amount of characters in the buffer
+     */
+    static uint64_t ParseUnsigned(const char *buffer, size_t length);
+
+private:
+    /**
+     * The file descriptors of all files.
+     */
+    std::vector<int> m_fds;
+
+    /**
+     * The values, that have been read by an IbSysfsBatch.
+     */
+    std::vector<uint64_t> m_bufferedValues;
+
+    /**
+     * Whether the files are read by an IbSysfsBatch.
+     */
+    std::vector<bool> m_isFileEnabled;
+
+    /**
+     * The time, at which m_bufferedValues have been read.
+     */
+    uint64_t m_bufferedTimestamp;
+
+    /**
+     * Whether m_bufferedValues contains values, that have not been consumed yet.
+     */
+    bool m_hasBufferedValues;
+};
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "IbTopologyCache.h"
+#include "detector/exception/IbFileException.h"
+
+namespace Detector {
+
+static const char TOPOLOGY_CACHE_MAGIC[8] = {'I', 'B', 'D', 'T', 'O', 'P', 'O', '\0'};
+
+IbTopologyCache::IbTopologyCache(const std::string &path) :
+        m_data(nullptr),
+        m_size(0),
+        m_header(nullptr),
+        m_nodes(nullptr),
+        m_ports(nullptr) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        throw IbFileException("Unable to open topology cache '" + path + "'! Error: " + strerror(errno));
+    }
+
+    struct stat fileStat{};
+
+    if (fstat(fd, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) < sizeof(Header)) {
+        close(fd);
+        throw IbFileException("Topology cache '" + path + "' is too small!");
+    }
+
+    m_size = static_cast<size_t>(fileStat.st_size);
+    m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping stays valid after the file descriptor has been closed.
+    close(fd);
+
+    if (m_data == MAP_FAILED) {
+        throw IbFileException("Unable to map topology cache '" + path + "'! Error: " + strerror(errno));
+    }
+
+    m_header = static_cast<const Header *>(m_data);
+    m_nodes = reinterpret_cast<const NodeRecord *>(m_header + 1);
+    m_ports = reinterpret_cast<const PortRecord *>(m_nodes + m_header->numNodes);
+
+    bool isValid = memcmp(m_header->magic, TOPOLOGY_CACHE_MAGIC, sizeof(TOPOLOGY_CACHE_MAGIC)) == 0 &&
+                   m_header->version == TOPOLOGY_CACHE_VERSION &&
+                   m_header->byteOrder == TOPOLOGY_CACHE_BYTE_ORDER &&
+                   m_size == sizeof(Header) + static_cast<size_t>(m_header->numNodes) * sizeof(NodeRecord) +
+                             static_cast<size_t>(m_header->numPorts) * sizeof(PortRecord);
+
+    for (uint32_t i = 0; isValid && i < m_header->numNodes; i++) {
+        isValid = static_cast<uint64_t>(m_nodes[i].firstPort) + m_nodes[i].numPortRecords <= m_header->numPorts;
+    }
+
+    if (!isValid) {
+        munmap(m_data, m_size);
+        throw IbFileException("Topology cache '" + path + "' is invalid!");
+    }
+}
+
+IbTopologyCache::~IbTopologyCache() {
+    munmap(m_data, m_size);
+}
+
+IbPort::Capabilities IbTopologyCache::GetPortCapabilities(const NodeRecord &node, uint32_t index) const {
+    const PortRecord &record = m_ports[node.firstPort + index];
+    IbPort::Capabilities capabilities{};
+
+    capabilities.lid = record.lid;
+    capabilities.portNum = record.portNum;
+    capabilities.nodeType = record.nodeType;
+    capabilities.linkWidth = record.linkWidth;
+    capabilities.capabilityMask = record.capabilityMask;
+    capabilities.capabilityMask2 = record.capabilityMask2;
+    capabilities.hasClassPortInfo = record.hasClassPortInfo != 0;
+    capabilities.remoteGuid = record.remoteGuid;
+    capabilities.remotePortNum = record.remotePortNum;
+    capabilities.remoteNodeType = record.remoteNodeType;
+
+    return capabilities;
+}
+
+void IbTopologyCache::Save(const std::string &path, const std::vector<IbNode *> &nodes, bool isNetwork,
+                           uint64_t scopeFingerprint) {
+    std::vector<NodeRecord> nodeRecords;
+    std::vector<PortRecord> portRecords;
+    Header header{};
+
+    for (IbNode *node : nodes) {
+        NodeRecord nodeRecord{};
+
+        nodeRecord.guid = node->GetGuid();
+        nodeRecord.firstPort = static_cast<uint32_t>(portRecords.size());
+        nodeRecord.numPortRecords = static_cast<uint16_t>(node->GetPorts().size());
+        nodeRecord.numPorts = node->GetNumPorts();
+        nodeRecord.nodeType = node->GetPorts().empty() ? 0 : node->GetPorts()[0]->GetCapabilities().nodeType;
+        strncpy(nodeRecord.description, node->GetDescription().c_str(), TOPOLOGY_CACHE_DESC_SIZE - 1);
+
+        for (const IbPort *port : node->GetPorts()) {
+            const IbPort::Capabilities &capabilities = port->GetCapabilities();
+            PortRecord portRecord{};
+
+            portRecord.lid = capabilities.lid;
+            portRecord.portNum = capabilities.portNum;
+            portRecord.nodeType = capabilities.nodeType;
+            portRecord.linkWidth = capabilities.linkWidth;
+            portRecord.capabilityMask = capabilities.capabilityMask;
+            portRecord.capabilityMask2 = capabilities.capabilityMask2;
+            portRecord.hasClassPortInfo = static_cast<uint8_t>(capabilities.hasClassPortInfo);
+            portRecord.remoteGuid = capabilities.remoteGuid;
+            portRecord.remotePortNum = capabilities.remotePortNum;
+            portRecord.remoteNodeType = capabilities.remoteNodeType;
+
+            portRecords.push_back(portRecord);
+        }
+
+        nodeRecords.push_back(nodeRecord);
+    }
+
+    memcpy(header.magic, TOPOLOGY_CACHE_MAGIC, sizeof(TOPOLOGY_CACHE_MAGIC));
+    header.version = TOPOLOGY_CACHE_VERSION;
+    header.byteOrder = TOPOLOGY_CACHE_BYTE_ORDER;
+    header.numNodes = static_cast<uint32_t>(nodeRecords.size());
+    header.numPorts = static_cast<uint32_t>(portRecords.size());
+    header.isNetwork = isNetwork ? 1 : 0;
+    header.scopeFingerprint = scopeFingerprint;
+
+    // Write to a temporary file first and rename it afterwards, which atomically replaces the old cache.
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        throw IbFileException("Unable to create topology cache '" + tmpPath + "'! Error: " + strerror(errno));
+    }
+
+    const void *parts[] = {&header, nodeRecords.data(), portRecords.data()};
+    size_t sizes[] = {sizeof(header), nodeRecords.size() * sizeof(NodeRecord),
+                      portRecords.size() * sizeof(PortRecord)};
+
+    for (uint32_t i = 0; i < 3; i++) {
+        auto data = static_cast<const uint8_t *>(parts[i]);
+        size_t written = 0;
+
+        while (written < sizes[i]) {
+            ssize_t ret = write(fd, data + written, sizes[i] - written);
+
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (ret <= 0) {
+                int error = errno;
+
+                close(fd);
+                unlink(tmpPath.c_str());
+
+                throw IbFileException("Unable to write topology cache '" + tmpPath + "'! Error: " + strerror(error));
+            }
+
+            written += static_cast<size_t>(ret);
+        }
+    }
+
+    close(fd);
+
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        int error = errno;
+
+        unlink(tmpPath.c_str());
+
+        throw IbFileException("Unable to replace topology cache '" + path + "'! Error: " + strerror(error));
+    }
+}
+
+}
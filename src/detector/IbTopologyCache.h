@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBTOPOLOGYCACHE_H
+#define DETECTOR_IBTOPOLOGYCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "IbNode.h"
+
+#define TOPOLOGY_CACHE_VERSION 4
+#define TOPOLOGY_CACHE_BYTE_ORDER 0x01020304
+#define TOPOLOGY_CACHE_DESC_SIZE 64
+
+namespace Detector {
+
+/**
+ * A file, that stores the discovered topology of a fabric and the capabilities of all ports.
+ *
+ * The file consists of a header, followed by an array of node records and an array of port records.
+ * All records have a fixed size, so that the file can be mapped into memory and used directly.
+ * Nodes and ports, that are created from the cache, do not send any MADs (see IbPort::Capabilities).
+ * The cache is only valid on machines with the same byte order.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbTopologyCache {
+
+public:
+    /**
+     * The beginning of the file.
+     */
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint32_t numNodes;
+        uint32_t numPorts;
+        uint8_t isNetwork;
+        uint8_t reserved[7];
+        uint64_t scopeFingerprint;
+    };
+
+    /**
+     * Describes a single node.
+     */
+    struct NodeRecord {
+        uint64_t guid;
+        uint32_t firstPort;
+        uint16_t numPortRecords;
+        uint8_t numPorts;
+        uint8_t nodeType;
+        char description[TOPOLOGY_CACHE_DESC_SIZE];
+    };
+
+    /**
+     * Describes a single port (see IbPort::Capabilities).
+     */
+    struct PortRecord {
+        uint16_t lid;
+        uint8_t portNum;
+        uint8_t nodeType;
+        uint8_t linkWidth;
+        uint8_t hasClassPortInfo;
+        uint16_t capabilityMask;
+        uint32_t capabilityMask2;
+        uint8_t remotePortNum;
+        uint8_t remoteNodeType;
+        uint8_t reserved[2];
+        uint64_t remoteGuid;
+    };
+
+    /**
+     * Constructor.
+     *
+     * Maps a cache file into memory and checks, that it is complete and has been written by a compatible version.
+     * Throws an IbFileException, if the file can not be mapped or is invalid.
+     *
+     * @param path The file's path
+     */
+    explicit IbTopologyCache(const std::string &path);
+
+    /**
+     * Destructor.
+     */
+    ~IbTopologyCache();
+
+    IbTopologyCache(const IbTopologyCache &copy) = delete;
+
+    IbTopologyCache &operator=(const IbTopologyCache &copy) = delete;
+
+    /**
+     * Write the topology of a set of nodes to a file.
+     * The file is replaced atomically, so that other processes never map a partially written cache.
+     *
+     * @param path The file's path
+     * @param nodes The nodes
+     * @param isNetwork Whether the nodes have been discovered in the entire network (or only on the local machine)
+     * @param scopeFingerprint The part of the network, that the nodes have been discovered in
+     *                         (see IbDiscoveryOptions::GetScopeFingerprint())
+     */
+    static void Save(const std::string &path, const std::vector<IbNode *> &nodes, bool isNetwork,
+                     uint64_t scopeFingerprint);
+
+    /**
+     * Check, whether the cached nodes have been discovered in the entire network (or only on the local machine).
+     */
+    bool IsNetwork() const {
+        return m_header->isNetwork != 0;
+    }
+
+    /**
+     * Get the fingerprint of the part of the network, that the cached nodes have been discovered in
+     * (see IbDiscoveryOptions::GetScopeFingerprint()).
+     */
+    uint64_t GetScopeFingerprint() const {
+        return m_header->scopeFingerprint;
+    }
+
+    /**
+     * Get the amount of cached nodes.
+     */
+    uint32_t GetNumNodes() const {
+        return m_header->numNodes;
+    }
+
+    /**
+     * Get a cached node.
+     *
+     * @param index The node's index
+     */
+    const NodeRecord &GetNode(uint32_t index) const {
+        return m_nodes[index];
+    }
+
+    /**
+     * Get the capabilities of a cached port.
+     *
+     * @param node The node, that the port belongs to
+     * @param index The port's index inside the node (0 to numPortRecords - 1)
+     */
+    IbPort::Capabilities GetPortCapabilities(const NodeRecord &node, uint32_t index) const;
+
+private:
+    /**
+     * The mapped file.
+     */
+    void *m_data;
+
+    /**
+     * The size of the mapped file.
+     */
+    size_t m_size;
+
+    /**
+     * The file's header.
+     */
+    const Header *m_header;
+
+    /**
+     * The node records.
+     */
+    const NodeRecord *m_nodes;
+
+    /**
+     * The port records.
+     */
+    const PortRecord *m_ports;
+};
+
+}
+
+#endif
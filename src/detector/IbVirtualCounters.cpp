@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IbVirtualCounters.h"
+
+namespace Detector {
+
+IbVirtualCounters::IbVirtualCounters() :
+        m_counters() {
+    for (uint32_t i = 0; i < NUM_COUNTERS; i++) {
+        SetWidth(static_cast<IbCounterId>(i), 64, OVERFLOW_SATURATE);
+    }
+}
+
+void IbVirtualCounters::SetWidth(IbCounterId id, uint8_t width, OverflowBehaviour behaviour) {
+    Counter &counter = m_counters[id];
+
+    counter.width = width == 0 || width > 64 ? 64 : width;
+    counter.maxRaw = counter.width == 64 ? UINT64_MAX : (1ULL << counter.width) - 1;
+    counter.behaviour = behaviour;
+    counter.isSaturated = false;
+}
+
+uint64_t IbVirtualCounters::Update(IbCounterId id, uint64_t raw) {
+    Counter &counter = m_counters[id];
+
+    if (raw > counter.maxRaw) {
+        // The counter is wider than assumed.
+        counter.width = 64;
+        counter.maxRaw = UINT64_MAX;
+    }
+
+    if (!counter.hasLastRaw) {
+        counter.total = raw;
+    } else if (raw >= counter.lastRaw) {
+        counter.total += raw - counter.lastRaw;
+    } else if (counter.behaviour == OVERFLOW_WRAP && counter.width < 64) {
+        counter.total += (counter.maxRaw - counter.lastRaw) + raw + 1;
+        counter.numOverflows++;
+    } else {
+        // The counter has been reset by someone else.
+        counter.total += raw;
+    }
+
+    bool isSaturated = counter.behaviour == OVERFLOW_SATURATE && counter.width < 64 && raw == counter.maxRaw;
+
+    if (isSaturated && !counter.isSaturated) {
+        counter.numOverflows++;
+    }
+
+    counter.isSaturated = isSaturated;
+    counter.lastRaw = raw;
+    counter.hasLastRaw = true;
+
+    return counter.total;
+}
+
+bool IbVirtualCounters::IsAnySaturated() const {
+    for (const Counter &counter : m_counters) {
+        if (counter.isSaturated) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void IbVirtualCounters::RestartCounter(IbCounterId id) {
+    m_counters[id].lastRaw = 0;
+    m_counters[id].isSaturated = false;
+}
+
+void IbVirtualCounters::Reset() {
+    for (Counter &counter : m_counters) {
+        counter.lastRaw = 0;
+        counter.total = 0;
+        counter.numOverflows = 0;
+        counter.hasLastRaw = false;
+        counter.isSaturated = false;
+    }
+}
+
+}
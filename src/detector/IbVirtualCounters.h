@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBVIRTUALCOUNTERS_H
+#define DETECTOR_IBVIRTUALCOUNTERS_H
+
+#include <cstdint>
+#include "IbPerfSnapshot.h"
+
+namespace Detector {
+
+/**
+ * Turns the raw values of counters with less than 64 bits into monotonic 64-bit virtual counters.
+ *
+ * Every counter has a width and an overflow behaviour. A counter, that saturates (like the counters of the
+ * PortCounters-attribute), stops at its maximum value and is marked as saturated, until it is restarted via
+ * RestartCounter() (e.g. after it has been reset on the device). A counter, that wraps, starts again at 0,
+ * which is detected by the raw value becoming smaller. In both cases, the virtual counter keeps the total amount,
+ * that has been counted since the first sample.
+ *
+ * If a raw value does not fit into the configured width, the counter is wider than assumed and is treated as
+ * a 64-bit counter from then on. A 64-bit or saturating counter, whose raw value becomes smaller, has been reset
+ * by someone else. The virtual counter then continues with the new raw value.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbVirtualCounters {
+
+public:
+    /**
+     * What a counter does, when it reaches its maximum value.
+     */
+    enum OverflowBehaviour {
+        OVERFLOW_SATURATE,
+        OVERFLOW_WRAP
+    };
+
+    /**
+     * Constructor.
+     *
+     * All counters are initialized as 64-bit counters.
+     */
+    IbVirtualCounters();
+
+    /**
+     * Destructor.
+     */
+    ~IbVirtualCounters() = default;
+
+    /**
+     * Set the width and overflow behaviour of a counter.
+     *
+     * @param id The counter's id
+     * @param width The amount of bits of the raw value (1 to 64)
+     * @param behaviour What the counter does, when it reaches its maximum value
+     */
+    void SetWidth(IbCounterId id, uint8_t width, OverflowBehaviour behaviour);
+
+    /**
+     * Get the width of a counter. This may be larger than the configured width (see class description).
+     *
+     * @param id The counter's id
+     */
+    uint8_t GetWidth(IbCounterId id) const {
+        return m_counters[id].width;
+    }
+
+    /**
+     * Process a new raw value of a counter.
+     *
+     * @param id The counter's id
+     * @param raw The raw value, as it has been read from the device
+     *
+     * @return The virtual 64-bit value
+     */
+    uint64_t Update(IbCounterId id, uint64_t raw);
+
+    /**
+     * Get the current virtual value of a counter.
+     *
+     * @param id The counter's id
+     */
+    uint64_t GetValue(IbCounterId id) const {
+        return m_counters[id].total;
+    }
+
+    /**
+     * Check, whether a raw value of a counter has been processed since the last Reset().
+     *
+     * @param id The counter's id
+     */
+    bool HasValue(IbCounterId id) const {
+        return m_counters[id].hasLastRaw;
+    }
+
+    /**
+     * Check, whether a counter is currently stuck at its maximum value.
+     *
+     * @param id The counter's id
+     */
+    bool IsSaturated(IbCounterId id) const {
+        return m_counters[id].isSaturated;
+    }
+
+    /**
+     * Check, whether any counter is currently stuck at its maximum value.
+     */
+    bool IsAnySaturated() const;
+
+    /**
+     * Get the amount of times, that a counter has wrapped or saturated.
+     *
+     * @param id The counter's id
+     */
+    uint64_t GetNumOverflows(IbCounterId id) const {
+        return m_counters[id].numOverflows;
+    }
+
+    /**
+     * Tell, that the raw value of a counter has been reset to 0 on the device.
+     * The virtual value is kept and continues counting from there on.
+     *
+     * @param id The counter's id
+     */
+    void RestartCounter(IbCounterId id);
+
+    /**
+     * Forget all values, so that the next raw values are taken as they are (e.g. after all counters have been
+     * reset on the device and the virtual values should start at 0 again). The widths are kept.
+     */
+    void Reset();
+
+private:
+    /**
+     * The state of a single counter.
+     */
+    struct Counter {
+        /**
+         * The maximum raw value.
+         */
+        uint64_t maxRaw;
+
+        /**
+         * The last raw value.
+         */
+        uint64_t lastRaw;
+
+        /**
+         * The virtual value.
+         */
+        uint64_t total;
+
+        /**
+         * The amount of wraps and saturations.
+         */
+        uint64_t numOverflows;
+
+        /**
+         * The amount of bits of the raw value.
+         */
+        uint8_t width;
+
+        /**
+         * What the counter does, when it reaches maxRaw.
+         */
+        OverflowBehaviour behaviour;
+
+        /**
+         * Whether lastRaw holds a value.
+         */
+        bool hasLastRaw;
+
+        /**
+         * Whether the counter is stuck at maxRaw.
+         */
+        bool isSaturated;
+    };
+
+    Counter m_counters[NUM_COUNTERS];
+};
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IbWorkerPool.h"
+
+namespace Detector {
+
+IbWorkerPool::IbWorkerPool(uint32_t numWorkers) :
+        m_task(nullptr),
+        m_numItems(0),
+        m_nextItem(0),
+        m_numBusyWorkers(0),
+        m_generation(0),
+        m_isShuttingDown(false) {
+    // The calling thread of ParallelFor() acts as worker 0, so we only need to start numWorkers - 1 threads.
+    try {
+        for (uint32_t i = 1; i < numWorkers; i++) {
+            m_threads.emplace_back(&IbWorkerPool::Work, this, i);
+        }
+    } catch (...) {
+        // Destroying a joinable thread terminates the program, so the threads, that have been started, are stopped.
+        Shutdown();
+        throw;
+    }
+}
+
+IbWorkerPool::~IbWorkerPool() {
+    Shutdown();
+}
+
+void IbWorkerPool::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isShuttingDown = true;
+    }
+
+    m_startCondition.notify_all();
+
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+
+    m_threads.clear();
+}
+
+void IbWorkerPool::ParallelFor(size_t count, const Task &task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_task = &task;
+        m_numItems = count;
+        m_nextItem = 0;
+        m_numBusyWorkers = static_cast<uint32_t>(m_threads.size());
+        m_exception = nullptr;
+        m_generation++;
+    }
+
+    m_startCondition.notify_all();
+
+    RunTasks(0);
+
+    std::exception_ptr exception;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCondition.wait(lock, [this] { return m_numBusyWorkers == 0; });
+
+        m_task = nullptr;
+        exception = m_exception;
+        m_exception = nullptr;
+    }
+
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+void IbWorkerPool::Work(uint32_t worker) {
+    uint64_t lastGeneration = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_startCondition.wait(lock, [this, lastGeneration] {
+                return m_isShuttingDown || m_generation != lastGeneration;
+            });
+
+            if (m_isShuttingDown) {
+                return;
+            }
+
+            lastGeneration = m_generation;
+        }
+
+        RunTasks(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (--m_numBusyWorkers == 0) {
+                m_doneCondition.notify_one();
+            }
+        }
+    }
+}
+
+void IbWorkerPool::RunTasks(uint32_t worker) {
+    size_t item;
+
+    while ((item = m_nextItem.fetch_add(1)) < m_numItems) {
+        try {
+            (*m_task)(item, worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (!m_exception) {
+                m_exception = std::current_exception();
+            }
+        }
+    }
+}
+
+}
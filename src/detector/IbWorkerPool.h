@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBWORKERPOOL_H
+#define DETECTOR_IBWORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Detector {
+
+/**
+ * A fixed-size pool of worker threads, that is used to spread blocking work (e.g. MAD-queries) over multiple threads.
+ *
+ * The thread, that calls ParallelFor(), participates as worker 0. A pool with a single worker therefore does not
+ * start any threads at all and executes everything on the calling thread.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbWorkerPool {
+
+public:
+    /**
+     * Signature of a task. The first parameter is the index of the work item,
+     * the second one is the number of the worker, that executes the task (0 <= worker < GetNumWorkers()).
+     */
+    typedef std::function<void(size_t, uint32_t)> Task;
+
+    /**
+     * Constructor.
+     *
+     * @param numWorkers The amount of workers (including the calling thread). A value of 0 is treated as 1.
+     */
+    explicit IbWorkerPool(uint32_t numWorkers);
+
+    /**
+     * Destructor.
+     */
+    ~IbWorkerPool();
+
+    IbWorkerPool(const IbWorkerPool &copy) = delete;
+
+    IbWorkerPool &operator=(const IbWorkerPool &copy) = delete;
+
+    /**
+     * Execute a task for every index in [0, count) and block until all of them have finished.
+     *
+     * The work items are handed out dynamically, so slow items (e.g. unresponsive ports) do not stall a whole worker.
+     * If one or more tasks throw an exception, the remaining items are still processed
+     * and the first exception is rethrown afterwards.
+     *
+     * CAUTION: This function must not be called concurrently or from inside a task.
+     *
+     * @param count The amount of work items
+     * @param task The task to execute for each work item
+     */
+    void ParallelFor(size_t count, const Task &task);
+
+    /**
+     * Get the amount of workers (including the calling thread).
+     */
+    uint32_t GetNumWorkers() const {
+        return static_cast<uint32_t>(m_threads.size() + 1);
+    }
+
+private:
+    /**
+     * Main loop of a worker thread.
+     *
+     * @param worker The worker's number
+     */
+    void Work(uint32_t worker);
+
+    /**
+     * Stop and join all worker threads.
+     */
+    void Shutdown();
+
+    /**
+     * Fetch and execute work items, until there are none left.
+     *
+     * @param worker The worker's number
+     */
+    void RunTasks(uint32_t worker);
+
+private:
+    /**
+     * The pool's threads. The calling thread of ParallelFor() is not part of this vector.
+     */
+    std::vector<std::thread> m_threads;
+
+    /**
+     * Protects all of the following members, except m_nextItem.
+     */
+    std::mutex m_mutex;
+
+    /**
+     * Used to wake up the workers, when a new batch of work is available or the pool is shutting down.
+     */
+    std::condition_variable m_startCondition;
+
+    /**
+     * Used to wake up the calling thread of ParallelFor(), when all workers have finished.
+     */
+    std::condition_variable m_doneCondition;
+
+    /**
+     * The task of the current batch.
+     */
+    const Task *m_task;
+
+    /**
+     * The amount of work items in the current batch.
+     */
+    size_t m_numItems;
+
+    /**
+     * Index of the next work item, that has not been handed out yet.
+     */
+    std::atomic<size_t> m_nextItem;
+
+    /**
+     * The amount of pool threads, that are still working on the current batch.
+     */
+    uint32_t m_numBusyWorkers;
+
+    /**
+     * Incremented for every batch. Workers use it to detect new work.
+     */
+    uint64_t m_generation;
+
+    /**
+     * Set to true by the destructor, to let all workers exit.
+     */
+    bool m_isShuttingDown;
+
+    /**
+     * The first exception, that has been thrown by a task of the current batch.
+     */
+    std::exception_ptr m_exception;
+};
+
+}
+
+#endif
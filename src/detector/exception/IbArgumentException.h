@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef DETECTOR_IBARGUMENTEXCEPTION_H
+#define DETECTOR_IBARGUMENTEXCEPTION_H
+
+#include <exception>
+#include <string>
+#include "IbPerfException.h"
+
+namespace Detector {
+
+/**
+ * An exception, which signalises, that a function has been called with an invalid argument.
+ *
+ * @author Fabian Ruhland, Fabian.Ruhland@hhu.de
+ * @date October 2026
+ */
+class IbArgumentException : public IbPerfException {
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param message Error message
+     */
+    explicit IbArgumentException(const std::string &message) noexcept :
+            IbPerfException("Invalid argument: " + message) {
+
+    }
+
+    /**
+     * Destructor.
+     */
+    ~IbArgumentException() override = default;
+
+};
+
+}
+
+#endif
@@ -21,10 +21,11 @@
 #include <csignal>
 #include <iostream>
 #include <chrono>
-#include <thread>
 #include <verbs.h>
 #include <detector/BuildConfig.h>
 #include <detector/IbDiagPerfCounter.h>
+#include <detector/IbSampler.h>
+#include <detector/IbSysfsBatch.h>
 #include <detector/exception/IbFileException.h>
 #include <vector>
 
@@ -77,22 +78,39 @@ int main(int argc, char *argv[]) {
 
     ibv_free_device_list(deviceList);
 
+    // Read the counter files of all devices at once, if io_uring is available.
+    Detector::IbSysfsBatch batch;
+
+    for(const auto &diagCounter : counters) {
+        diagCounter->RegisterFiles(batch);
+    }
+
     signal(SIGINT, SignalHandler);
 
+    Detector::IbSampler sampler(std::chrono::seconds(5));
+
     while (isRunning) {
         try {
+            Detector::IbSampler::Sweep sweep = sampler.Sample([&batch, &counters] {
+                batch.Submit();
+
+                for(const auto &diagCounter : counters) {
+                    diagCounter->RefreshCounters();
+                }
+            });
+
             for(const auto &diagCounter : counters) {
-                diagCounter->RefreshCounters();
                 std::cout << *diagCounter << std::endl << std::endl;
             }
 
             std::cout << std::endl;
 
+            if(sweep.missedPeriods > 0) {
+                printf("Sweep %lu overran its period (%lu deadlines missed)!\n", sweep.number, sweep.missedPeriods);
+            }
         } catch (const Detector::IbFileException &exception) {
             printf("An exception occurred: %s\n", exception.what());
         }
-
-        std::this_thread::sleep_for(std::chrono::seconds(5));
     }
 
     for(const auto &diagCounter : counters) {
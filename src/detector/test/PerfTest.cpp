@@ -18,10 +18,10 @@
 
 #include <csignal>
 #include <chrono>
-#include <thread>
 #include <detector/BuildConfig.h>
 #include <detector/exception/IbMadException.h>
 #include <detector/IbFabric.h>
+#include <detector/IbSampler.h>
 
 bool isRunning = true;
 
@@ -35,7 +35,7 @@ int main(int argc, char *argv[]) {
     Detector::BuildConfig::printBanner();
 
     if(argc < 3) {
-        printf("Usage: ./perftest <network/local> <mad/compat>\n");
+        printf("Usage: ./perftest <network/local> <mad/compat> [threads] [query window]\n");
         exit(EXIT_FAILURE);
     }
 
@@ -47,7 +47,7 @@ int main(int argc, char *argv[]) {
     } else if(!strcmp(argv[1], "local")) {
         network = false;
     } else {
-        printf("Usage: ./perftest <network/local> <mad/compat>\n");
+        printf("Usage: ./perftest <network/local> <mad/compat> [threads] [query window]\n");
         exit(EXIT_FAILURE);
     }
 
@@ -56,22 +56,45 @@ int main(int argc, char *argv[]) {
     } else if(!strcmp(argv[2], "compat")) {
         compat = true;
     } else {
-        printf("Usage: ./perftest <network/local> <mad/compat>\n");
+        printf("Usage: ./perftest <network/local> <mad/compat> [threads] [query window]\n");
         exit(EXIT_FAILURE);
     }
 
     Detector::IbFabric fabric(network, compat);
 
+    for(const std::string &error : fabric.GetDiscoveryErrors()) {
+        printf("Failed to set up a device: %s\n", error.c_str());
+    }
+
+    if(argc > 3) {
+        fabric.SetNumThreads(static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)));
+    }
+
+    if(argc > 4) {
+        fabric.SetQueryWindow(static_cast<uint32_t>(strtoul(argv[4], nullptr, 10)));
+    }
+
     signal(SIGINT, SignalHandler);
 
+    Detector::IbSampler sampler(std::chrono::seconds(5));
+
     while(isRunning) {
         try {
-            fabric.RefreshCounters();
+            Detector::IbSampler::Sweep sweep = sampler.Sample([&fabric] { fabric.RefreshCounters(); });
+
+            Detector::IbPerfRates rates = fabric.GetRates();
+
             std::cout << fabric << std::endl << std::endl;
+
+            printf("Fabric throughput: Xmit %.2f MB/s, Rcv %.2f MB/s\n\n",
+                   rates.values[Detector::COUNTER_XMIT_DATA_BYTES] / 1000000.0,
+                   rates.values[Detector::COUNTER_RCV_DATA_BYTES] / 1000000.0);
+
+            if(sweep.missedPeriods > 0) {
+                printf("Sweep %lu overran its period (%lu deadlines missed)!\n", sweep.number, sweep.missedPeriods);
+            }
         } catch(const Detector::IbPerfException &exception) {
             printf("An exception occurred: %s", exception.what());
         }
-
-        std::this_thread::sleep_for(std::chrono::seconds(5));
     }
 }
\ No newline at end of file
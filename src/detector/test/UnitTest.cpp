@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2018 Heinrich-Heine-Universitaet Duesseldorf,
+ * Institute of Computer Science, Department Operating Systems
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <detector/exception/IbFileException.h>
+#include <detector/exception/IbNetDiscException.h>
+#include <detector/IbCounterKernels.h>
+#include <detector/IbCounterRegistry.h>
+#include <detector/IbDiscoveryOptions.h>
+#include <detector/IbMadPortPool.h>
+#include <detector/IbPerfCounter.h>
+#include <detector/IbTopologyCache.h>
+#include <detector/IbVirtualCounters.h>
+
+// Tests, that do not need any InfiniBand hardware. The program exits with EXIT_FAILURE, if any check fails.
+
+static uint32_t numChecks = 0;
+static uint32_t numFailures = 0;
+
+static void Check(bool condition, const char *test, const char *description) {
+    numChecks++;
+
+    if (!condition) {
+        printf("[%s] FAILED: %s\n", test, description);
+        numFailures++;
+    }
+}
+
+static void TestCounterKernels() {
+    const char *test = "IbCounterKernels";
+    std::mt19937_64 random(42);
+
+    auto implementations = Detector::IbCounterKernels::GetSupportedImplementations();
+    const Detector::IbCounterKernels::Implementation *scalar = implementations.front();
+
+    printf("[%s] Comparing %zu implementation(s) against the scalar one\n", test, implementations.size() - 1);
+
+    // Odd lengths exercise the scalar remainders of the vectorized loops.
+    for (size_t count = 0; count <= 67; count++) {
+        std::vector<uint64_t> current(count);
+        std::vector<uint64_t> previous(count);
+
+        for (size_t i = 0; i < count; i++) {
+            current[i] = random();
+            // Every third value is smaller than before, which looks like a reset and must yield a delta of 0.
+            previous[i] = i % 3 == 0 ? current[i] + 1 + random() % 1000 : current[i] - random() % 1000;
+        }
+
+        // Values close to 2^64 make the sums wrap around.
+        if (count > 0) {
+            current[0] = UINT64_MAX;
+        }
+
+        std::vector<uint64_t> expectedTotals(previous);
+        std::vector<uint64_t> expectedDeltas(count);
+
+        scalar->add(expectedTotals.data(), current.data(), count);
+        scalar->subtract(current.data(), previous.data(), expectedDeltas.data(), count);
+        uint64_t expectedSum = scalar->sum(current.data(), count);
+
+        for (const Detector::IbCounterKernels::Implementation *implementation : implementations) {
+            std::vector<uint64_t> totals(previous);
+            std::vector<uint64_t> deltas(count);
+
+            implementation->add(totals.data(), current.data(), count);
+            implementation->subtract(current.data(), previous.data(), deltas.data(), count);
+
+            Check(implementation->sum(current.data(), count) == expectedSum, test, implementation->name);
+            Check(totals == expectedTotals, test, implementation->name);
+            Check(deltas == expectedDeltas, test, implementation->name);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            Check(expectedDeltas[i] == (current[i] < previous[i] ? 0 : current[i] - previous[i]), test,
+                  "Scalar subtraction clamps resets to 0");
+        }
+    }
+}
+
+static void TestVirtualCounters() {
+    const char *test = "IbVirtualCounters";
+    Detector::IbVirtualCounters counters;
+
+    // A wrapping 32-bit counter continues counting past its maximum value.
+    counters.SetWidth(Detector::COUNTER_XMIT_DATA_BYTES, 32, Detector::IbVirtualCounters::OVERFLOW_WRAP);
+    counters.Update(Detector::COUNTER_XMIT_DATA_BYTES, 0xfffffff0);
+    Check(counters.Update(Detector::COUNTER_XMIT_DATA_BYTES, 0x10) == 0x100000010, test, "Wrap is detected");
+    Check(counters.GetNumOverflows(Detector::COUNTER_XMIT_DATA_BYTES) == 1, test, "Wrap is counted");
+    Check(!counters.IsSaturated(Detector::COUNTER_XMIT_DATA_BYTES), test, "Wrapping counter does not saturate");
+
+    // A saturating 16-bit counter stops at its maximum value, until it is restarted.
+    counters.SetWidth(Detector::COUNTER_SYMBOL_ERRORS, 16, Detector::IbVirtualCounters::OVERFLOW_SATURATE);
+    counters.Update(Detector::COUNTER_SYMBOL_ERRORS, 100);
+    Check(counters.Update(Detector::COUNTER_SYMBOL_ERRORS, 0xffff) == 0xffff, test, "Saturated value is kept");
+    Check(counters.IsSaturated(Detector::COUNTER_SYMBOL_ERRORS), test, "Saturation is detected");
+    Check(counters.IsAnySaturated(), test, "Saturation is reported");
+    Check(counters.GetNumOverflows(Detector::COUNTER_SYMBOL_ERRORS) == 1, test, "Saturation is counted");
+
+    counters.RestartCounter(Detector::COUNTER_SYMBOL_ERRORS);
+    Check(counters.Update(Detector::COUNTER_SYMBOL_ERRORS, 5) == 0x10004, test, "Restarted counter continues");
+    Check(!counters.IsSaturated(Detector::COUNTER_SYMBOL_ERRORS), test, "Restart clears saturation");
+
+    // A 64-bit counter, whose raw value becomes smaller, has been reset by someone else.
+    counters.Update(Detector::COUNTER_XMIT_PKTS, 1000);
+    Check(counters.Update(Detector::COUNTER_XMIT_PKTS, 10) == 1010, test, "External reset continues counting");
+
+    // A raw value, that does not fit into the configured width, widens the counter.
+    counters.SetWidth(Detector::COUNTER_RCV_PKTS, 32, Detector::IbVirtualCounters::OVERFLOW_WRAP);
+    counters.Update(Detector::COUNTER_RCV_PKTS, 0x100000000);
+    Check(counters.GetWidth(Detector::COUNTER_RCV_PKTS) == 64, test, "Too large raw value widens the counter");
+
+    counters.Reset();
+    Check(!counters.HasValue(Detector::COUNTER_XMIT_DATA_BYTES), test, "Reset forgets the values");
+    Check(!counters.IsAnySaturated(), test, "Reset clears saturation");
+    Check(counters.Update(Detector::COUNTER_XMIT_DATA_BYTES, 7) == 7, test, "Value after reset is taken as it is");
+    Check(counters.GetNumOverflows(Detector::COUNTER_XMIT_DATA_BYTES) == 0, test, "Reset clears overflows");
+    Check(counters.GetWidth(Detector::COUNTER_SYMBOL_ERRORS) == 16, test, "Reset keeps the widths");
+}
+
+/**
+ * Decodes raw values like IbPort::DecodeResponse(): The baseline is subtracted from the raw value,
+ * before per-lane counters are multiplied by the link width.
+ */
+class BaselineTestCounter : public Detector::IbPerfCounter {
+
+public:
+    explicit BaselineTestCounter(uint8_t linkWidth) : m_linkWidth(linkWidth) {
+        SetBaselineReset(true);
+    }
+
+    void ResetCounters() override {
+        AdvanceBaseline(Detector::COUNTER_XMIT_DATA_BYTES, m_linkWidth);
+        AdvanceBaseline(Detector::COUNTER_XMIT_PKTS, m_linkWidth);
+    }
+
+    void RefreshCounters() override {
+
+    }
+
+    void Decode(Detector::IbCounterId id, uint64_t rawValue) {
+        uint64_t value = ApplyBaseline(id, rawValue);
+
+        SetCounter(id, Detector::IbCounterRegistry::Get(id).isPerLane ? value * m_linkWidth : value);
+    }
+
+private:
+    uint8_t m_linkWidth;
+};
+
+static void TestBaselineReset() {
+    const char *test = "IbPerfCounter";
+    BaselineTestCounter counter(4);
+
+    counter.Decode(Detector::COUNTER_XMIT_DATA_BYTES, 1000);
+    counter.Decode(Detector::COUNTER_XMIT_PKTS, 1000);
+    Check(counter.GetCounter(Detector::COUNTER_XMIT_DATA_BYTES) == 4000, test, "Per-lane value is multiplied");
+
+    // After the reset, only the increase since the reset is counted, on a 4x link as well as per packet.
+    counter.ResetCounters();
+    counter.Decode(Detector::COUNTER_XMIT_DATA_BYTES, 1010);
+    counter.Decode(Detector::COUNTER_XMIT_PKTS, 1010);
+    Check(counter.GetCounter(Detector::COUNTER_XMIT_DATA_BYTES) == 40, test, "Per-lane baseline is in raw units");
+    Check(counter.GetCounter(Detector::COUNTER_XMIT_PKTS) == 10, test, "Baseline is the last raw value");
+
+    // A second reset moves the baseline forward again.
+    counter.ResetCounters();
+    counter.Decode(Detector::COUNTER_XMIT_DATA_BYTES, 1011);
+    Check(counter.GetCounter(Detector::COUNTER_XMIT_DATA_BYTES) == 4, test, "Baselines accumulate");
+
+    // A raw value below the baseline still means, that the device has been reset.
+    counter.Decode(Detector::COUNTER_XMIT_DATA_BYTES, 5);
+    Check(counter.GetCounter(Detector::COUNTER_XMIT_DATA_BYTES) == 20, test, "Device reset clears the baseline");
+}
+
+static std::vector<char> ReadFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::string &path, const std::vector<char> &data) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    file.write(data.data(), data.size());
+}
+
+static bool IsRejected(const std::string &path) {
+    try {
+        Detector::IbTopologyCache cache(path);
+    } catch (const Detector::IbFileException &exception) {
+        return true;
+    }
+
+    return false;
+}
+
+static void TestTopologyCache() {
+    const char *test = "IbTopologyCache";
+    const std::string path = "unittest-topology.cache";
+    const std::string copyPath = "unittest-topology-copy.cache";
+
+    Detector::IbTopologyCache::Header header{};
+    Detector::IbTopologyCache::NodeRecord node{};
+    Detector::IbTopologyCache::PortRecord ports[2]{};
+
+    memcpy(header.magic, "IBDTOPO", sizeof(header.magic));
+    header.version = TOPOLOGY_CACHE_VERSION;
+    header.byteOrder = TOPOLOGY_CACHE_BYTE_ORDER;
+    header.numNodes = 1;
+    header.numPorts = 2;
+    header.isNetwork = 1;
+    header.scopeFingerprint = 0x0123456789abcdef;
+
+    node.guid = 0x0002c90300a1b2c3;
+    node.firstPort = 0;
+    node.numPortRecords = 2;
+    node.numPorts = 2;
+    node.nodeType = IB_NODE_CA;
+    strncpy(node.description, "node01 HCA-1", TOPOLOGY_CACHE_DESC_SIZE - 1);
+
+    for (uint8_t i = 0; i < 2; i++) {
+        ports[i].lid = static_cast<uint16_t>(10 + i);
+        ports[i].portNum = static_cast<uint8_t>(i + 1);
+        ports[i].nodeType = IB_NODE_CA;
+        ports[i].linkWidth = 4;
+        ports[i].hasClassPortInfo = 1;
+        ports[i].capabilityMask = 0x1234;
+        ports[i].capabilityMask2 = 0x56789a;
+        ports[i].remotePortNum = static_cast<uint8_t>(20 + i);
+        ports[i].remoteNodeType = IB_NODE_SWITCH;
+        ports[i].remoteGuid = 0x0002c90300ffff00 + i;
+    }
+
+    std::vector<char> data;
+    data.insert(data.end(), reinterpret_cast<char *>(&header), reinterpret_cast<char *>(&header + 1));
+    data.insert(data.end(), reinterpret_cast<char *>(&node), reinterpret_cast<char *>(&node + 1));
+    data.insert(data.end(), reinterpret_cast<char *>(ports), reinterpret_cast<char *>(ports + 2));
+    WriteFile(path, data);
+
+    // Load the cache, set up the nodes from it and save them again, which must yield the same file.
+    try {
+        Detector::IbMadPortPool pool(1);
+        Detector::IbTopologyCache cache(path);
+
+        Check(cache.IsNetwork(), test, "Network flag is loaded");
+        Check(cache.GetScopeFingerprint() == header.scopeFingerprint, test, "Scope is loaded");
+        Check(cache.GetNumNodes() == 1, test, "Nodes are loaded");
+
+        Detector::IbPort::Capabilities capabilities = cache.GetPortCapabilities(cache.GetNode(0), 1);
+        Check(capabilities.lid == 11 && capabilities.portNum == 2 && capabilities.linkWidth == 4 &&
+              capabilities.capabilityMask == 0x1234 && capabilities.capabilityMask2 == 0x56789a &&
+              capabilities.remoteGuid == 0x0002c90300ffff01, test, "Port capabilities are loaded");
+
+        Detector::IbNode cachedNode(cache, 0, pool);
+        Check(cachedNode.GetGuid() == node.guid && cachedNode.GetDescription() == "node01 HCA-1" &&
+              cachedNode.GetPorts().size() == 2, test, "Node is set up from the cache");
+
+        Detector::IbTopologyCache::Save(copyPath, {&cachedNode}, true, header.scopeFingerprint);
+        Check(ReadFile(copyPath) == data, test, "Saved cache equals the loaded one");
+    } catch (const Detector::IbPerfException &exception) {
+        Check(false, test, exception.what());
+    }
+
+    // Corrupt copies of the file must be rejected instead of being mapped.
+    std::vector<char> corrupt(data);
+    corrupt[0] = 'X';
+    WriteFile(copyPath, corrupt);
+    Check(IsRejected(copyPath), test, "Wrong magic is rejected");
+
+    corrupt = data;
+    corrupt.resize(data.size() - 1);
+    WriteFile(copyPath, corrupt);
+    Check(IsRejected(copyPath), test, "Truncated file is rejected");
+
+    corrupt = data;
+    reinterpret_cast<Detector::IbTopologyCache::Header *>(corrupt.data())->version = TOPOLOGY_CACHE_VERSION + 1;
+    WriteFile(copyPath, corrupt);
+    Check(IsRejected(copyPath), test, "Other version is rejected");
+
+    corrupt = data;
+    reinterpret_cast<Detector::IbTopologyCache::NodeRecord *>(corrupt.data() + sizeof(header))->firstPort = 1;
+    WriteFile(copyPath, corrupt);
+    Check(IsRejected(copyPath), test, "Port records out of range are rejected");
+
+    Check(IsRejected("unittest-missing.cache"), test, "Missing file is rejected");
+
+    remove(path.c_str());
+    remove(copyPath.c_str());
+}
+
+static void TestDiscoveryOptions() {
+    const char *test = "IbDiscoveryOptions";
+    const std::vector<uint16_t> lids{10, 11};
+
+    Detector::IbDiscoveryOptions options;
+    Check(!options.HasFilters(), test, "No filters by default");
+    Check(options.IsMatch(1, IB_NODE_CA, "node01 HCA-1", lids), test, "Everything matches without filters");
+
+    options.IncludeNodeType(IB_NODE_CA);
+    options.IncludeLidRange(5, 10);
+    Check(options.HasFilters(), test, "Filters are reported");
+    Check(options.IsMatch(1, IB_NODE_CA, "node01 HCA-1", lids), test, "A single port in the LID range matches");
+    Check(!options.IsMatch(1, IB_NODE_SWITCH, "node01 HCA-1", lids), test, "Other node type does not match");
+    Check(!options.IsMatch(1, IB_NODE_CA, "node01 HCA-1", {11, 12}), test, "LIDs out of range do not match");
+
+    options.IncludeDescription("^node0[1-3] ");
+    Check(options.IsMatch(1, IB_NODE_CA, "node02 HCA-1", lids), test, "Included description matches");
+    Check(!options.IsMatch(1, IB_NODE_CA, "node04 HCA-1", lids), test, "Other description does not match");
+
+    options.ExcludeGuid(2);
+    options.ExcludeDescription("HCA-2");
+    Check(!options.IsMatch(2, IB_NODE_CA, "node01 HCA-1", lids), test, "Excluded GUID does not match");
+    Check(!options.IsMatch(1, IB_NODE_CA, "node01 HCA-2", lids), test, "Excluded description does not match");
+    Check(options.IsMatch(1, IB_NODE_CA, "node01 HCA-1", lids), test, "Other nodes still match");
+
+    options.ExcludeLidRange(11, 11);
+    Check(!options.IsMatch(1, IB_NODE_CA, "node01 HCA-1", lids), test, "Excluded LID range does not match");
+
+    bool isRejected = false;
+
+    try {
+        options.IncludeDescription("node(");
+    } catch (const Detector::IbNetDiscException &exception) {
+        isRejected = true;
+    }
+
+    Check(isRejected, test, "Invalid pattern is rejected");
+
+    // The fingerprint only depends on the scope, so that a topology cache can be checked against it.
+    Detector::IbDiscoveryOptions scope;
+    Detector::IbDiscoveryOptions sameScope;
+    uint64_t defaultFingerprint = scope.GetScopeFingerprint();
+
+    scope.SetCachePath("unittest.cache");
+    scope.SetLazyPortInit(true);
+    Check(scope.GetScopeFingerprint() == defaultFingerprint, test, "Cache path and lazy flag are not in the scope");
+
+    scope.SetMaxHops(2);
+    Check(scope.GetScopeFingerprint() != defaultFingerprint, test, "Hop limit changes the scope");
+
+    sameScope.SetMaxHops(2);
+    Check(scope.GetScopeFingerprint() == sameScope.GetScopeFingerprint(), test, "Same scope, same fingerprint");
+
+    scope.SetStartLid(0x12);
+    Check(scope.GetScopeFingerprint() != sameScope.GetScopeFingerprint(), test, "Start LID changes the scope");
+
+    sameScope.SetStartLid(0x12);
+    sameScope.SetStartPort("mlx5_0", 1);
+    Check(scope.GetScopeFingerprint() != sameScope.GetScopeFingerprint(), test, "Start port changes the scope");
+
+    scope.SetStartPort("mlx5_0", 1);
+    scope.IncludeDescription("^rack4-");
+    Check(scope.GetScopeFingerprint() != sameScope.GetScopeFingerprint(), test, "Filters change the scope");
+}
+
+static void TestCounterRegistry() {
+    const char *test = "IbCounterRegistry";
+    const uint32_t groupMasks[] = {Detector::COUNTER_MASK_DATA, Detector::COUNTER_MASK_CAST,
+                                   Detector::COUNTER_MASK_ERRORS, Detector::COUNTER_MASK_XMIT_WAIT};
+    uint32_t allGroups = 0;
+    uint32_t counterSelectBits = 0;
+
+    for (uint32_t mask : groupMasks) {
+        Check((allGroups & mask) == 0, test, "Groups are disjoint");
+        allGroups |= mask;
+    }
+
+    Check(allGroups == Detector::COUNTER_MASK_ALL, test, "Groups cover all counters");
+    Check(Detector::COUNTER_MASK_DATA == (Detector::CounterMaskBit(Detector::COUNTER_XMIT_DATA_BYTES) |
+                                          Detector::CounterMaskBit(Detector::COUNTER_RCV_DATA_BYTES) |
+                                          Detector::CounterMaskBit(Detector::COUNTER_XMIT_PKTS) |
+                                          Detector::CounterMaskBit(Detector::COUNTER_RCV_PKTS)),
+          test, "Data mask selects data and packets");
+    Check(Detector::COUNTER_MASK_XMIT_WAIT == Detector::CounterMaskBit(Detector::COUNTER_XMIT_WAIT), test,
+          "Congestion mask selects the transmission-wait counter");
+
+    for (const Detector::IbCounterDescriptor &counter : Detector::IbCounterRegistry::COUNTERS) {
+        Check((counterSelectBits & counter.counterSelectBit) == 0, test, "CounterSelect bits are unique");
+        counterSelectBits |= counter.counterSelectBit;
+
+        Check(counter.field != IB_NO_FIELD || counter.extendedCapability == Detector::CAPABILITY_EXTENDED_WIDTH,
+              test, "Counters without a PortCounters field require PortCountersExtended");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    TestCounterKernels();
+    TestVirtualCounters();
+    TestBaselineReset();
+    TestTopologyCache();
+    TestDiscoveryOptions();
+    TestCounterRegistry();
+
+    printf("%u of %u checks passed\n", numChecks - numFailures, numChecks);
+
+    return numFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}